@@ -0,0 +1,300 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "autotune.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <libgen.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *RULE_NAMES[] = { "Ziegler-Nichols", "Tyreus-Luyben" };
+
+static double elapsed_s(const struct timespec *start,
+			const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) * 1.0E-9;
+}
+
+/* Run the relay test around set_point. The first full oscillation is
+ * discarded, Ku and Tu are averaged over the following cycles. */
+void autotune_init(autotune_t *at, const enum AUTOTUNE_RULE rule,
+		   const double set_point, const double output_low,
+		   const double output_high, const double hysteresis,
+		   const unsigned int cycles, const uint32_t timeout_s)
+{
+	assert(at != NULL);
+	assert(output_high > output_low);
+	assert(hysteresis >= 0.0);
+	assert(cycles > 0);
+
+	memset(at, 0, sizeof(*at));
+	at->state = AUTOTUNE_RUNNING;
+	at->rule = rule;
+	at->set_point = set_point;
+	at->output_low = output_low;
+	at->output_high = output_high;
+	at->hysteresis = hysteresis;
+	at->cycles = cycles;
+	at->timeout_s = timeout_s;
+}
+
+static void finish(autotune_t *at)
+{
+	const double amplitude = at->amplitude_sum / at->cycles;
+	const double d = (at->output_high - at->output_low) / 2.0;
+
+	/* the hysteresis shifts the switching points, describing function
+	 * of a relay with hysteresis */
+	double a = amplitude;
+	if (amplitude > at->hysteresis) {
+		const double h = at->hysteresis;
+		a = sqrt(amplitude * amplitude - h * h);
+	}
+
+	at->tu = at->period_sum / at->cycles;
+	at->ku = 4.0 * d / (M_PI * a);
+	at->state = AUTOTUNE_DONE;
+}
+
+/* Feed a measurement, output is set to the relay output to apply until the
+ * next one. Measurements that aren't newer than the last one are ignored. */
+enum AUTOTUNE_STATE autotune_update(autotune_t *at, const double input,
+				    const struct timespec *timestamp,
+				    double *output)
+{
+	assert(at != NULL);
+	assert(timestamp != NULL);
+	assert(output != NULL);
+
+	*output = at->output_low;
+	if (at->state != AUTOTUNE_RUNNING) {
+		return at->state;
+	}
+
+	if (!at->has_input) {
+		at->has_input = 1;
+		at->start = *timestamp;
+		at->relay_high = input < at->set_point;
+	} else {
+		const double dt = elapsed_s(&at->last_update, timestamp);
+		const double applied =
+		    at->relay_high ? at->output_high : at->output_low;
+		if (dt <= 0.0) {
+			*output = applied;
+			return at->state;
+		}
+		if (at->has_cycle_start) {
+			at->output_sum += applied * dt;
+			at->output_time += dt;
+		}
+	}
+	at->last_update = *timestamp;
+	if (elapsed_s(&at->start, timestamp) > at->timeout_s) {
+		fprintf(stderr, "autotune: no stable oscillation after %u s\n",
+			(unsigned int)at->timeout_s);
+		at->state = AUTOTUNE_FAILED;
+		return at->state;
+	}
+
+	if (input > at->cycle_max) {
+		at->cycle_max = input;
+	}
+	if (input < at->cycle_min) {
+		at->cycle_min = input;
+	}
+
+	if (at->relay_high && input > at->set_point + at->hysteresis) {
+		at->relay_high = 0;
+
+		/* a cycle runs from one switch to low to the next */
+		if (at->has_cycle_start && ++at->cycle > 1) {
+			at->period_sum +=
+			    elapsed_s(&at->cycle_start, timestamp);
+			at->amplitude_sum +=
+			    (at->cycle_max - at->cycle_min) / 2.0;
+			printf("autotune: cycle %u of %u, period %.0f s, "
+			       "amplitude %.3f\n",
+			       at->cycle - 1, at->cycles,
+			       elapsed_s(&at->cycle_start, timestamp),
+			       (at->cycle_max - at->cycle_min) / 2.0);
+			if (at->cycle - 1 == at->cycles) {
+				finish(at);
+				return at->state;
+			}
+		}
+		at->has_cycle_start = 1;
+		at->cycle_start = *timestamp;
+		at->cycle_max = input;
+		at->cycle_min = input;
+	} else if (!at->relay_high &&
+		   input < at->set_point - at->hysteresis) {
+		at->relay_high = 1;
+	}
+
+	*output = at->relay_high ? at->output_high : at->output_low;
+	return at->state;
+}
+
+void autotune_get_gains(const autotune_t *at, struct pid_gains *gains)
+{
+	double ti, td;
+
+	assert(at != NULL);
+	assert(at->state == AUTOTUNE_DONE);
+	assert(gains != NULL);
+
+	switch (at->rule) {
+	case AUTOTUNE_ZIEGLER_NICHOLS:
+		gains->kp = 0.6 * at->ku;
+		ti = 0.5 * at->tu;
+		td = 0.125 * at->tu;
+		break;
+	default:
+		gains->kp = at->ku / 2.2;
+		ti = 2.2 * at->tu;
+		td = at->tu / 6.3;
+		break;
+	}
+	gains->ki = gains->kp / ti;
+	gains->kd = gains->kp * td;
+}
+
+/* Mean relay output over the oscillation so far, about the output that
+ * holds the bath at the set point. Controllers taking over from the relay
+ * start from it. Before the first cycle this is the current relay output. */
+double autotune_get_mean_output(const autotune_t *at)
+{
+	assert(at != NULL);
+
+	if (at->output_time <= 0.0) {
+		return at->relay_high ? at->output_high : at->output_low;
+	}
+	return at->output_sum / at->output_time;
+}
+
+/* Read gains stored by autotune_store_gains(). Returns -1 and leaves gains
+ * alone if there are none or they aren't finite and non-negative. */
+int autotune_load_gains(const char *path, struct pid_gains *gains)
+{
+	char line[256];
+	double kp, ki, kd;
+
+	assert(path != NULL);
+	assert(gains != NULL);
+
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return -1;
+	}
+
+	int rc = -1;
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#') {
+			continue;
+		}
+		if (sscanf(line, "%lf %lf %lf", &kp, &ki, &kd) == 3 &&
+		    isfinite(kp) && isfinite(ki) && isfinite(kd) &&
+		    kp >= 0.0 && ki >= 0.0 && kd >= 0.0) {
+			rc = 0;
+		}
+		break;
+	}
+	fclose(file);
+
+	if (rc == 0) {
+		gains->kp = kp;
+		gains->ki = ki;
+		gains->kd = kd;
+	}
+
+	if (rc == -1) {
+		fprintf(stderr, "autotune: invalid gains in %s\n", path);
+	}
+	return rc;
+}
+
+/* Write gains under a temporary name and rename the file into place. at,
+ * which may be NULL, documents where the gains came from. */
+int autotune_store_gains(const char *path, const struct pid_gains *gains,
+			 const autotune_t *at)
+{
+	char dir[PATH_MAX];
+	char tmp_path[PATH_MAX];
+
+	assert(path != NULL);
+	assert(gains != NULL);
+
+	if (snprintf(dir, sizeof(dir), "%s", path) >= (int)sizeof(dir) ||
+	    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >=
+		(int)sizeof(tmp_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (mkdir(dirname(dir), 0755) == -1 && errno != EEXIST) {
+		fprintf(stderr, "autotune: failed to create %s: %s\n", dir,
+			strerror(errno));
+		return -1;
+	}
+
+	int fd = mkstemp(tmp_path);
+	if (fd == -1) {
+		fprintf(stderr, "autotune: failed to create %s: %s\n",
+			tmp_path, strerror(errno));
+		return -1;
+	}
+	FILE *file = fdopen(fd, "w");
+	if (!file) {
+		close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+
+	fprintf(file, "# sousvided PID gains: kp ki kd\n");
+	if (at) {
+		fprintf(file, "# %s from Ku=%g Tu=%gs\n", RULE_NAMES[at->rule],
+			at->ku, at->tu);
+	}
+	fprintf(file, "%.9g %.9g %.9g\n", gains->kp, gains->ki, gains->kd);
+
+	if (fflush(file) != 0 || fchmod(fd, 0644) == -1 || fsync(fd) == -1) {
+		fprintf(stderr, "autotune: failed to write %s: %s\n", tmp_path,
+			strerror(errno));
+		fclose(file);
+		unlink(tmp_path);
+		return -1;
+	}
+	fclose(file);
+
+	if (rename(tmp_path, path) == -1) {
+		fprintf(stderr, "autotune: failed to rename %s: %s\n",
+			tmp_path, strerror(errno));
+		unlink(tmp_path);
+		return -1;
+	}
+	return 0;
+}
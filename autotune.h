@@ -0,0 +1,103 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_AUTOTUNE_H
+#define SOUSVIDED_AUTOTUNE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Relay feedback autotuner (Astrom-Hagglund). The heater is switched
+ * between two outputs whenever the temperature leaves a hysteresis band
+ * around the set point, which makes the bath oscillate with the ultimate
+ * period Tu. The ultimate gain Ku follows from the relay and oscillation
+ * amplitudes. Ku and Tu give the PID gains by one of the tuning rules. */
+
+/* Where tuned gains are kept between runs */
+#ifndef PID_GAINS_DIR
+#define PID_GAINS_DIR "/var/lib/sousvided"
+#endif
+#define PID_GAINS_FILE PID_GAINS_DIR "/pid-gains"
+
+enum AUTOTUNE_STATE {
+	AUTOTUNE_OFF = 0,
+	AUTOTUNE_RUNNING,
+	AUTOTUNE_DONE,
+	AUTOTUNE_FAILED
+};
+
+enum AUTOTUNE_RULE {
+	AUTOTUNE_ZIEGLER_NICHOLS = 0, /* fast, about 25% overshoot */
+	AUTOTUNE_TYREUS_LUYBEN        /* slower, little overshoot */
+};
+
+/* Gains in the form pidctrl_tune() takes them, ki per second and kd in
+ * seconds */
+struct pid_gains
+{
+	double kp;
+	double ki;
+	double kd;
+};
+
+struct autotune
+{
+	enum AUTOTUNE_STATE state;
+	enum AUTOTUNE_RULE rule;
+	double set_point;
+	double output_low;
+	double output_high;
+	double hysteresis;
+	unsigned int cycles; /* to measure, after the first one */
+	uint32_t timeout_s;
+
+	int relay_high;
+	int has_input;
+	struct timespec start;
+	struct timespec last_update; /* timestamp of the last measurement */
+	struct timespec cycle_start;
+	int has_cycle_start;
+	double cycle_max;
+	double cycle_min;
+	unsigned int cycle;
+	double period_sum;
+	double amplitude_sum;
+	double output_sum; /* relay output integrated since the first cycle */
+	double output_time; /* s */
+
+	double ku;
+	double tu; /* s */
+};
+typedef struct autotune autotune_t;
+
+void autotune_init(autotune_t *at, const enum AUTOTUNE_RULE rule,
+		   const double set_point, const double output_low,
+		   const double output_high, const double hysteresis,
+		   const unsigned int cycles, const uint32_t timeout_s);
+enum AUTOTUNE_STATE autotune_update(autotune_t *at, const double input,
+				    const struct timespec *timestamp,
+				    double *output);
+void autotune_get_gains(const autotune_t *at, struct pid_gains *gains);
+double autotune_get_mean_output(const autotune_t *at);
+
+int autotune_load_gains(const char *path, struct pid_gains *gains);
+int autotune_store_gains(const char *path, const struct pid_gains *gains,
+			 const autotune_t *at);
+
+#endif /* SOUSVIDED_AUTOTUNE_H */
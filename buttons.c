@@ -27,7 +27,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <pthread.h>
 #include <unistd.h>
 
-#include "bcm2835.h"
+#include "hal.h"
+#include "trace.h"
 
 void button_init(button_t *btn, const uint8_t pin)
 {
@@ -38,10 +39,10 @@ void button_init(button_t *btn, const uint8_t pin)
 	btn->last_event = 0;
 
 	/* set pin as input */
-	bcm2835_gpio_fsel(btn->pin, BCM2835_GPIO_FSEL_INPT);
+	hal_gpio_function(btn->pin, HAL_GPIO_INPUT);
 
 	/* activate rising edge detection */
-	bcm2835_gpio_ren(btn->pin);
+	hal_gpio_detect(btn->pin, HAL_GPIO_DETECT_RISING, 1);
 
 	btn->initialized = 1;
 }
@@ -52,10 +53,10 @@ void button_cleanup(button_t *btn)
 	assert(btn->initialized);
 
 	/* disable rising edge detection */
-	bcm2835_gpio_clr_ren(btn->pin);
+	hal_gpio_detect(btn->pin, HAL_GPIO_DETECT_RISING, 0);
 
 	/* clear event detection status for this pin */
-	bcm2835_gpio_set_eds(btn->pin);
+	hal_gpio_clear_event_status(btn->pin);
 
 	btn->pin = 0xFF;
 	btn->last_event = 0xFFFFFFFF;
@@ -67,8 +68,8 @@ static int notify_needed(button_t *btn, const uint32_t debounce,
 {
 	assert(btn != NULL);
 
-	if (bcm2835_gpio_eds(btn->pin)) {
-		bcm2835_gpio_set_eds(btn->pin);
+	if (hal_gpio_event_status(btn->pin)) {
+		hal_gpio_clear_event_status(btn->pin);
 		if (milli_secs - btn->last_event > debounce) {
 			btn->last_event = milli_secs;
 			return 1;
@@ -87,6 +88,7 @@ static void *button_ctrl_thread(void *user_data)
 	struct timespec now;
 	uint64_t milli_secs;
 
+	trace_thread_name("buttons");
 	while (1) {
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		milli_secs = (now.tv_sec * 1000) + (now.tv_nsec / 1000000);
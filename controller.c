@@ -0,0 +1,76 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "controller.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+void controller_init(controller_t *c, const struct controller_ops *ops,
+		     void *state)
+{
+	assert(c != NULL);
+	assert(ops != NULL);
+	assert(ops->update != NULL);
+	assert(ops->get_set_point != NULL);
+	assert(ops->set_set_point != NULL);
+	assert(ops->reset != NULL);
+
+	c->ops = ops;
+	c->state = state;
+}
+
+const char *controller_name(const controller_t *c)
+{
+	assert(c != NULL);
+	return c->ops->name;
+}
+
+double controller_update(controller_t *c, const double input,
+			 const struct timespec *timestamp)
+{
+	assert(c != NULL);
+	return c->ops->update(c->state, input, timestamp);
+}
+
+double controller_get_set_point(controller_t *c)
+{
+	assert(c != NULL);
+	return c->ops->get_set_point(c->state);
+}
+
+void controller_set_set_point(controller_t *c, const double sp)
+{
+	assert(c != NULL);
+	c->ops->set_set_point(c->state, sp);
+}
+
+void controller_reset(controller_t *c, const double output)
+{
+	assert(c != NULL);
+	c->ops->reset(c->state, output);
+}
+
+void controller_set_applied(controller_t *c, const double output)
+{
+	assert(c != NULL);
+	if (c->ops->set_applied) {
+		c->ops->set_applied(c->state, output);
+	}
+}
@@ -0,0 +1,65 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_CONTROLLER_H
+#define SOUSVIDED_CONTROLLER_H
+
+#include <time.h>
+
+/* Temperature controllers the control task can drive: pidctrl (pid.h), the
+ * model predictive controller (mpc.h) and the Smith predictor (smith.h). A
+ * controller takes the latest measurement and returns the heater duty cycle
+ * to apply until the next one, like pidctrl_update(). */
+struct controller_ops
+{
+	const char *name;
+	double (*update)(void *state, const double input,
+			 const struct timespec *timestamp);
+	double (*get_set_point)(void *state);
+	void (*set_set_point)(void *state, const double sp);
+	/* forget the history, e.g. before taking over from another
+	 * controller. output is the duty cycle applied until now, the
+	 * controllers start from it instead of from 0. */
+	void (*reset)(void *state, const double output);
+	/* the duty cycle the heater actually got since the last update,
+	 * which differs from the returned one after rounding to half waves
+	 * or while a fault keeps the heater off. May be NULL for controllers
+	 * that don't model their past outputs. */
+	void (*set_applied)(void *state, const double output);
+};
+
+struct controller
+{
+	const struct controller_ops *ops;
+	void *state;
+};
+typedef struct controller controller_t;
+
+void controller_init(controller_t *c, const struct controller_ops *ops,
+		     void *state);
+const char *controller_name(const controller_t *c);
+
+double controller_update(controller_t *c, const double input,
+			 const struct timespec *timestamp);
+double controller_get_set_point(controller_t *c);
+void controller_set_set_point(controller_t *c, const double sp);
+void controller_reset(controller_t *c, const double output);
+void controller_set_applied(controller_t *c, const double output);
+
+#endif /* SOUSVIDED_CONTROLLER_H */
@@ -0,0 +1,269 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "cvd.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+/* Calculate the normalized resistance at temperature T (in degrees Celsius)
+ * using the Callendar Van Dusen Equation */
+double callendar_van_dusen(const double T)
+{
+	/* R(T) = 1 + AT + BT^2                 (T >= 0)
+	 *        1 + AT + BT^2 + C(T - 100)T^3	(T < 0)
+	 */
+	if (T < 0.0) {
+		return (((CVD_C * (T - 100.0) * T + CVD_B) * T + CVD_A) * T +
+			1.0);
+	}
+#ifdef FP_FAST_FMA
+	/* Use hardware fused multiply-add if possible */
+	return fma(fma(CVD_B, T, CVD_A), T, 1.0);
+#else
+	return ((CVD_B * T + CVD_A) * T + 1.0);
+#endif /* FP_FAST_FMA */
+}
+
+/* Calculate the derivative of the normalized resistance at temperature T (in
+ * degrees Celsius), using the Callendar Van Dusen Equation */
+double callendar_van_dusen_derivative(const double T)
+{
+	/* dR/dt = A + 2BT                            (T >= 0.0)
+	 *         A + 2BT + C * (-300 T^2 + 4 T ^3)  (T < 0.0)
+	 */
+
+	if (T < 0.0) {
+		return ((4.0 * T - 300.0) * CVD_C * T + 2.0 * CVD_B) * T +
+		       CVD_A;
+	}
+#ifdef FP_FAST_FMA
+	/* Use hardware fused multiply-add if possible */
+	return fma(2.0 * CVD_B, T, CVD_A);
+#else
+	return CVD_A + (2.0 * CVD_B * T);
+#endif /* FP_FAST_FMA */
+}
+
+/* Calculate the temperature (in degrees Celsius) for the normalized
+ * resistance r = R / R0 without iterating */
+double callendar_van_dusen_inverse(const double r)
+{
+	const double x = r - 1.0;
+	if (x < 0.0) {
+		return ((((CVD_INV_C5 * x + CVD_INV_C4) * x + CVD_INV_C3) * x +
+			 CVD_INV_C2) * x + CVD_INV_C1) * x;
+	}
+
+	/* Solve BT^2 + AT - x = 0 for T. This form of the quadratic formula
+	 * avoids the cancellation of -A + sqrt(...) close to T = 0 */
+	return (2.0 * x) / (CVD_A + sqrt(CVD_A * CVD_A + 4.0 * CVD_B * x));
+}
+
+/* approximate the temperature for a given resistance using Newton's method,
+ * starting at temperature T0 */
+double newton_approx(const double R, const unsigned int R0,
+		     const double max_residual, const double T0)
+{
+	double T = T0;
+	double residual;
+	do {
+		residual = R - R0 * callendar_van_dusen(T);
+		T += residual / (R0 * callendar_van_dusen_derivative(T));
+	} while (fabs(residual) > max_residual);
+	return T;
+}
+
+double resistance_from_adc(const unsigned int adc,
+			   const unsigned int reference_resistance)
+{
+	assert(adc < 32768);
+	return ((adc * reference_resistance) / 32768.0);
+}
+
+/* ADC code closest to the given resistance, clamped to [0, 32767] */
+static unsigned int adc_from_resistance(const double resistance,
+					const unsigned int reference_resistance)
+{
+	const double adc = resistance * 32768.0 / reference_resistance;
+	if (adc <= 0.0) {
+		return 0;
+	} else if (adc >= 32767.0) {
+		return 32767;
+	}
+	return (unsigned int)(adc + 0.5);
+}
+
+static unsigned int find_minimum_adc(const double resistance_min,
+				     const unsigned int reference_resistance)
+{
+	/* Compute the first code at or above resistance_min directly, the
+	 * loops only correct for rounding of the initial estimate */
+	unsigned int adc =
+	    adc_from_resistance(resistance_min, reference_resistance);
+	while (adc > 0 && (resistance_from_adc(adc - 1, reference_resistance) >=
+			   resistance_min)) {
+		--adc;
+	}
+	while (adc < 32768 && (resistance_from_adc(adc, reference_resistance) <
+			       resistance_min)) {
+		++adc;
+	}
+
+	if (adc > 0) {
+		--adc;
+	}
+
+	return adc;
+}
+
+static unsigned int find_maximum_adc(const double resistance_max,
+				     const unsigned int reference_resistance,
+				     const unsigned int adc_min)
+{
+	/* last code at or below resistance_max, see find_minimum_adc() */
+	unsigned int adc =
+	    adc_from_resistance(resistance_max, reference_resistance);
+	while (adc < 32767 &&
+	       (resistance_from_adc(adc + 1, reference_resistance) <=
+		resistance_max)) {
+		++adc;
+	}
+	while (adc > 0 && (resistance_from_adc(adc, reference_resistance) >
+			   resistance_max)) {
+		--adc;
+	}
+
+	if (!adc) {
+		++adc;
+	}
+
+	if (adc <= adc_min) {
+		adc = adc_min + 1;
+	}
+
+	return adc;
+}
+
+/* Determine the range of ADC codes [adc_min, adc_max] that covers the
+ * temperature range [temperature_min, temperature_max] */
+void cvd_adc_range(const double temperature_min, const double temperature_max,
+		   const unsigned int R0,
+		   const unsigned int reference_resistance,
+		   unsigned int *adc_min, unsigned int *adc_max)
+{
+	assert(adc_min != NULL);
+	assert(adc_max != NULL);
+
+	const double resistance_min = R0 * callendar_van_dusen(temperature_min);
+	const double resistance_max = R0 * callendar_van_dusen(temperature_max);
+
+	*adc_min = find_minimum_adc(resistance_min, reference_resistance);
+	*adc_max = find_maximum_adc(resistance_max, reference_resistance,
+				    *adc_min);
+}
+
+struct fill_job
+{
+	float *data;
+	unsigned int adc;
+	unsigned int size;
+	unsigned int R0;
+	unsigned int reference_resistance;
+};
+
+/* Each Newton solve starts at the analytic approximation, which is within
+ * 1e-4 degrees Celsius of the solution, so it converges after a single step.
+ * Starting at the previous code's result would be just as close, but chains
+ * the solves together and keeps the CPU from overlapping them. */
+static void *fill_range(void *user_data)
+{
+	struct fill_job *job = (struct fill_job *)user_data;
+
+	unsigned int i;
+	for (i = 0; i < job->size; ++i) {
+		const double resistance = resistance_from_adc(
+		    job->adc + i, job->reference_resistance);
+		const double T0 =
+		    callendar_van_dusen_inverse(resistance / job->R0);
+		job->data[i] = newton_approx(resistance, job->R0, 1.0e-6, T0);
+	}
+	return NULL;
+}
+
+/* Fill data[0, size) with the temperatures of the ADC codes starting at
+ * adc_min. Large tables are split across one thread per CPU. Returns the
+ * number of threads used. */
+unsigned int cvd_fill_table(float *data, const unsigned int adc_min,
+			    const unsigned int size, const unsigned int R0,
+			    const unsigned int reference_resistance)
+{
+	assert(data != NULL);
+	assert(adc_min + size <= 32768);
+
+	long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int num_jobs = CVD_FILL_MAX_THREADS;
+	if (num_cpus > 0 && num_cpus < num_jobs) {
+		num_jobs = num_cpus;
+	}
+	if (num_jobs > size / CVD_FILL_MIN_CODES_PER_THREAD) {
+		num_jobs = size / CVD_FILL_MIN_CODES_PER_THREAD;
+	}
+	if (num_jobs == 0) {
+		num_jobs = 1;
+	}
+
+	struct fill_job jobs[CVD_FILL_MAX_THREADS];
+	pthread_t threads[CVD_FILL_MAX_THREADS];
+	int started[CVD_FILL_MAX_THREADS];
+
+	unsigned int i;
+	unsigned int offset = 0;
+	for (i = 0; i < num_jobs; ++i) {
+		const unsigned int count = (size - offset) / (num_jobs - i);
+		jobs[i].data = data + offset;
+		jobs[i].adc = adc_min + offset;
+		jobs[i].size = count;
+		jobs[i].R0 = R0;
+		jobs[i].reference_resistance = reference_resistance;
+		offset += count;
+	}
+
+	/* the calling thread takes the first range itself */
+	for (i = 1; i < num_jobs; ++i) {
+		started[i] = pthread_create(&threads[i], NULL, &fill_range,
+					    &jobs[i]) == 0;
+	}
+
+	fill_range(&jobs[0]);
+
+	for (i = 1; i < num_jobs; ++i) {
+		if (started[i]) {
+			pthread_join(threads[i], NULL);
+		} else {
+			fill_range(&jobs[i]);
+		}
+	}
+
+	return num_jobs;
+}
@@ -0,0 +1,61 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_CVD_H
+#define SOUSVIDED_CVD_H
+
+/* Callendar Van Dusen equation and helpers shared by the RTD table code and
+ * the build-time table generator (rtd_table_gen) */
+
+#define CVD_A 3.9083E-3
+#define CVD_B (-5.775E-7)
+#define CVD_C (-4.18301E-12)
+
+/* Coefficients of T(x) = sum(c_i * x^i), x = r - 1, least squares fitted
+ * to the inverse of the Callendar Van Dusen equation for -200 <= T <= 0.
+ * The fit has no constant term, so T(r = 1) = 0 matches the quadratic branch,
+ * and its maximum error is about 5e-5 degrees Celsius. */
+#define CVD_INV_C1 2.558675949560E+02
+#define CVD_INV_C2 9.705455990197E+00
+#define CVD_INV_C3 (-8.787323698818E-01)
+#define CVD_INV_C4 4.775714062113E+00
+#define CVD_INV_C5 1.511846803393E+00
+
+double callendar_van_dusen(const double T);
+double callendar_van_dusen_derivative(const double T);
+double callendar_van_dusen_inverse(const double r);
+double newton_approx(const double R, const unsigned int R0,
+		     const double max_residual, const double T0);
+double resistance_from_adc(const unsigned int adc,
+			   const unsigned int reference_resistance);
+
+void cvd_adc_range(const double temperature_min, const double temperature_max,
+		   const unsigned int R0,
+		   const unsigned int reference_resistance,
+		   unsigned int *adc_min, unsigned int *adc_max);
+/* Table generation runs at most this many threads, each covering at least
+ * CVD_FILL_MIN_CODES_PER_THREAD ADC codes */
+#define CVD_FILL_MAX_THREADS 8
+#define CVD_FILL_MIN_CODES_PER_THREAD 2048
+
+unsigned int cvd_fill_table(float *data, const unsigned int adc_min,
+			    const unsigned int size, const unsigned int R0,
+			    const unsigned int reference_resistance);
+
+#endif /* SOUSVIDED_CVD_H */
@@ -0,0 +1,381 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "filter.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void filter_pipeline_init(filter_pipeline_t *p)
+{
+	assert(p != NULL);
+	memset(p, 0, sizeof(filter_pipeline_t));
+}
+
+/* Forget the filter state, but keep the stages */
+void filter_pipeline_reset(filter_pipeline_t *p)
+{
+	assert(p != NULL);
+
+	unsigned int i;
+	for (i = 0; i < p->num_stages; ++i) {
+		struct filter_stage *stage = &p->stages[i];
+		switch (stage->type) {
+		case FILTER_MEDIAN:
+			stage->median.count = 0;
+			stage->median.next = 0;
+			break;
+		case FILTER_EMA:
+			stage->ema.primed = 0;
+			break;
+		case FILTER_DECIMATE:
+			stage->decimate.count = 0;
+			stage->decimate.sum = 0.0;
+			break;
+		case FILTER_KALMAN:
+			stage->kalman.primed = 0;
+			break;
+		}
+	}
+}
+
+static struct filter_stage *add_stage(filter_pipeline_t *p,
+				      const enum FILTER_TYPE type)
+{
+	assert(p != NULL);
+
+	if (p->num_stages == FILTER_MAX_STAGES) {
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	struct filter_stage *stage = &p->stages[p->num_stages++];
+	memset(stage, 0, sizeof(struct filter_stage));
+	stage->type = type;
+	return stage;
+}
+
+int filter_pipeline_add_median(filter_pipeline_t *p, const unsigned int n)
+{
+	if (n == 0 || n > FILTER_MEDIAN_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct filter_stage *stage = add_stage(p, FILTER_MEDIAN);
+	if (!stage) {
+		return -1;
+	}
+	stage->median.n = n;
+	return 0;
+}
+
+int filter_pipeline_add_ema(filter_pipeline_t *p, const double alpha)
+{
+	if (!(alpha > 0.0 && alpha <= 1.0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct filter_stage *stage = add_stage(p, FILTER_EMA);
+	if (!stage) {
+		return -1;
+	}
+	stage->ema.alpha = alpha;
+	return 0;
+}
+
+int filter_pipeline_add_decimate(filter_pipeline_t *p, const unsigned int m)
+{
+	if (m == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct filter_stage *stage = add_stage(p, FILTER_DECIMATE);
+	if (!stage) {
+		return -1;
+	}
+	stage->decimate.m = m;
+	return 0;
+}
+
+int filter_pipeline_add_kalman(filter_pipeline_t *p, const double q,
+			       const double r)
+{
+	if (!(q >= 0.0) || !(r > 0.0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct filter_stage *stage = add_stage(p, FILTER_KALMAN);
+	if (!stage) {
+		return -1;
+	}
+	stage->kalman.q = q;
+	stage->kalman.r = r;
+	return 0;
+}
+
+/* ":N" with N a number of samples, at least 1. Returns the number of
+ * characters parsed including trailing blanks, -1 if there is no such
+ * number. */
+static int parse_count(const char *s, unsigned int *count)
+{
+	const char *start = s;
+	char *end;
+
+	if (*s != ':' || !isdigit((unsigned char)s[1])) {
+		return -1;
+	}
+	errno = 0;
+	const unsigned long value = strtoul(s + 1, &end, 10);
+	if (errno == ERANGE || value < 1 || value > UINT_MAX) {
+		return -1;
+	}
+	*count = value;
+	for (s = end; isspace((unsigned char)*s); ++s) {
+	}
+	return s - start;
+}
+
+/* Parse a comma separated list of stages and append them to the pipeline:
+ *   median:N        median of the last N samples
+ *   ema:ALPHA       y += ALPHA * (x - y)
+ *   decimate:M      average of M samples
+ *   kalman:Q:R      process and measurement noise variances
+ * e.g. "median:5,decimate:8,ema:0.3". Returns -1 with errno set to EINVAL
+ * for a malformed spec, in which case the pipeline is left unchanged. */
+int filter_pipeline_parse(filter_pipeline_t *p, const char *spec)
+{
+	assert(p != NULL);
+	assert(spec != NULL);
+
+	filter_pipeline_t parsed = *p;
+	const char *s = spec;
+
+	while (*s) {
+		char name[16];
+		double a = 0.0, b = 0.0;
+		unsigned int count = 0;
+		int n = 0;
+		int rc;
+
+		if (sscanf(s, " %15[a-z] %n", name, &n) != 1) {
+			errno = EINVAL;
+			return -1;
+		}
+		s += n;
+
+		if (!strcmp(name, "median") &&
+		    (n = parse_count(s, &count)) > 0) {
+			rc = filter_pipeline_add_median(&parsed, count);
+		} else if (!strcmp(name, "ema") &&
+			   sscanf(s, ":%lf %n", &a, &n) == 1) {
+			rc = filter_pipeline_add_ema(&parsed, a);
+		} else if (!strcmp(name, "decimate") &&
+			   (n = parse_count(s, &count)) > 0) {
+			rc = filter_pipeline_add_decimate(&parsed, count);
+		} else if (!strcmp(name, "kalman") &&
+			   sscanf(s, ":%lf:%lf %n", &a, &b, &n) == 2) {
+			rc = filter_pipeline_add_kalman(&parsed, a, b);
+		} else {
+			errno = EINVAL;
+			return -1;
+		}
+		if (rc == -1) {
+			return -1;
+		}
+		s += n;
+
+		if (*s == ',') {
+			++s;
+		} else if (*s) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	*p = parsed;
+	return 0;
+}
+
+/* Describe the pipeline in the format accepted by filter_pipeline_parse().
+ * Returns the length of the description like snprintf(). */
+int filter_pipeline_format(const filter_pipeline_t *p, char *buffer,
+			   const size_t size)
+{
+	assert(p != NULL);
+
+	int length = 0;
+	unsigned int i;
+	for (i = 0; i < p->num_stages; ++i) {
+		const struct filter_stage *stage = &p->stages[i];
+		const size_t offset = (size_t)length < size ? length : size;
+		const char *separator = i ? "," : "";
+		int n = 0;
+
+		switch (stage->type) {
+		case FILTER_MEDIAN:
+			n = snprintf(buffer + offset, size - offset,
+				     "%smedian:%u", separator, stage->median.n);
+			break;
+		case FILTER_EMA:
+			n = snprintf(buffer + offset, size - offset, "%sema:%g",
+				     separator, stage->ema.alpha);
+			break;
+		case FILTER_DECIMATE:
+			n = snprintf(buffer + offset, size - offset,
+				     "%sdecimate:%u", separator,
+				     stage->decimate.m);
+			break;
+		case FILTER_KALMAN:
+			n = snprintf(buffer + offset, size - offset,
+				     "%skalman:%g:%g", separator,
+				     stage->kalman.q, stage->kalman.r);
+			break;
+		}
+		length += n;
+	}
+
+	if (p->num_stages == 0 && size > 0) {
+		buffer[0] = '\0';
+	}
+	return length;
+}
+
+static int median_process(struct filter_median *f, const double x,
+			  double *y)
+{
+	unsigned int i;
+
+	if (f->count == f->n) {
+		/* drop the oldest sample from the sorted window */
+		const double oldest = f->window[f->next];
+		for (i = 0; i + 1 < f->count && f->sorted[i] != oldest; ++i) {
+		}
+		for (; i + 1 < f->count; ++i) {
+			f->sorted[i] = f->sorted[i + 1];
+		}
+		--f->count;
+	}
+
+	f->window[f->next] = x;
+	f->next = (f->next + 1) % f->n;
+
+	/* insertion step of insertion sort */
+	for (i = f->count; i > 0 && f->sorted[i - 1] > x; --i) {
+		f->sorted[i] = f->sorted[i - 1];
+	}
+	f->sorted[i] = x;
+	++f->count;
+
+	if (f->count & 1) {
+		*y = f->sorted[f->count / 2];
+	} else {
+		*y = 0.5 * (f->sorted[f->count / 2 - 1] +
+			    f->sorted[f->count / 2]);
+	}
+	return 1;
+}
+
+static int ema_process(struct filter_ema *f, const double x, double *y)
+{
+	if (!f->primed) {
+		f->y = x;
+		f->primed = 1;
+	} else {
+		f->y += f->alpha * (x - f->y);
+	}
+	*y = f->y;
+	return 1;
+}
+
+static int decimate_process(struct filter_decimate *f, const double x,
+			    double *y)
+{
+	f->sum += x;
+	if (++f->count < f->m) {
+		return 0;
+	}
+
+	*y = f->sum / f->m;
+	f->sum = 0.0;
+	f->count = 0;
+	return 1;
+}
+
+static int kalman_process(struct filter_kalman *f, const double x, double *y)
+{
+	if (!f->primed) {
+		f->x = x;
+		f->p = f->r;
+		f->primed = 1;
+	} else {
+		f->p += f->q;
+		const double k = f->p / (f->p + f->r);
+		f->x += k * (x - f->x);
+		f->p *= 1.0 - k;
+	}
+	*y = f->x;
+	return 1;
+}
+
+/* Feed a sample through all stages. Returns 1 and sets output if the last
+ * stage produced a value, 0 if a decimation stage is still accumulating.
+ * An empty pipeline passes the input through. */
+int filter_pipeline_process(filter_pipeline_t *p, const double input,
+			    double *output)
+{
+	assert(p != NULL);
+	assert(output != NULL);
+
+	double x = input;
+	unsigned int i;
+	for (i = 0; i < p->num_stages; ++i) {
+		struct filter_stage *stage = &p->stages[i];
+		int produced = 0;
+
+		switch (stage->type) {
+		case FILTER_MEDIAN:
+			produced = median_process(&stage->median, x, &x);
+			break;
+		case FILTER_EMA:
+			produced = ema_process(&stage->ema, x, &x);
+			break;
+		case FILTER_DECIMATE:
+			produced = decimate_process(&stage->decimate, x, &x);
+			break;
+		case FILTER_KALMAN:
+			produced = kalman_process(&stage->kalman, x, &x);
+			break;
+		}
+		if (!produced) {
+			return 0;
+		}
+	}
+
+	*output = x;
+	return 1;
+}
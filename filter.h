@@ -0,0 +1,104 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_FILTER_H
+#define SOUSVIDED_FILTER_H
+
+#include <stddef.h>
+
+#define FILTER_MAX_STAGES 8
+#define FILTER_MEDIAN_MAX 15
+
+enum FILTER_TYPE {
+	FILTER_MEDIAN = 0, /* median of the last n samples */
+	FILTER_EMA,        /* exponential moving average */
+	FILTER_DECIMATE,   /* average of m samples, one output per m inputs */
+	FILTER_KALMAN      /* 1-D Kalman filter with a random walk model */
+};
+
+struct filter_median
+{
+	unsigned int n;
+	unsigned int count;
+	unsigned int next;
+	double window[FILTER_MEDIAN_MAX]; /* in arrival order */
+	double sorted[FILTER_MEDIAN_MAX];
+};
+
+struct filter_ema
+{
+	double alpha;
+	double y;
+	int primed;
+};
+
+struct filter_decimate
+{
+	unsigned int m;
+	unsigned int count;
+	double sum;
+};
+
+struct filter_kalman
+{
+	double q; /* process noise variance per sample */
+	double r; /* measurement noise variance */
+	double x;
+	double p;
+	int primed;
+};
+
+struct filter_stage
+{
+	enum FILTER_TYPE type;
+	union {
+		struct filter_median median;
+		struct filter_ema ema;
+		struct filter_decimate decimate;
+		struct filter_kalman kalman;
+	};
+};
+
+/* A chain of filter stages. Every stage takes constant time per sample, the
+ * median stage is O(n) in its window size. A pipeline is not thread safe,
+ * it is meant to be owned by the thread that acquires the samples. */
+struct filter_pipeline
+{
+	unsigned int num_stages;
+	struct filter_stage stages[FILTER_MAX_STAGES];
+};
+typedef struct filter_pipeline filter_pipeline_t;
+
+void filter_pipeline_init(filter_pipeline_t *p);
+void filter_pipeline_reset(filter_pipeline_t *p);
+
+int filter_pipeline_add_median(filter_pipeline_t *p, const unsigned int n);
+int filter_pipeline_add_ema(filter_pipeline_t *p, const double alpha);
+int filter_pipeline_add_decimate(filter_pipeline_t *p, const unsigned int m);
+int filter_pipeline_add_kalman(filter_pipeline_t *p, const double q,
+			       const double r);
+
+int filter_pipeline_parse(filter_pipeline_t *p, const char *spec);
+int filter_pipeline_format(const filter_pipeline_t *p, char *buffer,
+			   const size_t size);
+
+int filter_pipeline_process(filter_pipeline_t *p, const double input,
+			    double *output);
+
+#endif /* SOUSVIDED_FILTER_H */
@@ -0,0 +1,151 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Benchmark of the sensor filter stages.
+ *
+ * Usage: filter_bench [SAMPLES]
+ *
+ * Feeds a synthetic DRDY stream (a slow temperature ramp in ADC codes with
+ * one LSB of Gaussian noise and occasional spikes) through each stage on
+ * its own and through a few typical pipelines. Reports the CPU time per
+ * input sample and the RMS error of the outputs against the noise free
+ * signal. Run it on the target (e.g. ARMv6) to get meaningful timings.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "filter.h"
+
+static double *CLEAN;
+static double *NOISY;
+static volatile double SINK;
+
+static double elapsed_ns(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1.0E9 +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+static double gaussian(void)
+{
+	/* Box-Muller */
+	const double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+	const double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+	return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static void generate(const size_t n)
+{
+	size_t i;
+	srand(42);
+	for (i = 0; i < n; ++i) {
+		/* about 2 degrees Celsius per minute at 60 samples/s */
+		CLEAN[i] = 9000.0 + 0.02 * i / 60.0 * 8.0;
+		NOISY[i] = CLEAN[i] + gaussian();
+		if (rand() % 1000 == 0) {
+			NOISY[i] += (rand() & 1) ? 40.0 : -40.0;
+		}
+	}
+}
+
+static void run(const char *spec, const size_t n)
+{
+	filter_pipeline_t p;
+	filter_pipeline_init(&p);
+	if (filter_pipeline_parse(&p, spec) == -1) {
+		fprintf(stderr, "invalid filter %s\n", spec);
+		return;
+	}
+
+	struct timespec start, end;
+	double y, sum = 0.0;
+	size_t i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n; ++i) {
+		if (filter_pipeline_process(&p, NOISY[i], &y)) {
+			sum += y;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	SINK = sum;
+
+	/* second pass for the error, outside of the timed loop. Skip the
+	 * first second while the filters settle. */
+	double error = 0.0;
+	size_t outputs = 0;
+	filter_pipeline_reset(&p);
+	for (i = 0; i < n; ++i) {
+		if (filter_pipeline_process(&p, NOISY[i], &y) && i >= 60) {
+			error += (y - CLEAN[i]) * (y - CLEAN[i]);
+			++outputs;
+		}
+	}
+
+	printf("%-32s %10.2f %10zu %10.4f\n", spec[0] ? spec : "(none)",
+	       elapsed_ns(&start, &end) / n, outputs,
+	       outputs ? sqrt(error / outputs) : 0.0);
+}
+
+int main(int argc, char **argv)
+{
+	size_t n = 1 << 22;
+	if (argc == 2) {
+		n = strtoul(argv[1], NULL, 10);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [SAMPLES]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (n < 120) {
+		fprintf(stderr, "need at least 120 samples\n");
+		return EXIT_FAILURE;
+	}
+
+	CLEAN = malloc(sizeof(double) * n);
+	NOISY = malloc(sizeof(double) * n);
+	if (!CLEAN || !NOISY) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	generate(n);
+
+	printf("%-32s %10s %10s %10s\n", "filter", "ns/sample", "outputs",
+	       "rms LSB");
+	run("", n);
+	run("median:3", n);
+	run("median:5", n);
+	run("median:9", n);
+	run("median:15", n);
+	run("ema:0.3", n);
+	run("ema:0.05", n);
+	run("decimate:8", n);
+	run("decimate:32", n);
+	run("kalman:0.0001:1", n);
+	run("median:3,ema:0.5", n);
+	run("median:5,decimate:8,ema:0.3", n);
+	run("median:5,kalman:0.0001:1", n);
+
+	free(NOISY);
+	free(CLEAN);
+	return EXIT_SUCCESS;
+}
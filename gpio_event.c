@@ -0,0 +1,162 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "gpio_event.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "hal.h"
+
+/* Request edge events on a GPIO line from the kernel's GPIO character
+ * device, for the hardware backends. Returns the line event descriptor, or
+ * -1 and sets errno if the GPIO chip can't be opened or the line is already
+ * in use by another consumer. */
+int gpio_line_request(const char *chip, const uint8_t pin,
+		      const enum GPIO_EVENT_EDGE edge, const char *consumer)
+{
+	assert(chip != NULL);
+
+	int chip_fd = open(chip, O_RDONLY | O_CLOEXEC);
+	if (chip_fd == -1) {
+		fprintf(stderr, "gpio_line_request: failed to open %s: %s\n",
+			chip, strerror(errno));
+		return -1;
+	}
+
+	struct gpioevent_request request;
+	memset(&request, 0, sizeof(request));
+	request.lineoffset = pin;
+	request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	if (edge & GPIO_EVENT_RISING_EDGE) {
+		request.eventflags |= GPIOEVENT_REQUEST_RISING_EDGE;
+	}
+	if (edge & GPIO_EVENT_FALLING_EDGE) {
+		request.eventflags |= GPIOEVENT_REQUEST_FALLING_EDGE;
+	}
+	if (consumer) {
+		strncpy(request.consumer_label, consumer,
+			sizeof(request.consumer_label) - 1);
+	}
+
+	int rc = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+	int saved_errno = errno;
+	close(chip_fd);
+	if (rc == -1) {
+		fprintf(stderr, "gpio_line_request: failed to request events "
+				"for line %u: %s\n",
+			(unsigned int)pin, strerror(saved_errno));
+		errno = saved_errno;
+		return -1;
+	}
+
+	return request.fd;
+}
+
+/* Current level of a line requested with gpio_line_request(), or -1 on
+ * error */
+int gpio_line_value(const int fd)
+{
+	struct gpiohandle_data data;
+	if (ioctl(fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == -1) {
+		return -1;
+	}
+	return data.values[0];
+}
+
+void gpio_line_release(const int fd)
+{
+	close(fd);
+}
+
+/* Request edge events on a GPIO line through the hardware backend. Returns
+ * -1 and sets errno if the line can't be requested. */
+int gpio_event_init(gpio_event_t *ev, const char *chip, const uint8_t pin,
+		    const enum GPIO_EVENT_EDGE edge, const char *consumer)
+{
+	assert(ev != NULL);
+	assert(chip != NULL);
+
+	ev->pin = pin;
+	ev->fd = hal_line_request(chip, pin, edge, consumer);
+	return ev->fd == -1 ? -1 : 0;
+}
+
+void gpio_event_cleanup(gpio_event_t *ev)
+{
+	assert(ev != NULL);
+
+	if (ev->fd != -1) {
+		hal_line_release(ev->fd);
+		ev->fd = -1;
+	}
+}
+
+/* Block until the next edge or until timeout_ms passed (-1 waits forever).
+ * Returns 1 if an edge was read, 0 on timeout and -1 on error. The timestamp
+ * is taken by the kernel in the interrupt handler, on CLOCK_MONOTONIC since
+ * Linux 5.7 and on CLOCK_REALTIME before. */
+int gpio_event_wait(gpio_event_t *ev, const int timeout_ms,
+		    enum GPIO_EVENT_EDGE *edge, struct timespec *timestamp)
+{
+	assert(ev != NULL);
+	assert(ev->fd != -1);
+
+	struct pollfd pfd = { ev->fd, POLLIN, 0 };
+	int rc = poll(&pfd, 1, timeout_ms);
+	if (rc <= 0) {
+		if (rc == -1 && errno == EINTR) {
+			return 0;
+		}
+		return rc;
+	}
+
+	struct gpioevent_data event;
+	if (read(ev->fd, &event, sizeof(event)) != sizeof(event)) {
+		return -1;
+	}
+
+	if (edge) {
+		*edge = event.id == GPIOEVENT_EVENT_RISING_EDGE
+			    ? GPIO_EVENT_RISING_EDGE
+			    : GPIO_EVENT_FALLING_EDGE;
+	}
+	if (timestamp) {
+		timestamp->tv_sec = event.timestamp / 1000000000ULL;
+		timestamp->tv_nsec = event.timestamp % 1000000000ULL;
+	}
+	return 1;
+}
+
+/* Current level of the line, or -1 on error */
+int gpio_event_get_value(gpio_event_t *ev)
+{
+	assert(ev != NULL);
+	assert(ev->fd != -1);
+
+	return hal_line_value(ev->fd);
+}
@@ -0,0 +1,61 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_GPIO_EVENT_H
+#define SOUSVIDED_GPIO_EVENT_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* GPIO controller the BCM2835 GPIO pins are exposed on. The pin numbers used
+ * with the bcm2835 library are the line offsets on this chip. */
+#ifndef GPIO_EVENT_CHIP
+#define GPIO_EVENT_CHIP "/dev/gpiochip0"
+#endif
+
+enum GPIO_EVENT_EDGE {
+	GPIO_EVENT_RISING_EDGE = 1,
+	GPIO_EVENT_FALLING_EDGE = 2,
+	GPIO_EVENT_BOTH_EDGES = 3
+};
+
+/* Edge events of a single GPIO line, delivered by the kernel's GPIO
+ * character device (or the simulation backend, see hal.h) instead of
+ * polling the event detect status register */
+struct gpio_event
+{
+	int fd;
+	uint8_t pin;
+};
+typedef struct gpio_event gpio_event_t;
+
+int gpio_event_init(gpio_event_t *ev, const char *chip, const uint8_t pin,
+		    const enum GPIO_EVENT_EDGE edge, const char *consumer);
+void gpio_event_cleanup(gpio_event_t *ev);
+
+int gpio_event_wait(gpio_event_t *ev, const int timeout_ms,
+		    enum GPIO_EVENT_EDGE *edge, struct timespec *timestamp);
+int gpio_event_get_value(gpio_event_t *ev);
+
+int gpio_line_request(const char *chip, const uint8_t pin,
+		      const enum GPIO_EVENT_EDGE edge, const char *consumer);
+int gpio_line_value(const int fd);
+void gpio_line_release(const int fd);
+
+#endif /* SOUSVIDED_GPIO_EVENT_H */
@@ -0,0 +1,205 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "hal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct hal_backend *const BACKENDS[] = {
+	&hal_bcm2835_backend,
+	&hal_linux_backend,
+	&hal_sim_backend,
+};
+
+static const struct hal_backend *HAL = NULL;
+
+/* Select and initialize the backend called name, or the one named by the
+ * SOUSVIDED_HAL environment variable if name is NULL. Returns -1 with errno
+ * set to ENOENT for an unknown backend, or if the backend failed to
+ * initialize. */
+int hal_init(const char *name)
+{
+	assert(HAL == NULL);
+
+	if (!name) {
+		name = getenv("SOUSVIDED_HAL");
+	}
+	if (!name || !*name) {
+		name = HAL_DEFAULT_BACKEND;
+	}
+
+	unsigned int i;
+	for (i = 0; i < sizeof(BACKENDS) / sizeof(BACKENDS[0]); ++i) {
+		if (strcmp(BACKENDS[i]->name, name) != 0) {
+			continue;
+		}
+		if (BACKENDS[i]->init() == -1) {
+			return -1;
+		}
+		HAL = BACKENDS[i];
+		return 0;
+	}
+
+	fprintf(stderr, "hal_init: unknown backend %s\n", name);
+	errno = ENOENT;
+	return -1;
+}
+
+void hal_close(void)
+{
+	assert(HAL != NULL);
+
+	HAL->close();
+	HAL = NULL;
+}
+
+const char *hal_name(void)
+{
+	assert(HAL != NULL);
+	return HAL->name;
+}
+
+void hal_spi_begin(void)
+{
+	HAL->spi_begin();
+}
+
+void hal_spi_end(void)
+{
+	HAL->spi_end();
+}
+
+void hal_spi_configure(const enum HAL_SPI_MODE mode, const uint32_t speed_hz,
+		       const uint8_t cs)
+{
+	HAL->spi_configure(mode, speed_hz, cs);
+}
+
+/* Full duplex transfer of n bytes, data is replaced by the bytes read */
+void hal_spi_transfer(uint8_t *data, const size_t n)
+{
+	HAL->spi_transfer(data, n);
+}
+
+/* Transfer the messages back to back, each in its own chip select cycle */
+void hal_spi_transfer_batch(struct hal_spi_message *messages, const size_t n)
+{
+	if (HAL->spi_transfer_batch) {
+		HAL->spi_transfer_batch(messages, n);
+		return;
+	}
+
+	size_t i;
+	for (i = 0; i < n; ++i) {
+		HAL->spi_transfer(messages[i].data, messages[i].n);
+	}
+}
+
+void hal_gpio_function(const uint8_t pin,
+		       const enum HAL_GPIO_FUNCTION function)
+{
+	HAL->gpio_function(pin, function);
+}
+
+void hal_gpio_pull(const uint8_t pin, const enum HAL_GPIO_PULL pull)
+{
+	HAL->gpio_pull(pin, pull);
+}
+
+void hal_gpio_write(const uint8_t pin, const uint8_t level)
+{
+	HAL->gpio_write(pin, level);
+}
+
+uint8_t hal_gpio_read(const uint8_t pin)
+{
+	return HAL->gpio_read(pin);
+}
+
+void hal_gpio_detect(const uint8_t pin, const enum HAL_GPIO_DETECT detect,
+		     const int enable)
+{
+	HAL->gpio_detect(pin, detect, enable);
+}
+
+uint8_t hal_gpio_event_status(const uint8_t pin)
+{
+	return HAL->gpio_event_status(pin);
+}
+
+void hal_gpio_clear_event_status(const uint8_t pin)
+{
+	HAL->gpio_clear_event_status(pin);
+}
+
+int hal_line_request(const char *chip, const uint8_t pin,
+		     const enum GPIO_EVENT_EDGE edge, const char *consumer)
+{
+	return HAL->line_request(chip, pin, edge, consumer);
+}
+
+int hal_line_value(const int fd)
+{
+	return HAL->line_value(fd);
+}
+
+void hal_line_release(const int fd)
+{
+	HAL->line_release(fd);
+}
+
+void hal_pwm_clock(const uint32_t divider)
+{
+	HAL->pwm_clock(divider);
+}
+
+void hal_pwm_mode(const uint8_t channel, const uint8_t markspace,
+		  const uint8_t enabled)
+{
+	HAL->pwm_mode(channel, markspace, enabled);
+}
+
+void hal_pwm_range(const uint8_t channel, const uint32_t range)
+{
+	HAL->pwm_range(channel, range);
+}
+
+void hal_pwm_data(const uint8_t channel, const uint32_t data)
+{
+	HAL->pwm_data(channel, data);
+}
+
+void hal_delay_us(const uint64_t us)
+{
+	HAL->delay_us(us);
+}
+
+/* System calls the backend made to access the hardware, backends that map
+ * the peripherals into memory don't count any */
+uint64_t hal_syscall_count(void)
+{
+	if (HAL->syscall_count) {
+		return HAL->syscall_count();
+	}
+	return 0;
+}
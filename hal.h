@@ -0,0 +1,167 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_HAL_H
+#define SOUSVIDED_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gpio_event.h"
+
+/* Backend selected by hal_init(NULL) if SOUSVIDED_HAL isn't set */
+#ifndef HAL_DEFAULT_BACKEND
+#define HAL_DEFAULT_BACKEND "bcm2835"
+#endif
+
+#define HAL_LOW 0
+#define HAL_HIGH 1
+
+enum HAL_GPIO_FUNCTION {
+	HAL_GPIO_INPUT = 0,
+	HAL_GPIO_OUTPUT,
+	HAL_GPIO_PWM /* alternate function 5 on the PWM capable pins */
+};
+
+enum HAL_GPIO_PULL {
+	HAL_GPIO_PULL_OFF = 0,
+	HAL_GPIO_PULL_DOWN,
+	HAL_GPIO_PULL_UP
+};
+
+/* Conditions that set a pin's event detect status */
+enum HAL_GPIO_DETECT {
+	HAL_GPIO_DETECT_LOW = 0, /* level, set as long as the pin is low */
+	HAL_GPIO_DETECT_RISING   /* edge */
+};
+
+enum HAL_SPI_MODE {
+	HAL_SPI_MODE0 = 0,
+	HAL_SPI_MODE1,
+	HAL_SPI_MODE2,
+	HAL_SPI_MODE3
+};
+
+/* Chip selects of the SPI peripheral, HAL_SPI_CS_NONE leaves chip select to
+ * a GPIO pin driven by the caller */
+#define HAL_SPI_CS0 0
+#define HAL_SPI_CS1 1
+#define HAL_SPI_CS_NONE 3
+
+/* One chip select cycle of a batched SPI transfer, data is replaced by the
+ * bytes read */
+struct hal_spi_message
+{
+	uint8_t *data;
+	size_t n;
+};
+
+/* Everything the daemon does with the hardware. Backends only need to be
+ * correct for a single caller at a time per subsystem: SPI transfers are
+ * serialized by spi_bus.c and every pin has a single owner. */
+struct hal_backend
+{
+	const char *name;
+	int (*init)(void);
+	void (*close)(void);
+
+	/* SPI, most significant bit first */
+	void (*spi_begin)(void);
+	void (*spi_end)(void);
+	void (*spi_configure)(const enum HAL_SPI_MODE mode,
+			      const uint32_t speed_hz, const uint8_t cs);
+	void (*spi_transfer)(uint8_t *data, const size_t n);
+	/* optional, hal_spi_transfer_batch() falls back to spi_transfer */
+	void (*spi_transfer_batch)(struct hal_spi_message *messages,
+				   const size_t n);
+
+	/* GPIO */
+	void (*gpio_function)(const uint8_t pin,
+			      const enum HAL_GPIO_FUNCTION function);
+	void (*gpio_pull)(const uint8_t pin, const enum HAL_GPIO_PULL pull);
+	void (*gpio_write)(const uint8_t pin, const uint8_t level);
+	uint8_t (*gpio_read)(const uint8_t pin);
+	void (*gpio_detect)(const uint8_t pin,
+			    const enum HAL_GPIO_DETECT detect,
+			    const int enable);
+	uint8_t (*gpio_event_status)(const uint8_t pin);
+	void (*gpio_clear_event_status)(const uint8_t pin);
+
+	/* Edge events, the returned descriptor becomes readable when an edge
+	 * is pending and delivers struct gpioevent_data records like a
+	 * kernel line event descriptor, see gpio_event.c */
+	int (*line_request)(const char *chip, const uint8_t pin,
+			    const enum GPIO_EVENT_EDGE edge,
+			    const char *consumer);
+	int (*line_value)(const int fd);
+	void (*line_release)(const int fd);
+
+	/* PWM, the clock divider applies to the 19.2 MHz oscillator */
+	void (*pwm_clock)(const uint32_t divider);
+	void (*pwm_mode)(const uint8_t channel, const uint8_t markspace,
+			 const uint8_t enabled);
+	void (*pwm_range)(const uint8_t channel, const uint32_t range);
+	void (*pwm_data)(const uint8_t channel, const uint32_t data);
+
+	void (*delay_us)(const uint64_t us);
+
+	/* optional, number of system calls the backend made so far */
+	uint64_t (*syscall_count)(void);
+};
+
+extern const struct hal_backend hal_bcm2835_backend;
+extern const struct hal_backend hal_linux_backend;
+extern const struct hal_backend hal_sim_backend;
+
+int hal_init(const char *name);
+void hal_close(void);
+const char *hal_name(void);
+
+void hal_spi_begin(void);
+void hal_spi_end(void);
+void hal_spi_configure(const enum HAL_SPI_MODE mode, const uint32_t speed_hz,
+		       const uint8_t cs);
+void hal_spi_transfer(uint8_t *data, const size_t n);
+void hal_spi_transfer_batch(struct hal_spi_message *messages, const size_t n);
+
+void hal_gpio_function(const uint8_t pin,
+		       const enum HAL_GPIO_FUNCTION function);
+void hal_gpio_pull(const uint8_t pin, const enum HAL_GPIO_PULL pull);
+void hal_gpio_write(const uint8_t pin, const uint8_t level);
+uint8_t hal_gpio_read(const uint8_t pin);
+void hal_gpio_detect(const uint8_t pin, const enum HAL_GPIO_DETECT detect,
+		     const int enable);
+uint8_t hal_gpio_event_status(const uint8_t pin);
+void hal_gpio_clear_event_status(const uint8_t pin);
+
+int hal_line_request(const char *chip, const uint8_t pin,
+		     const enum GPIO_EVENT_EDGE edge, const char *consumer);
+int hal_line_value(const int fd);
+void hal_line_release(const int fd);
+
+void hal_pwm_clock(const uint32_t divider);
+void hal_pwm_mode(const uint8_t channel, const uint8_t markspace,
+		  const uint8_t enabled);
+void hal_pwm_range(const uint8_t channel, const uint32_t range);
+void hal_pwm_data(const uint8_t channel, const uint32_t data);
+
+void hal_delay_us(const uint64_t us);
+uint64_t hal_syscall_count(void);
+
+#endif /* SOUSVIDED_HAL_H */
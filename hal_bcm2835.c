@@ -0,0 +1,207 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Hardware backend on top of the bcm2835 library, which accesses the SoC's
+ * peripherals through /dev/mem and needs root. Edge events come from the
+ * kernel's GPIO character device. */
+
+#include "hal.h"
+
+#include <stdio.h>
+
+#include "bcm2835.h"
+
+/* The SPI clock divides the 250 MHz core clock */
+#define BCM2835_CORE_CLOCK_HZ 250000000
+
+static int bcm_init(void)
+{
+	if (!bcm2835_init()) {
+		fprintf(stderr, "Failed to initialize bcm2835 library.\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void bcm_close(void)
+{
+	bcm2835_close();
+}
+
+static void bcm_spi_begin(void)
+{
+	/* initialize GPIO pins for SPI operations */
+	bcm2835_spi_begin();
+
+	/* set SPI bit order to most significant bit first.
+	 * NOTE: This is the only mode the BCM2835 chip supports */
+	bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+}
+
+static void bcm_spi_end(void)
+{
+	/* return the GPIO SPI pins to their default setting */
+	bcm2835_spi_end();
+}
+
+static void bcm_spi_configure(const enum HAL_SPI_MODE mode,
+			      const uint32_t speed_hz, const uint8_t cs)
+{
+	/* the divider must be even, round it up to stay below speed_hz */
+	uint32_t divider = (BCM2835_CORE_CLOCK_HZ + speed_hz - 1) / speed_hz;
+	divider = (divider + 1) & ~1u;
+	if (divider > 65536) {
+		divider = 65536;
+	}
+
+	bcm2835_spi_setDataMode(mode);
+	/* a divider of 0 means 65536 */
+	bcm2835_spi_setClockDivider(divider & 0xFFFF);
+	if (cs == HAL_SPI_CS_NONE) {
+		bcm2835_spi_chipSelect(BCM2835_SPI_CS_NONE);
+	} else {
+		bcm2835_spi_chipSelect(cs);
+		bcm2835_spi_setChipSelectPolarity(cs, LOW);
+	}
+}
+
+static void bcm_spi_transfer(uint8_t *data, const size_t n)
+{
+	bcm2835_spi_transfern((char *)data, n);
+}
+
+static void bcm_gpio_function(const uint8_t pin,
+			      const enum HAL_GPIO_FUNCTION function)
+{
+	switch (function) {
+	case HAL_GPIO_INPUT:
+		bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_INPT);
+		break;
+	case HAL_GPIO_OUTPUT:
+		bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_OUTP);
+		break;
+	case HAL_GPIO_PWM:
+		bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_ALT5);
+		break;
+	}
+}
+
+static void bcm_gpio_pull(const uint8_t pin, const enum HAL_GPIO_PULL pull)
+{
+	switch (pull) {
+	case HAL_GPIO_PULL_OFF:
+		bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_OFF);
+		break;
+	case HAL_GPIO_PULL_DOWN:
+		bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_DOWN);
+		break;
+	case HAL_GPIO_PULL_UP:
+		bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_UP);
+		break;
+	}
+}
+
+static void bcm_gpio_write(const uint8_t pin, const uint8_t level)
+{
+	bcm2835_gpio_write(pin, level ? HIGH : LOW);
+}
+
+static uint8_t bcm_gpio_read(const uint8_t pin)
+{
+	return bcm2835_gpio_lev(pin);
+}
+
+static void bcm_gpio_detect(const uint8_t pin,
+			    const enum HAL_GPIO_DETECT detect, const int enable)
+{
+	if (detect == HAL_GPIO_DETECT_LOW) {
+		if (enable) {
+			bcm2835_gpio_len(pin);
+		} else {
+			bcm2835_gpio_clr_len(pin);
+		}
+	} else {
+		if (enable) {
+			bcm2835_gpio_ren(pin);
+		} else {
+			bcm2835_gpio_clr_ren(pin);
+		}
+	}
+}
+
+static uint8_t bcm_gpio_event_status(const uint8_t pin)
+{
+	return bcm2835_gpio_eds(pin);
+}
+
+static void bcm_gpio_clear_event_status(const uint8_t pin)
+{
+	bcm2835_gpio_set_eds(pin);
+}
+
+static void bcm_pwm_mode(const uint8_t channel, const uint8_t markspace,
+			 const uint8_t enabled)
+{
+	bcm2835_pwm_set_mode(channel, markspace, enabled);
+}
+
+static void bcm_pwm_range(const uint8_t channel, const uint32_t range)
+{
+	bcm2835_pwm_set_range(channel, range);
+}
+
+static void bcm_pwm_data(const uint8_t channel, const uint32_t data)
+{
+	bcm2835_pwm_set_data(channel, data);
+}
+
+static void bcm_pwm_clock(const uint32_t divider)
+{
+	bcm2835_pwm_set_clock(divider);
+}
+
+static void bcm_delay_us(const uint64_t us)
+{
+	bcm2835_delayMicroseconds(us);
+}
+
+const struct hal_backend hal_bcm2835_backend = {
+	.name = "bcm2835",
+	.init = &bcm_init,
+	.close = &bcm_close,
+	.spi_begin = &bcm_spi_begin,
+	.spi_end = &bcm_spi_end,
+	.spi_configure = &bcm_spi_configure,
+	.spi_transfer = &bcm_spi_transfer,
+	.gpio_function = &bcm_gpio_function,
+	.gpio_pull = &bcm_gpio_pull,
+	.gpio_write = &bcm_gpio_write,
+	.gpio_read = &bcm_gpio_read,
+	.gpio_detect = &bcm_gpio_detect,
+	.gpio_event_status = &bcm_gpio_event_status,
+	.gpio_clear_event_status = &bcm_gpio_clear_event_status,
+	.line_request = &gpio_line_request,
+	.line_value = &gpio_line_value,
+	.line_release = &gpio_line_release,
+	.pwm_clock = &bcm_pwm_clock,
+	.pwm_mode = &bcm_pwm_mode,
+	.pwm_range = &bcm_pwm_range,
+	.pwm_data = &bcm_pwm_data,
+	.delay_us = &bcm_delay_us,
+};
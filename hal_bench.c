@@ -0,0 +1,191 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Benchmark of the SPI register sequences max31865.c runs per sample.
+ *
+ * Usage: hal_bench [-b BACKEND] [-n ITERATIONS]
+ *
+ * Every sequence is sent once as a batch (one SPI_IOC_MESSAGE ioctl on the
+ * linux backend) and once as separate transfers. Reports the latency
+ * percentiles and the number of system calls per sequence, as far as the
+ * backend counts them; the bcm2835 backend drives the memory mapped
+ * peripheral and makes none. The MAX31865 is expected on CS0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "hal.h"
+#include "max31865.h"
+#include "spi_bus.h"
+
+#define MAX_MESSAGES 3
+
+struct sequence
+{
+	const char *name;
+	size_t n;
+	uint8_t data[MAX_MESSAGES][1 + MAX31865_REGISTER_MAX];
+	size_t length[MAX_MESSAGES];
+};
+
+/* The same register accesses as the batches in max31865.c, with the
+ * default configuration of bias on, automatic conversion and 50Hz filter */
+static const struct sequence SEQUENCES[] = {
+	{ "read rtd", 1, { { MAX31865_REGISTER_RTD_MSB } }, { 3 } },
+	{ "snapshot",
+	  1,
+	  { { MAX31865_REGISTER_CONFIG } },
+	  { 1 + MAX31865_REGISTER_MAX } },
+	{ "set config",
+	  2,
+	  { { 0x80 | MAX31865_REGISTER_CONFIG, 0xC1 },
+	    { MAX31865_REGISTER_CONFIG } },
+	  { 2, 1 + MAX31865_REGISTER_MAX } },
+	{ "one-shot readout",
+	  2,
+	  { { MAX31865_REGISTER_RTD_MSB },
+	    { 0x80 | MAX31865_REGISTER_CONFIG, 0x81 } },
+	  { 3, 2 } },
+	{ "fault cycle",
+	  3,
+	  { { MAX31865_REGISTER_CONFIG },
+	    { 0x80 | MAX31865_REGISTER_CONFIG, 0xC3 },
+	    { 0x80 | MAX31865_REGISTER_CONFIG, 0x85 } },
+	  { 1 + MAX31865_REGISTER_MAX, 2, 2 } },
+};
+
+#define NUM_SEQUENCES (sizeof(SEQUENCES) / sizeof(SEQUENCES[0]))
+
+static unsigned int elapsed_ns(const struct timespec *start,
+			       const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000u +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+static int compare_uint(const void *a, const void *b)
+{
+	const unsigned int x = *(const unsigned int *)a;
+	const unsigned int y = *(const unsigned int *)b;
+	return (x > y) - (x < y);
+}
+
+static void run(const spi_device_t *dev, const struct sequence *sequence,
+		const int batched, unsigned int *latencies,
+		const unsigned int iterations)
+{
+	uint8_t data[MAX_MESSAGES][1 + MAX31865_REGISTER_MAX];
+	struct hal_spi_message messages[MAX_MESSAGES];
+	struct timespec start, end;
+	unsigned long long total = 0;
+	unsigned int i;
+	size_t j;
+
+	const uint64_t syscalls = hal_syscall_count();
+	for (i = 0; i < iterations; ++i) {
+		/* transfers overwrite the buffers with the bytes read */
+		memcpy(data, sequence->data, sizeof(data));
+		for (j = 0; j < sequence->n; ++j) {
+			messages[j].data = data[j];
+			messages[j].n = sequence->length[j];
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (batched) {
+			spi_device_transfer_batch(dev, messages, sequence->n);
+		} else {
+			for (j = 0; j < sequence->n; ++j) {
+				spi_device_transfer(dev, messages[j].data,
+						    messages[j].n);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		latencies[i] = elapsed_ns(&start, &end);
+		total += latencies[i];
+	}
+	const uint64_t calls = hal_syscall_count() - syscalls;
+
+	qsort(latencies, iterations, sizeof(unsigned int), &compare_uint);
+	printf("%-16s %-9s %9.2f %9.2f %9.2f %9.2f\n", sequence->name,
+	       batched ? "batch" : "separate", total / (iterations * 1.0E3),
+	       latencies[iterations / 2] / 1.0E3,
+	       latencies[iterations * 99 / 100] / 1.0E3,
+	       (double)calls / iterations);
+}
+
+int main(int argc, char **argv)
+{
+	const char *backend = NULL;
+	unsigned int iterations = 10000;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "b:n:")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-b BACKEND] [-n ITERATIONS]\n",
+				argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (iterations == 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	unsigned int *latencies = malloc(sizeof(unsigned int) * iterations);
+	if (!latencies) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	if (hal_init(backend) == -1) {
+		free(latencies);
+		return EXIT_FAILURE;
+	}
+
+	spi_device_t dev;
+	spi_device_init(&dev, HAL_SPI_CS0, HAL_SPI_MODE1, 5000000);
+
+	printf("%s backend, %u iterations per run\n", hal_name(), iterations);
+	printf("%-16s %-9s %9s %9s %9s %9s\n", "sequence", "transfer",
+	       "mean us", "p50 us", "p99 us", "syscalls");
+
+	size_t i;
+	for (i = 0; i < NUM_SEQUENCES; ++i) {
+		run(&dev, &SEQUENCES[i], 1, latencies, iterations);
+		run(&dev, &SEQUENCES[i], 0, latencies, iterations);
+	}
+
+	spi_device_cleanup(&dev);
+	hal_close();
+	free(latencies);
+	return EXIT_SUCCESS;
+}
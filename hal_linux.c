@@ -0,0 +1,637 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Backend on top of the kernel's userspace interfaces: /dev/spidevB.C for
+ * SPI, the GPIO character device for GPIO and edge events and sysfs for
+ * PWM. Needs no root, only access to the device nodes (e.g. membership in
+ * the spi and gpio groups). Register sequences are sent to spidev as a
+ * single SPI_IOC_MESSAGE batch. */
+
+#include "hal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/* printf() format of the SPI device node, the argument is the chip
+ * select */
+#ifndef HAL_LINUX_SPIDEV
+#define HAL_LINUX_SPIDEV "/dev/spidev0.%u"
+#endif
+
+#ifndef HAL_LINUX_PWM_CHIP
+#define HAL_LINUX_PWM_CHIP "/sys/class/pwm/pwmchip0"
+#endif
+
+#define HAL_LINUX_NUM_PINS 54
+#define HAL_LINUX_NUM_CS 2
+#define HAL_LINUX_NUM_PWM_CHANNELS 2
+#define HAL_LINUX_MAX_BATCH 8
+#define HAL_LINUX_PWM_CLOCK_HZ 19200000ULL
+
+enum LINE_STATE {
+	LINE_FREE = 0,
+	LINE_INPUT,
+	LINE_OUTPUT,
+	LINE_RISING, /* rising edge events for the event detect status */
+	LINE_EVENTS  /* requested through hal_line_request() */
+};
+
+struct line
+{
+	int fd;
+	enum LINE_STATE state;
+	enum HAL_GPIO_PULL pull;
+	uint8_t low_detect;
+	uint8_t event_status;
+};
+
+struct pwm_channel
+{
+	uint8_t exported;
+	uint32_t range;
+	uint32_t data;
+	uint8_t written; /* the kernel has period_ns and duty_ns */
+	unsigned long long period_ns;
+	unsigned long long duty_ns;
+};
+
+static struct
+{
+	atomic_ullong syscalls;
+	int chip_fd;
+	struct line lines[HAL_LINUX_NUM_PINS];
+
+	int spi_fd[HAL_LINUX_NUM_CS];
+	uint8_t spi_mode[HAL_LINUX_NUM_CS];
+	int spi_current;
+	uint32_t spi_speed_hz;
+
+	uint32_t pwm_divider;
+	struct pwm_channel pwm[HAL_LINUX_NUM_PWM_CHANNELS];
+} LINUX = { .chip_fd = -1 };
+
+static void count_syscalls(const unsigned int n)
+{
+	atomic_fetch_add_explicit(&LINUX.syscalls, n, memory_order_relaxed);
+}
+
+static int linux_init(void)
+{
+	unsigned int i;
+
+	atomic_init(&LINUX.syscalls, 0);
+	LINUX.chip_fd = open(GPIO_EVENT_CHIP, O_RDONLY | O_CLOEXEC);
+	count_syscalls(1);
+	if (LINUX.chip_fd == -1) {
+		fprintf(stderr, "Failed to open %s: %s\n", GPIO_EVENT_CHIP,
+			strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < HAL_LINUX_NUM_PINS; ++i) {
+		LINUX.lines[i].fd = -1;
+		LINUX.lines[i].state = LINE_FREE;
+		LINUX.lines[i].pull = HAL_GPIO_PULL_OFF;
+		LINUX.lines[i].low_detect = 0;
+		LINUX.lines[i].event_status = 0;
+	}
+	for (i = 0; i < HAL_LINUX_NUM_CS; ++i) {
+		LINUX.spi_fd[i] = -1;
+		LINUX.spi_mode[i] = 0xFF;
+	}
+	LINUX.spi_current = -1;
+	LINUX.spi_speed_hz = 0;
+	LINUX.pwm_divider = 1;
+	memset(LINUX.pwm, 0, sizeof(LINUX.pwm));
+	return 0;
+}
+
+static void release_line(const uint8_t pin)
+{
+	struct line *line = &LINUX.lines[pin];
+	if (line->fd != -1) {
+		close(line->fd);
+		count_syscalls(1);
+	}
+	line->fd = -1;
+	line->state = LINE_FREE;
+	line->event_status = 0;
+}
+
+static void linux_close(void)
+{
+	unsigned int i;
+	for (i = 0; i < HAL_LINUX_NUM_PINS; ++i) {
+		release_line(i);
+	}
+	for (i = 0; i < HAL_LINUX_NUM_CS; ++i) {
+		if (LINUX.spi_fd[i] != -1) {
+			close(LINUX.spi_fd[i]);
+			LINUX.spi_fd[i] = -1;
+		}
+	}
+	close(LINUX.chip_fd);
+	LINUX.chip_fd = -1;
+}
+
+static void linux_spi_begin(void)
+{
+}
+
+static void linux_spi_end(void)
+{
+	unsigned int i;
+	for (i = 0; i < HAL_LINUX_NUM_CS; ++i) {
+		if (LINUX.spi_fd[i] != -1) {
+			close(LINUX.spi_fd[i]);
+			count_syscalls(1);
+			LINUX.spi_fd[i] = -1;
+			LINUX.spi_mode[i] = 0xFF;
+		}
+	}
+	LINUX.spi_current = -1;
+}
+
+/* Chips with a GPIO chip select share the device node of CS0 with the chip
+ * select disabled */
+static void linux_spi_configure(const enum HAL_SPI_MODE mode,
+				const uint32_t speed_hz, const uint8_t cs)
+{
+	const unsigned int index = cs == HAL_SPI_CS_NONE ? 0 : cs;
+	uint8_t spi_mode = mode;
+	if (cs == HAL_SPI_CS_NONE) {
+		spi_mode |= SPI_NO_CS;
+	}
+
+	LINUX.spi_current = -1;
+	if (index >= HAL_LINUX_NUM_CS) {
+		fprintf(stderr, "hal_linux: invalid chip select %u\n",
+			(unsigned int)cs);
+		return;
+	}
+
+	if (LINUX.spi_fd[index] == -1) {
+		char path[64];
+		snprintf(path, sizeof(path), HAL_LINUX_SPIDEV, index);
+		LINUX.spi_fd[index] = open(path, O_RDWR | O_CLOEXEC);
+		count_syscalls(1);
+		if (LINUX.spi_fd[index] == -1) {
+			fprintf(stderr, "hal_linux: failed to open %s: %s\n",
+				path, strerror(errno));
+			return;
+		}
+	}
+
+	/* the mode belongs to the device, not to the file descriptor */
+	if (LINUX.spi_mode[index] != spi_mode) {
+		count_syscalls(1);
+		if (ioctl(LINUX.spi_fd[index], SPI_IOC_WR_MODE, &spi_mode) ==
+		    -1) {
+			fprintf(stderr, "hal_linux: failed to set SPI mode "
+					"0x%02X: %s\n",
+				(unsigned int)spi_mode, strerror(errno));
+			return;
+		}
+		LINUX.spi_mode[index] = spi_mode;
+	}
+
+	LINUX.spi_current = index;
+	LINUX.spi_speed_hz = speed_hz;
+}
+
+/* A single ioctl for up to HAL_LINUX_MAX_BATCH messages, chip select is
+ * released between them */
+static void linux_spi_transfer_batch(struct hal_spi_message *messages,
+				     const size_t n)
+{
+	struct spi_ioc_transfer transfers[HAL_LINUX_MAX_BATCH];
+	size_t offset = 0;
+
+	if (LINUX.spi_current == -1) {
+		for (offset = 0; offset < n; ++offset) {
+			memset(messages[offset].data, 0, messages[offset].n);
+		}
+		return;
+	}
+
+	while (offset < n) {
+		size_t count = n - offset;
+		if (count > HAL_LINUX_MAX_BATCH) {
+			count = HAL_LINUX_MAX_BATCH;
+		}
+
+		memset(transfers, 0, sizeof(transfers));
+		size_t i;
+		for (i = 0; i < count; ++i) {
+			const struct hal_spi_message *message =
+			    &messages[offset + i];
+			transfers[i].tx_buf = (unsigned long)message->data;
+			transfers[i].rx_buf = (unsigned long)message->data;
+			transfers[i].len = message->n;
+			transfers[i].speed_hz = LINUX.spi_speed_hz;
+			transfers[i].bits_per_word = 8;
+			transfers[i].cs_change = i + 1 < count;
+		}
+
+		count_syscalls(1);
+		if (ioctl(LINUX.spi_fd[LINUX.spi_current],
+			  SPI_IOC_MESSAGE(count), transfers) == -1) {
+			fprintf(stderr, "hal_linux: SPI transfer failed: %s\n",
+				strerror(errno));
+		}
+		offset += count;
+	}
+}
+
+static void linux_spi_transfer(uint8_t *data, const size_t n)
+{
+	struct hal_spi_message message = { data, n };
+	linux_spi_transfer_batch(&message, 1);
+}
+
+static int request_handle(const uint8_t pin, const uint32_t flags,
+			  const uint8_t value)
+{
+	struct gpiohandle_request request;
+	memset(&request, 0, sizeof(request));
+	request.lineoffsets[0] = pin;
+	request.lines = 1;
+	request.flags = flags;
+	request.default_values[0] = value;
+	strncpy(request.consumer_label, "sousvided",
+		sizeof(request.consumer_label) - 1);
+
+	count_syscalls(1);
+	if (ioctl(LINUX.chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &request) == -1) {
+		fprintf(stderr, "hal_linux: failed to request line %u: %s\n",
+			(unsigned int)pin, strerror(errno));
+		return -1;
+	}
+	return request.fd;
+}
+
+static uint32_t pull_flags(const enum HAL_GPIO_PULL pull)
+{
+	switch (pull) {
+	case HAL_GPIO_PULL_DOWN:
+		return GPIOHANDLE_REQUEST_BIAS_PULL_DOWN;
+	case HAL_GPIO_PULL_UP:
+		return GPIOHANDLE_REQUEST_BIAS_PULL_UP;
+	default:
+		return GPIOHANDLE_REQUEST_BIAS_DISABLE;
+	}
+}
+
+static void request_input(const uint8_t pin)
+{
+	struct line *line = &LINUX.lines[pin];
+
+	release_line(pin);
+	line->fd = request_handle(
+	    pin, GPIOHANDLE_REQUEST_INPUT | pull_flags(line->pull), 0);
+	if (line->fd != -1) {
+		line->state = LINE_INPUT;
+	}
+}
+
+static void linux_gpio_function(const uint8_t pin,
+				const enum HAL_GPIO_FUNCTION function)
+{
+	struct line *line = &LINUX.lines[pin];
+
+	switch (function) {
+	case HAL_GPIO_INPUT:
+		request_input(pin);
+		break;
+	case HAL_GPIO_OUTPUT:
+		release_line(pin);
+		line->fd = request_handle(pin, GPIOHANDLE_REQUEST_OUTPUT, 0);
+		if (line->fd != -1) {
+			line->state = LINE_OUTPUT;
+		}
+		break;
+	case HAL_GPIO_PWM:
+		/* the pin is muxed by the pwm overlay */
+		release_line(pin);
+		break;
+	}
+}
+
+static void linux_gpio_pull(const uint8_t pin, const enum HAL_GPIO_PULL pull)
+{
+	LINUX.lines[pin].pull = pull;
+	if (LINUX.lines[pin].state == LINE_INPUT) {
+		request_input(pin);
+	}
+}
+
+static void linux_gpio_write(const uint8_t pin, const uint8_t level)
+{
+	const struct line *line = &LINUX.lines[pin];
+	if (line->state != LINE_OUTPUT) {
+		return;
+	}
+
+	struct gpiohandle_data data;
+	memset(&data, 0, sizeof(data));
+	data.values[0] = level != 0;
+	count_syscalls(1);
+	ioctl(line->fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+}
+
+static uint8_t linux_gpio_read(const uint8_t pin)
+{
+	if (LINUX.lines[pin].fd == -1) {
+		request_input(pin);
+	}
+	if (LINUX.lines[pin].fd == -1) {
+		return 0;
+	}
+
+	count_syscalls(1);
+	return gpio_line_value(LINUX.lines[pin].fd) == 1;
+}
+
+/* Rising edge detection keeps an event descriptor open, low level
+ * detection reads the line when the status is asked for */
+static void linux_gpio_detect(const uint8_t pin,
+			      const enum HAL_GPIO_DETECT detect,
+			      const int enable)
+{
+	struct line *line = &LINUX.lines[pin];
+
+	if (detect == HAL_GPIO_DETECT_LOW) {
+		line->low_detect = enable != 0;
+		return;
+	}
+
+	if (enable) {
+		release_line(pin);
+		count_syscalls(3);
+		line->fd = gpio_line_request(GPIO_EVENT_CHIP, pin,
+					     GPIO_EVENT_RISING_EDGE,
+					     "sousvided");
+		if (line->fd != -1) {
+			line->state = LINE_RISING;
+		}
+	} else if (line->state == LINE_RISING) {
+		request_input(pin);
+	}
+}
+
+static void drain_events(struct line *line)
+{
+	struct gpioevent_data event;
+	struct pollfd pfd = { line->fd, POLLIN, 0 };
+
+	count_syscalls(1);
+	while (poll(&pfd, 1, 0) == 1) {
+		count_syscalls(2);
+		if (read(line->fd, &event, sizeof(event)) != sizeof(event)) {
+			break;
+		}
+		line->event_status = 1;
+	}
+}
+
+static uint8_t linux_gpio_event_status(const uint8_t pin)
+{
+	struct line *line = &LINUX.lines[pin];
+
+	if (line->state == LINE_RISING) {
+		drain_events(line);
+		return line->event_status;
+	}
+	if (line->low_detect) {
+		return linux_gpio_read(pin) == 0;
+	}
+	return 0;
+}
+
+static void linux_gpio_clear_event_status(const uint8_t pin)
+{
+	struct line *line = &LINUX.lines[pin];
+
+	if (line->state == LINE_RISING) {
+		drain_events(line);
+	}
+	line->event_status = 0;
+}
+
+/* The line can only be requested once, the event descriptor replaces the
+ * handle this backend holds */
+static int linux_line_request(const char *chip, const uint8_t pin,
+			      const enum GPIO_EVENT_EDGE edge,
+			      const char *consumer)
+{
+	struct line *line = &LINUX.lines[pin];
+
+	release_line(pin);
+	count_syscalls(3);
+	line->fd = gpio_line_request(chip, pin, edge, consumer);
+	if (line->fd == -1) {
+		return -1;
+	}
+	line->state = LINE_EVENTS;
+	return line->fd;
+}
+
+static int linux_line_value(const int fd)
+{
+	count_syscalls(1);
+	return gpio_line_value(fd);
+}
+
+static void linux_line_release(const int fd)
+{
+	unsigned int i;
+	for (i = 0; i < HAL_LINUX_NUM_PINS; ++i) {
+		if (LINUX.lines[i].fd == fd) {
+			release_line(i);
+			return;
+		}
+	}
+	gpio_line_release(fd);
+}
+
+static int sysfs_write(const char *path, const char *value)
+{
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	if (fd == -1) {
+		count_syscalls(1);
+		return -1;
+	}
+	const ssize_t length = strlen(value);
+	const ssize_t written = write(fd, value, length);
+	close(fd);
+	count_syscalls(3);
+	return written == length ? 0 : -1;
+}
+
+static int pwm_write(const uint8_t channel, const char *attribute,
+		     const unsigned long long value)
+{
+	char path[128], buffer[32];
+	snprintf(path, sizeof(path), "%s/pwm%u/%s", HAL_LINUX_PWM_CHIP,
+		 (unsigned int)channel, attribute);
+	snprintf(buffer, sizeof(buffer), "%llu", value);
+	return sysfs_write(path, buffer);
+}
+
+static struct pwm_channel *export_pwm(const uint8_t channel)
+{
+	if (channel >= HAL_LINUX_NUM_PWM_CHANNELS) {
+		return NULL;
+	}
+
+	struct pwm_channel *pwm = &LINUX.pwm[channel];
+	if (!pwm->exported) {
+		char buffer[8];
+		snprintf(buffer, sizeof(buffer), "%u", (unsigned int)channel);
+		/* fails with EBUSY if it already is */
+		sysfs_write(HAL_LINUX_PWM_CHIP "/export", buffer);
+		if (pwm_write(channel, "enable", 0) == -1) {
+			fprintf(stderr, "hal_linux: PWM channel %u isn't "
+					"available in %s\n",
+				(unsigned int)channel, HAL_LINUX_PWM_CHIP);
+			return NULL;
+		}
+		pwm->exported = 1;
+	}
+	return pwm;
+}
+
+/* The PWM runs at the rate the bcm2835 clock divider would give it, with
+ * range ticks per period */
+static void update_pwm(const uint8_t channel)
+{
+	struct pwm_channel *pwm = export_pwm(channel);
+	if (!pwm || !pwm->range) {
+		return;
+	}
+
+	const unsigned long long tick_ns =
+	    LINUX.pwm_divider * 1000000000ULL / HAL_LINUX_PWM_CLOCK_HZ;
+	const uint32_t data = pwm->data < pwm->range ? pwm->data : pwm->range;
+	const unsigned long long period_ns = pwm->range * tick_ns;
+	const unsigned long long duty_ns = data * tick_ns;
+
+	/* the duty cycle must never exceed the period: a shorter period
+	 * goes in after the duty cycle, a longer one before. Nothing is
+	 * known about the duty cycle before the first update. */
+	int rc = 0;
+	if (!pwm->written) {
+		rc |= pwm_write(channel, "duty_cycle", 0);
+		rc |= pwm_write(channel, "period", period_ns);
+		rc |= pwm_write(channel, "duty_cycle", duty_ns);
+	} else {
+		if (period_ns > pwm->period_ns) {
+			rc |= pwm_write(channel, "period", period_ns);
+		}
+		if (duty_ns != pwm->duty_ns) {
+			rc |= pwm_write(channel, "duty_cycle", duty_ns);
+		}
+		if (period_ns < pwm->period_ns) {
+			rc |= pwm_write(channel, "period", period_ns);
+		}
+	}
+	pwm->written = rc == 0;
+	pwm->period_ns = period_ns;
+	pwm->duty_ns = duty_ns;
+}
+
+static void linux_pwm_clock(const uint32_t divider)
+{
+	LINUX.pwm_divider = divider ? divider : 1;
+}
+
+static void linux_pwm_mode(const uint8_t channel, const uint8_t markspace,
+			   const uint8_t enabled)
+{
+	(void)markspace;
+
+	if (export_pwm(channel)) {
+		pwm_write(channel, "enable", enabled != 0);
+	}
+}
+
+static void linux_pwm_range(const uint8_t channel, const uint32_t range)
+{
+	if (channel < HAL_LINUX_NUM_PWM_CHANNELS) {
+		LINUX.pwm[channel].range = range;
+		update_pwm(channel);
+	}
+}
+
+static void linux_pwm_data(const uint8_t channel, const uint32_t data)
+{
+	if (channel < HAL_LINUX_NUM_PWM_CHANNELS) {
+		LINUX.pwm[channel].data = data;
+		update_pwm(channel);
+	}
+}
+
+static void linux_delay_us(const uint64_t us)
+{
+	struct timespec delay = { us / 1000000, (us % 1000000) * 1000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) == EINTR) {
+	}
+}
+
+static uint64_t linux_syscall_count(void)
+{
+	return atomic_load_explicit(&LINUX.syscalls, memory_order_relaxed);
+}
+
+const struct hal_backend hal_linux_backend = {
+	.name = "linux",
+	.init = &linux_init,
+	.close = &linux_close,
+	.spi_begin = &linux_spi_begin,
+	.spi_end = &linux_spi_end,
+	.spi_configure = &linux_spi_configure,
+	.spi_transfer = &linux_spi_transfer,
+	.spi_transfer_batch = &linux_spi_transfer_batch,
+	.gpio_function = &linux_gpio_function,
+	.gpio_pull = &linux_gpio_pull,
+	.gpio_write = &linux_gpio_write,
+	.gpio_read = &linux_gpio_read,
+	.gpio_detect = &linux_gpio_detect,
+	.gpio_event_status = &linux_gpio_event_status,
+	.gpio_clear_event_status = &linux_gpio_clear_event_status,
+	.line_request = &linux_line_request,
+	.line_value = &linux_line_value,
+	.line_release = &linux_line_release,
+	.pwm_clock = &linux_pwm_clock,
+	.pwm_mode = &linux_pwm_mode,
+	.pwm_range = &linux_pwm_range,
+	.pwm_data = &linux_pwm_data,
+	.delay_us = &linux_delay_us,
+	.syscall_count = &linux_syscall_count,
+};
@@ -0,0 +1,688 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Simulation backend: a MAX31865 measuring a simulated water bath, which is
+ * heated through the SSR pin and stirred by the circulator on the PWM
+ * channel. A thread advances the plant in real time and completes the
+ * conversions, every hardware access first catches the simulation up to the
+ * current time.
+ *
+ * SOUSVIDED_SIM_FAULT=STATUS[@SECONDS] injects the given fault status bits
+ * (see max31865.h) into the fault detection cycles, after SECONDS if given.
+ * Faults that open the RTD connection also read as a full scale RTD. */
+
+#include "hal_sim.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "cvd.h"
+#include "hal.h"
+#include "max31865.h"
+
+#define SIM_NUM_PINS 54
+#define SIM_MAX_LINES 8
+#define SIM_NUM_PWM_CHANNELS 2
+
+/* from the MAX31865 data sheet */
+#define SIM_FAULT_CYCLE_NS 550000LL
+#define SIM_CONVERSION_50HZ_NS 62500000LL
+#define SIM_CONVERSION_60HZ_NS 52000000LL
+#define SIM_AUTO_50HZ_NS 20000000LL
+#define SIM_AUTO_60HZ_NS 16700000LL
+
+struct sim_line
+{
+	int read_fd;
+	int write_fd;
+	uint8_t pin;
+	enum GPIO_EVENT_EDGE edge;
+};
+
+static struct
+{
+	pthread_mutex_t mtx;
+	pthread_t thread;
+	atomic_int running;
+	int64_t now; /* ns on CLOCK_MONOTONIC the simulation advanced to */
+	sim_plant_t plant;
+
+	uint8_t function[SIM_NUM_PINS];
+	uint8_t level[SIM_NUM_PINS];
+	uint8_t low_detect[SIM_NUM_PINS];
+	uint8_t rising_detect[SIM_NUM_PINS];
+	uint8_t event_status[SIM_NUM_PINS];
+	struct sim_line lines[SIM_MAX_LINES];
+
+	uint8_t spi_cs;
+	uint8_t pwm_enabled[SIM_NUM_PWM_CHANNELS];
+	uint32_t pwm_range[SIM_NUM_PWM_CHANNELS];
+	uint32_t pwm_data[SIM_NUM_PWM_CHANNELS];
+
+	/* MAX31865 */
+	uint8_t regs[MAX31865_REGISTER_MAX];
+	int64_t conversion_due; /* 0 if no conversion is running */
+	int64_t fault_cycle_due;
+	uint8_t injected_fault;
+	uint8_t pending_fault;
+	int64_t pending_fault_due;
+} SIM = { .mtx = PTHREAD_MUTEX_INITIALIZER };
+
+static int64_t monotonic_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void set_level(const uint8_t pin, const uint8_t level)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	if (SIM.level[pin] == level) {
+		return;
+	}
+	SIM.level[pin] = level;
+	if (level && SIM.rising_detect[pin]) {
+		SIM.event_status[pin] = 1;
+	}
+
+	struct gpioevent_data event;
+	event.timestamp = SIM.now;
+	event.id = level ? GPIOEVENT_EVENT_RISING_EDGE
+			 : GPIOEVENT_EVENT_FALLING_EDGE;
+	const enum GPIO_EVENT_EDGE edge =
+	    level ? GPIO_EVENT_RISING_EDGE : GPIO_EVENT_FALLING_EDGE;
+
+	unsigned int i;
+	for (i = 0; i < SIM_MAX_LINES; ++i) {
+		const struct sim_line *line = &SIM.lines[i];
+		if (line->read_fd == -1 || line->pin != pin ||
+		    !(line->edge & edge)) {
+			continue;
+		}
+		/* like the kernel, drop events nobody reads */
+		if (write(line->write_fd, &event, sizeof(event)) == -1) {
+			continue;
+		}
+	}
+}
+
+static int64_t auto_conversion_ns(void)
+{
+	return (SIM.regs[MAX31865_REGISTER_CONFIG] & 0x01) ? SIM_AUTO_50HZ_NS
+							   : SIM_AUTO_60HZ_NS;
+}
+
+static int rtd_open(void)
+{
+	return (SIM.injected_fault &
+		(MAX31865_FAULT_REFIN_LOW | MAX31865_FAULT_RTDIN_LOW)) != 0;
+}
+
+static void complete_conversion(void)
+{
+	uint8_t *regs = SIM.regs;
+
+	unsigned int code = 0x7FFF;
+	if (!rtd_open()) {
+		const double T = sim_plant_read_sensor(&SIM.plant);
+		const double adc = SIM_RTD_R0 * callendar_van_dusen(T) *
+				   32768.0 / SIM_REFERENCE_RESISTANCE;
+		if (adc <= 0.0) {
+			code = 0;
+		} else if (adc < 32767.0) {
+			code = (unsigned int)(adc + 0.5);
+		}
+	}
+
+	/* the thresholds compare against the register value without the
+	 * fault bit */
+	const unsigned int high =
+	    ((regs[MAX31865_REGISTER_FAULT_HT_MSB] << 8) |
+	     regs[MAX31865_REGISTER_FAULT_HT_LSB]) >> 1;
+	const unsigned int low =
+	    ((regs[MAX31865_REGISTER_FAULT_LT_MSB] << 8) |
+	     regs[MAX31865_REGISTER_FAULT_LT_LSB]) >> 1;
+	if (code >= high) {
+		regs[MAX31865_REGISTER_FAULT_STATUS] |= MAX31865_FAULT_RTD_HIGH;
+	}
+	if (code <= low) {
+		regs[MAX31865_REGISTER_FAULT_STATUS] |= MAX31865_FAULT_RTD_LOW;
+	}
+
+	const uint8_t fault = regs[MAX31865_REGISTER_FAULT_STATUS] != 0;
+	regs[MAX31865_REGISTER_RTD_MSB] = code >> 7;
+	regs[MAX31865_REGISTER_RTD_LSB] = ((code << 1) & 0xFF) | fault;
+	set_level(SIM_MAX31865_DRDY_PIN, 0);
+}
+
+/* Catch the plant and the MAX31865 up with the given time */
+static void advance(const int64_t now)
+{
+	if (now <= SIM.now) {
+		return;
+	}
+
+	const double heater = SIM.function[SIM_SSR_PIN] == HAL_GPIO_OUTPUT &&
+			      SIM.level[SIM_SSR_PIN];
+	double circulator = 0.0;
+	const unsigned int channel = SIM_CIRCULATOR_PWM_CHANNEL;
+	if (SIM.pwm_enabled[channel] && SIM.pwm_range[channel]) {
+		circulator = (double)SIM.pwm_data[channel] /
+			     SIM.pwm_range[channel];
+		if (circulator > 1.0) {
+			circulator = 1.0;
+		}
+	}
+	sim_plant_step(&SIM.plant, (now - SIM.now) * 1.0E-9, heater,
+		       circulator);
+	SIM.now = now;
+
+	if (SIM.pending_fault_due && now >= SIM.pending_fault_due) {
+		SIM.injected_fault = SIM.pending_fault;
+		SIM.pending_fault_due = 0;
+	}
+
+	uint8_t *config = &SIM.regs[MAX31865_REGISTER_CONFIG];
+	if (SIM.fault_cycle_due && now >= SIM.fault_cycle_due) {
+		SIM.regs[MAX31865_REGISTER_FAULT_STATUS] |=
+		    SIM.injected_fault & 0x3C;
+		*config &= ~0x0C;
+		SIM.fault_cycle_due = 0;
+	}
+
+	if (SIM.conversion_due && now >= SIM.conversion_due) {
+		complete_conversion();
+		if (*config & 0x40) {
+			SIM.conversion_due += auto_conversion_ns();
+		} else {
+			*config &= ~0x20;
+			SIM.conversion_due = 0;
+		}
+	}
+}
+
+/* Config register bits, see max31865_set_configuration() */
+static void write_config(uint8_t value)
+{
+	const uint8_t old = SIM.regs[MAX31865_REGISTER_CONFIG];
+
+	if ((value & 0x02) && !(value & 0x2C)) {
+		SIM.regs[MAX31865_REGISTER_FAULT_STATUS] = 0;
+	}
+	value &= ~0x02;
+
+	/* fault detection cycle control, writing 00 has no effect */
+	const uint8_t cycle = (value >> 2) & 0x03;
+	value = (value & ~0x0C) | (old & 0x0C);
+	if (cycle == MAX31865_FAULT_CYCLE_AUTO ||
+	    (cycle == MAX31865_FAULT_CYCLE_MANUAL_2 &&
+	     ((old >> 2) & 0x03) == MAX31865_FAULT_CYCLE_MANUAL_1)) {
+		value |= 0x0C & (cycle << 2);
+		SIM.fault_cycle_due = SIM.now + SIM_FAULT_CYCLE_NS;
+	} else if (cycle == MAX31865_FAULT_CYCLE_MANUAL_1) {
+		value = (value & ~0x0C) | 0x08;
+	}
+
+	if (!(value & 0x80)) {
+		/* no conversions without bias voltage */
+		value &= ~0x20;
+		SIM.conversion_due = 0;
+	} else if (value & 0x40) {
+		value &= ~0x20;
+		if (!(old & 0x40) || !SIM.conversion_due) {
+			SIM.conversion_due = SIM.now + auto_conversion_ns();
+		}
+	} else if ((value & 0x20) && !SIM.conversion_due) {
+		SIM.conversion_due =
+		    SIM.now + ((value & 0x01) ? SIM_CONVERSION_50HZ_NS
+					      : SIM_CONVERSION_60HZ_NS);
+	} else if (!(value & 0x20)) {
+		/* automatic conversions stopped */
+		SIM.conversion_due = 0;
+	}
+
+	SIM.regs[MAX31865_REGISTER_CONFIG] = value;
+}
+
+static void write_register(const enum MAX31865_REGISTER reg,
+			   const uint8_t value)
+{
+	switch (reg) {
+	case MAX31865_REGISTER_CONFIG:
+		write_config(value);
+		break;
+	case MAX31865_REGISTER_FAULT_HT_MSB:
+	case MAX31865_REGISTER_FAULT_HT_LSB:
+	case MAX31865_REGISTER_FAULT_LT_MSB:
+	case MAX31865_REGISTER_FAULT_LT_LSB:
+		SIM.regs[reg] = value;
+		break;
+	default:
+		/* read only */
+		break;
+	}
+}
+
+static int sim_init(void)
+{
+	pthread_mutex_lock(&SIM.mtx);
+	SIM.now = monotonic_ns();
+	sim_plant_init(&SIM.plant, NULL);
+
+	memset(SIM.function, HAL_GPIO_INPUT, sizeof(SIM.function));
+	memset(SIM.level, 0, sizeof(SIM.level));
+	memset(SIM.low_detect, 0, sizeof(SIM.low_detect));
+	memset(SIM.rising_detect, 0, sizeof(SIM.rising_detect));
+	memset(SIM.event_status, 0, sizeof(SIM.event_status));
+	unsigned int i;
+	for (i = 0; i < SIM_MAX_LINES; ++i) {
+		SIM.lines[i].read_fd = -1;
+		SIM.lines[i].write_fd = -1;
+	}
+	SIM.spi_cs = HAL_SPI_CS_NONE;
+	memset(SIM.pwm_enabled, 0, sizeof(SIM.pwm_enabled));
+	memset(SIM.pwm_range, 0, sizeof(SIM.pwm_range));
+	memset(SIM.pwm_data, 0, sizeof(SIM.pwm_data));
+
+	/* power on defaults, DRDY idles high */
+	memset(SIM.regs, 0, sizeof(SIM.regs));
+	SIM.regs[MAX31865_REGISTER_FAULT_HT_MSB] = 0xFF;
+	SIM.regs[MAX31865_REGISTER_FAULT_HT_LSB] = 0xFF;
+	SIM.level[SIM_MAX31865_DRDY_PIN] = 1;
+	SIM.conversion_due = 0;
+	SIM.fault_cycle_due = 0;
+	SIM.injected_fault = 0;
+	SIM.pending_fault_due = 0;
+
+	const char *fault = getenv("SOUSVIDED_SIM_FAULT");
+	if (fault) {
+		char *end;
+		SIM.pending_fault = strtoul(fault, &end, 0);
+		const double delay = *end == '@' ? strtod(end + 1, NULL) : 0.0;
+		SIM.pending_fault_due = SIM.now + (int64_t)(delay * 1.0E9) + 1;
+	}
+	pthread_mutex_unlock(&SIM.mtx);
+
+	atomic_store(&SIM.running, 1);
+	return 0;
+}
+
+static void *sim_thread(void *user_data)
+{
+	struct timespec next;
+
+	(void)user_data;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (atomic_load(&SIM.running)) {
+		next.tv_nsec += SIM_TICK_US * 1000;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			++next.tv_sec;
+		}
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		pthread_mutex_lock(&SIM.mtx);
+		advance(monotonic_ns());
+		pthread_mutex_unlock(&SIM.mtx);
+	}
+	return NULL;
+}
+
+static int sim_start(void)
+{
+	if (sim_init() == -1) {
+		return -1;
+	}
+
+	int rc = pthread_create(&SIM.thread, NULL, &sim_thread, NULL);
+	if (rc != 0) {
+		fprintf(stderr, "Failed to start the simulation thread\n");
+		errno = rc;
+		return -1;
+	}
+	printf("Simulating a %.0fW heater in a %.1fl water bath\n",
+	       SIM.plant.params.heater_power,
+	       (SIM.plant.params.heater_capacity +
+		SIM.plant.params.bath_capacity) / 4186.0);
+	return 0;
+}
+
+static void sim_close(void)
+{
+	atomic_store(&SIM.running, 0);
+	pthread_join(SIM.thread, NULL);
+
+	unsigned int i;
+	for (i = 0; i < SIM_MAX_LINES; ++i) {
+		if (SIM.lines[i].read_fd != -1) {
+			close(SIM.lines[i].read_fd);
+			close(SIM.lines[i].write_fd);
+			SIM.lines[i].read_fd = -1;
+			SIM.lines[i].write_fd = -1;
+		}
+	}
+}
+
+static void sim_spi_begin(void)
+{
+}
+
+static void sim_spi_end(void)
+{
+}
+
+static void sim_spi_configure(const enum HAL_SPI_MODE mode,
+			      const uint32_t speed_hz, const uint8_t cs)
+{
+	(void)mode;
+	(void)speed_hz;
+
+	pthread_mutex_lock(&SIM.mtx);
+	SIM.spi_cs = cs;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+/* Only the MAX31865 on the hardware chip select answers, like the real
+ * chip the register address increments after each byte */
+static void sim_spi_transfer(uint8_t *data, const size_t n)
+{
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+
+	if (SIM.spi_cs != SIM_MAX31865_CS || n == 0) {
+		memset(data, 0, n);
+		pthread_mutex_unlock(&SIM.mtx);
+		return;
+	}
+
+	const uint8_t address = data[0];
+	int read_rtd = 0;
+	size_t i;
+	data[0] = 0;
+	for (i = 1; i < n; ++i) {
+		const enum MAX31865_REGISTER reg =
+		    ((address & 0x7F) + i - 1) % MAX31865_REGISTER_MAX;
+		if (address & 0x80) {
+			write_register(reg, data[i]);
+			data[i] = 0;
+		} else {
+			data[i] = SIM.regs[reg];
+			read_rtd |= reg == MAX31865_REGISTER_RTD_LSB;
+		}
+	}
+
+	/* reading the conversion result releases DRDY */
+	if (read_rtd) {
+		set_level(SIM_MAX31865_DRDY_PIN, 1);
+	}
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static void sim_gpio_function(const uint8_t pin,
+			      const enum HAL_GPIO_FUNCTION function)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	SIM.function[pin] = function;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static void sim_gpio_pull(const uint8_t pin, const enum HAL_GPIO_PULL pull)
+{
+	assert(pin < SIM_NUM_PINS);
+	(void)pull;
+}
+
+static void sim_gpio_write(const uint8_t pin, const uint8_t level)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	set_level(pin, level != 0);
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static uint8_t sim_gpio_read(const uint8_t pin)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	const uint8_t level = SIM.level[pin];
+	pthread_mutex_unlock(&SIM.mtx);
+	return level;
+}
+
+static void sim_gpio_detect(const uint8_t pin,
+			    const enum HAL_GPIO_DETECT detect, const int enable)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	if (detect == HAL_GPIO_DETECT_LOW) {
+		SIM.low_detect[pin] = enable != 0;
+	} else {
+		SIM.rising_detect[pin] = enable != 0;
+	}
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+/* Level detection keeps the status set as long as the level holds */
+static uint8_t sim_gpio_event_status(const uint8_t pin)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	const uint8_t status =
+	    SIM.event_status[pin] || (SIM.low_detect[pin] && !SIM.level[pin]);
+	pthread_mutex_unlock(&SIM.mtx);
+	return status;
+}
+
+static void sim_gpio_clear_event_status(const uint8_t pin)
+{
+	assert(pin < SIM_NUM_PINS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	SIM.event_status[pin] = 0;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+/* The edge events are written to a pipe in the kernel's format */
+static int sim_line_request(const char *chip, const uint8_t pin,
+			    const enum GPIO_EVENT_EDGE edge,
+			    const char *consumer)
+{
+	assert(pin < SIM_NUM_PINS);
+	(void)chip;
+	(void)consumer;
+
+	pthread_mutex_lock(&SIM.mtx);
+	struct sim_line *line = NULL;
+	unsigned int i;
+	for (i = 0; i < SIM_MAX_LINES; ++i) {
+		if (SIM.lines[i].read_fd != -1 && SIM.lines[i].pin == pin) {
+			pthread_mutex_unlock(&SIM.mtx);
+			errno = EBUSY;
+			return -1;
+		}
+		if (SIM.lines[i].read_fd == -1 && !line) {
+			line = &SIM.lines[i];
+		}
+	}
+
+	int fds[2];
+	if (!line || pipe(fds) == -1) {
+		pthread_mutex_unlock(&SIM.mtx);
+		if (!line) {
+			errno = ENOSPC;
+		}
+		return -1;
+	}
+	for (i = 0; i < 2; ++i) {
+		fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[i], F_SETFL, O_NONBLOCK);
+	}
+	line->read_fd = fds[0];
+	line->write_fd = fds[1];
+	line->pin = pin;
+	line->edge = edge;
+	pthread_mutex_unlock(&SIM.mtx);
+	return fds[0];
+}
+
+static struct sim_line *find_line(const int fd)
+{
+	unsigned int i;
+	for (i = 0; i < SIM_MAX_LINES; ++i) {
+		if (SIM.lines[i].read_fd == fd) {
+			return &SIM.lines[i];
+		}
+	}
+	return NULL;
+}
+
+static int sim_line_value(const int fd)
+{
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	const struct sim_line *line = find_line(fd);
+	const int value = line ? SIM.level[line->pin] : -1;
+	pthread_mutex_unlock(&SIM.mtx);
+	return value;
+}
+
+static void sim_line_release(const int fd)
+{
+	pthread_mutex_lock(&SIM.mtx);
+	struct sim_line *line = find_line(fd);
+	if (line) {
+		close(line->read_fd);
+		close(line->write_fd);
+		line->read_fd = -1;
+		line->write_fd = -1;
+	}
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static void sim_pwm_clock(const uint32_t divider)
+{
+	(void)divider;
+}
+
+static void sim_pwm_mode(const uint8_t channel, const uint8_t markspace,
+			 const uint8_t enabled)
+{
+	assert(channel < SIM_NUM_PWM_CHANNELS);
+	(void)markspace;
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	SIM.pwm_enabled[channel] = enabled;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static void sim_pwm_range(const uint8_t channel, const uint32_t range)
+{
+	assert(channel < SIM_NUM_PWM_CHANNELS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	SIM.pwm_range[channel] = range;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static void sim_pwm_data(const uint8_t channel, const uint32_t data)
+{
+	assert(channel < SIM_NUM_PWM_CHANNELS);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	SIM.pwm_data[channel] = data;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+static void sim_delay_us(const uint64_t us)
+{
+	struct timespec delay = { us / 1000000, (us % 1000000) * 1000 };
+	while (clock_nanosleep(CLOCK_MONOTONIC, 0, &delay, &delay) == EINTR) {
+	}
+}
+
+/* Fault status bits the next fault detection cycles report */
+void hal_sim_set_fault(const uint8_t status)
+{
+	pthread_mutex_lock(&SIM.mtx);
+	SIM.injected_fault = status;
+	SIM.pending_fault_due = 0;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+/* Copy of the plant's current state, e.g. to compare the actual bath
+ * temperature with the controller's view */
+void hal_sim_get_plant(sim_plant_t *plant)
+{
+	assert(plant != NULL);
+
+	pthread_mutex_lock(&SIM.mtx);
+	advance(monotonic_ns());
+	*plant = SIM.plant;
+	pthread_mutex_unlock(&SIM.mtx);
+}
+
+const struct hal_backend hal_sim_backend = {
+	.name = "sim",
+	.init = &sim_start,
+	.close = &sim_close,
+	.spi_begin = &sim_spi_begin,
+	.spi_end = &sim_spi_end,
+	.spi_configure = &sim_spi_configure,
+	.spi_transfer = &sim_spi_transfer,
+	.gpio_function = &sim_gpio_function,
+	.gpio_pull = &sim_gpio_pull,
+	.gpio_write = &sim_gpio_write,
+	.gpio_read = &sim_gpio_read,
+	.gpio_detect = &sim_gpio_detect,
+	.gpio_event_status = &sim_gpio_event_status,
+	.gpio_clear_event_status = &sim_gpio_clear_event_status,
+	.line_request = &sim_line_request,
+	.line_value = &sim_line_value,
+	.line_release = &sim_line_release,
+	.pwm_clock = &sim_pwm_clock,
+	.pwm_mode = &sim_pwm_mode,
+	.pwm_range = &sim_pwm_range,
+	.pwm_data = &sim_pwm_data,
+	.delay_us = &sim_delay_us,
+};
@@ -0,0 +1,46 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_HAL_SIM_H
+#define SOUSVIDED_HAL_SIM_H
+
+#include <stdint.h>
+
+#include "sim_plant.h"
+
+/* Wiring of the simulated board, the same as sousvided.c expects on the
+ * RaspberryPi. Only the MAX31865, the SSR and the circulator are simulated,
+ * the buttons are never pressed. */
+#define SIM_MAX31865_CS 0
+#define SIM_MAX31865_DRDY_PIN 25
+#define SIM_SSR_PIN 4
+#define SIM_CIRCULATOR_PWM_CHANNEL 0
+
+/* The simulated RTD and the MAX31865's reference resistor */
+#define SIM_RTD_R0 1000
+#define SIM_REFERENCE_RESISTANCE 1400
+
+/* Rate at which the simulation advances the plant and completes
+ * conversions */
+#define SIM_TICK_US 1000
+
+void hal_sim_set_fault(const uint8_t status);
+void hal_sim_get_plant(sim_plant_t *plant);
+
+#endif /* SOUSVIDED_HAL_SIM_H */
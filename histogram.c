@@ -0,0 +1,192 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "histogram.h"
+
+#include <assert.h>
+
+/* Threads are spread over the shards in the order they record their first
+ * value */
+static atomic_uint NEXT_SHARD;
+static _Thread_local int SHARD = -1;
+
+static struct histogram_shard *thread_shard(histogram_t *h)
+{
+	if (SHARD == -1) {
+		SHARD = atomic_fetch_add_explicit(&NEXT_SHARD, 1,
+						  memory_order_relaxed) %
+			HISTOGRAM_SHARDS;
+	}
+	return &h->shards[SHARD];
+}
+
+static unsigned int bucket_index(const uint64_t ns)
+{
+	const uint32_t value = ns > UINT32_MAX ? UINT32_MAX : ns;
+	if (value < HISTOGRAM_SUB_BUCKETS) {
+		return value;
+	}
+
+	const unsigned int msb = 31 - __builtin_clz(value);
+	const unsigned int shift = msb - (HISTOGRAM_SUB_BUCKET_BITS - 1);
+	return HISTOGRAM_SUB_BUCKETS +
+	       (msb - HISTOGRAM_SUB_BUCKET_BITS) * (HISTOGRAM_SUB_BUCKETS / 2) +
+	       (value >> shift) - HISTOGRAM_SUB_BUCKETS / 2;
+}
+
+/* Largest value that is counted in the bucket */
+static uint64_t bucket_value(const unsigned int index)
+{
+	if (index < HISTOGRAM_SUB_BUCKETS) {
+		return index;
+	}
+
+	const unsigned int i = index - HISTOGRAM_SUB_BUCKETS;
+	const unsigned int msb =
+	    i / (HISTOGRAM_SUB_BUCKETS / 2) + HISTOGRAM_SUB_BUCKET_BITS;
+	const uint64_t top =
+	    i % (HISTOGRAM_SUB_BUCKETS / 2) + HISTOGRAM_SUB_BUCKETS / 2;
+	return ((top + 1) << (msb - (HISTOGRAM_SUB_BUCKET_BITS - 1))) - 1;
+}
+
+void histogram_init(histogram_t *h, const char *name)
+{
+	assert(h != NULL);
+
+	h->name = name;
+	histogram_reset(h);
+}
+
+/* Values recorded concurrently may or may not survive the reset */
+void histogram_reset(histogram_t *h)
+{
+	unsigned int i, j;
+
+	assert(h != NULL);
+
+	for (i = 0; i < HISTOGRAM_SHARDS; ++i) {
+		for (j = 0; j < HISTOGRAM_BUCKETS; ++j) {
+			atomic_store_explicit(&h->shards[i].counts[j], 0,
+					      memory_order_relaxed);
+		}
+		atomic_store_explicit(&h->shards[i].max, 0,
+				      memory_order_relaxed);
+	}
+}
+
+void histogram_record(histogram_t *h, const uint64_t ns)
+{
+	assert(h != NULL);
+
+	struct histogram_shard *shard = thread_shard(h);
+	atomic_fetch_add_explicit(&shard->counts[bucket_index(ns)], 1,
+				  memory_order_relaxed);
+
+	unsigned long long max =
+	    atomic_load_explicit(&shard->max, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(
+			       &shard->max, &max, ns, memory_order_relaxed,
+			       memory_order_relaxed)) {
+	}
+}
+
+void histogram_snapshot(const histogram_t *h,
+			struct histogram_snapshot *snapshot)
+{
+	unsigned int i, j;
+
+	assert(h != NULL);
+	assert(snapshot != NULL);
+
+	snapshot->total = 0;
+	snapshot->max = 0;
+	for (j = 0; j < HISTOGRAM_BUCKETS; ++j) {
+		snapshot->counts[j] = 0;
+	}
+
+	for (i = 0; i < HISTOGRAM_SHARDS; ++i) {
+		const struct histogram_shard *shard = &h->shards[i];
+		for (j = 0; j < HISTOGRAM_BUCKETS; ++j) {
+			const uint64_t count = atomic_load_explicit(
+			    &shard->counts[j], memory_order_relaxed);
+			snapshot->counts[j] += count;
+			snapshot->total += count;
+		}
+
+		const uint64_t max =
+		    atomic_load_explicit(&shard->max, memory_order_relaxed);
+		if (max > snapshot->max) {
+			snapshot->max = max;
+		}
+	}
+}
+
+/* Highest value equivalent to the given percentile (0-100), 0 for an
+ * empty histogram */
+uint64_t histogram_percentile(const struct histogram_snapshot *snapshot,
+			      const double percentile)
+{
+	assert(snapshot != NULL);
+
+	if (snapshot->total == 0) {
+		return 0;
+	}
+
+	uint64_t rank = snapshot->total * percentile / 100.0 + 0.5;
+	if (rank == 0) {
+		rank = 1;
+	}
+
+	uint64_t count = 0;
+	unsigned int i;
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		count += snapshot->counts[i];
+		if (count >= rank) {
+			break;
+		}
+	}
+
+	const uint64_t value = bucket_value(i);
+	return value < snapshot->max ? value : snapshot->max;
+}
+
+void histogram_print_header(FILE *stream)
+{
+	assert(stream != NULL);
+
+	fprintf(stream, "%-20s %10s %10s %10s %10s %10s %10s\n", "timing",
+		"count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+}
+
+void histogram_print(const histogram_t *h, FILE *stream)
+{
+	struct histogram_snapshot snapshot;
+
+	assert(h != NULL);
+	assert(stream != NULL);
+
+	histogram_snapshot(h, &snapshot);
+	fprintf(stream, "%-20s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		h->name, (unsigned long long)snapshot.total,
+		histogram_percentile(&snapshot, 50.0) / 1.0E3,
+		histogram_percentile(&snapshot, 90.0) / 1.0E3,
+		histogram_percentile(&snapshot, 99.0) / 1.0E3,
+		histogram_percentile(&snapshot, 99.9) / 1.0E3,
+		snapshot.max / 1.0E3);
+}
@@ -0,0 +1,74 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_HISTOGRAM_H
+#define SOUSVIDED_HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Log-linear histogram of durations in ns, in the style of HdrHistogram:
+ * exact below 64ns, above that 32 buckets per power of two, i.e. a
+ * relative error below 3.2% up to the limit of 4.29s. Recording is a
+ * relaxed atomic increment in the shard of the recording thread, so
+ * threads never wait for each other and rarely share a cache line. */
+
+#define HISTOGRAM_SUB_BUCKET_BITS 6
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS                                                     \
+	(HISTOGRAM_SUB_BUCKETS +                                              \
+	 (32 - HISTOGRAM_SUB_BUCKET_BITS) * (HISTOGRAM_SUB_BUCKETS / 2))
+#define HISTOGRAM_SHARDS 4
+
+struct histogram_shard
+{
+	atomic_ullong counts[HISTOGRAM_BUCKETS];
+	atomic_ullong max;
+} __attribute__((aligned(64)));
+
+struct histogram
+{
+	const char *name;
+	struct histogram_shard shards[HISTOGRAM_SHARDS];
+};
+typedef struct histogram histogram_t;
+
+/* Counts of all shards at one point in time */
+struct histogram_snapshot
+{
+	uint64_t counts[HISTOGRAM_BUCKETS];
+	uint64_t total;
+	uint64_t max;
+};
+
+void histogram_init(histogram_t *h, const char *name);
+void histogram_reset(histogram_t *h);
+
+void histogram_record(histogram_t *h, const uint64_t ns);
+
+void histogram_snapshot(const histogram_t *h,
+			struct histogram_snapshot *snapshot);
+uint64_t histogram_percentile(const struct histogram_snapshot *snapshot,
+			      const double percentile);
+
+void histogram_print_header(FILE *stream);
+void histogram_print(const histogram_t *h, FILE *stream);
+
+#endif /* SOUSVIDED_HISTOGRAM_H */
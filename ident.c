@@ -0,0 +1,372 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "ident.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Steps before the model is published, and after a load change */
+#define IDENT_WARMUP_STEPS 60
+
+/* Initial covariance of a, b and c */
+static const double INITIAL_COVARIANCE[3] = { 1.0, 1.0E2, 1.0E4 };
+
+/* At steady state the data only pins down the holding duty cycle, and with
+ * forgetting the estimates drift along the other directions. Forgetting
+ * stops while the trace of P is above this. */
+#define IDENT_MAX_TRACE 1.0
+
+/* The model is published while the standard deviation of b is below this
+ * share of b. There is no telling b from c while the duty cycle stays
+ * constant, e.g. while heating up at full power. */
+#define IDENT_MAX_UNCERTAINTY 0.2
+
+/* A valid model is stable after this many steps without differing from the
+ * first of them, see ident_model_differs() */
+#define IDENT_STABLE_STEPS 120
+
+/* Relative change of the gain or the time constant, and change of the
+ * ambient temperature in K, that make a model differ. Any change of the
+ * dead time does. */
+#define IDENT_STABLE_CHANGE 0.05
+#define IDENT_STABLE_AMBIENT 1.0
+
+/* Another dead time takes over once its estimator predicts this much
+ * better. Close to steady state all of them predict about equally well and
+ * the best one would otherwise wander between them. */
+#define IDENT_DELAY_MARGIN 0.05
+
+/* Prediction errors are clipped to this many standard deviations */
+#define IDENT_OUTLIER_LIMIT 4.0
+
+/* Two sided CUSUM test on the normalized prediction errors of the best
+ * estimator: drift allowance and alarm threshold, in standard deviations */
+#define IDENT_CUSUM_DRIFT 0.5
+#define IDENT_CUSUM_LIMIT 10.0
+
+/* Standard deviation of the loss coefficient after a load change, relative
+ * to the current one */
+#define IDENT_LOAD_CHANGE_LOSS 10.0
+
+static double elapsed_s(const struct timespec *start,
+			const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) * 1.0E-9;
+}
+
+static void rls_init(struct ident_rls *rls)
+{
+	memset(rls, 0, sizeof(*rls));
+	rls->theta[0] = 1.0;
+	rls->p[0][0] = INITIAL_COVARIANCE[0];
+	rls->p[1][1] = INITIAL_COVARIANCE[1];
+	rls->p[2][2] = INITIAL_COVARIANCE[2];
+}
+
+/* One recursive instrumental variable step, returns the a priori
+ * prediction error. The temperature in phi is as noisy as the one
+ * predicted, plain least squares would let the noise pull a towards 0.
+ * The instruments z replace it with an older temperature. */
+static double rls_update(struct ident_rls *rls, const double phi[3],
+			 const double z[3], const double y,
+			 const double forgetting)
+{
+	double pz[3], phip[3];
+	int i, j;
+
+	for (i = 0; i < 3; ++i) {
+		pz[i] = rls->p[i][0] * z[0] + rls->p[i][1] * z[1] +
+			rls->p[i][2] * z[2];
+		phip[i] = phi[0] * rls->p[0][i] + phi[1] * rls->p[1][i] +
+			  phi[2] * rls->p[2][i];
+	}
+
+	const double trace = rls->p[0][0] + rls->p[1][1] + rls->p[2][2];
+	const double lambda = trace < IDENT_MAX_TRACE ? forgetting : 1.0;
+	const double denominator =
+	    lambda + phi[0] * pz[0] + phi[1] * pz[1] + phi[2] * pz[2];
+	const double e = y - (rls->theta[0] * phi[0] +
+			      rls->theta[1] * phi[1] + rls->theta[2] * phi[2]);
+
+	/* Sudden changes of the temperature, e.g. from cold food, aren't
+	 * changes of the parameters. Limit their weight. */
+	double clipped = e;
+	if (rls->updates >= IDENT_WARMUP_STEPS) {
+		const double limit = IDENT_OUTLIER_LIMIT * sqrt(rls->error);
+		clipped = fmax(-limit, fmin(limit, e));
+	}
+
+	for (i = 0; i < 3; ++i) {
+		const double k = pz[i] / denominator;
+		rls->theta[i] += k * clipped;
+		for (j = 0; j < 3; ++j) {
+			rls->p[i][j] = (rls->p[i][j] - k * phip[j]) / lambda;
+		}
+	}
+
+	/* plain mean until the forgetting takes over */
+	const double weight = fmax(1.0 - lambda, 1.0 / ++rls->updates);
+	rls->error += weight * (clipped * clipped - rls->error);
+	return e;
+}
+
+/* The model is updated every step_s seconds from the duty cycle averaged
+ * over the step. forgetting weights the past steps, e.g. 0.999 for a memory
+ * of about 1000 steps. */
+void ident_init(ident_t *id, const double step_s, const double forgetting)
+{
+	assert(id != NULL);
+	assert(step_s > 0.0);
+	assert(forgetting > 0.0 && forgetting <= 1.0);
+
+	memset(id, 0, sizeof(*id));
+	id->step_s = step_s;
+	id->forgetting = forgetting;
+	pthread_mutex_init(&id->model_mtx, NULL);
+	ident_reset(id);
+}
+
+void ident_cleanup(ident_t *id)
+{
+	assert(id != NULL);
+
+	pthread_mutex_destroy(&id->model_mtx);
+}
+
+/* Start over, e.g. with a different bath */
+void ident_reset(ident_t *id)
+{
+	assert(id != NULL);
+
+	unsigned int i;
+
+	id->started = 0;
+	id->duty_integral = 0.0;
+	id->duty_next = 0;
+	id->steps = 0;
+	id->settled = 0;
+	id->best = 0;
+	id->cusum_high = 0.0;
+	id->cusum_low = 0.0;
+	for (i = 0; i < IDENT_DELAYS; ++i) {
+		id->duty[i] = 0.0;
+		rls_init(&id->rls[i]);
+	}
+
+	pthread_mutex_lock(&id->model_mtx);
+	memset(&id->model, 0, sizeof(id->model));
+	pthread_mutex_unlock(&id->model_mtx);
+}
+
+static void publish(ident_t *id, const struct timespec *load_change)
+{
+	const struct ident_rls *rls = &id->rls[id->best];
+	const double a = rls->theta[0];
+	const double b = rls->theta[1];
+	const double c = rls->theta[2];
+	/* only the updating thread writes the model */
+	struct ident_model model = id->model;
+
+	const double b_deviation = sqrt(rls->p[1][1] * rls->error);
+	model.valid = id->settled >= IDENT_WARMUP_STEPS && a > 0.0 &&
+		      a < 1.0 && b_deviation < IDENT_MAX_UNCERTAINTY * b;
+	if (model.valid) {
+		model.gain = b / (1.0 - a);
+		model.time_constant = -id->step_s / log(a);
+		model.dead_time = id->best * id->step_s;
+		model.loss = 1.0 / model.gain;
+		model.ambient = c / (1.0 - a);
+	}
+	model.error = sqrt(rls->error);
+
+	if (!model.valid) {
+		model.stable_steps = 0;
+	} else if (!model.stable_steps ||
+		   ident_model_differs(&model, &id->reference)) {
+		id->reference = model;
+		model.stable_steps = 1;
+	} else {
+		++model.stable_steps;
+	}
+	model.stable = model.stable_steps >= IDENT_STABLE_STEPS;
+
+	if (load_change) {
+		++model.load_changes;
+		model.last_load_change = *load_change;
+	}
+
+	pthread_mutex_lock(&id->model_mtx);
+	id->model = model;
+	pthread_mutex_unlock(&id->model_mtx);
+}
+
+/* A load change shows as prediction errors of one sign that the model
+ * can't explain. Most load changes (a lid taken off, the circulator
+ * changed) change the heat loss, open up the covariance in its direction
+ * so the estimates follow the new loss instead of averaging it with the
+ * old one. */
+static int detect_load_change(ident_t *id, const double e)
+{
+	const struct ident_rls *rls = &id->rls[id->best];
+	unsigned int i, j;
+
+	if (id->settled < IDENT_WARMUP_STEPS || rls->error <= 0.0) {
+		return 0;
+	}
+
+	const double z = e / sqrt(rls->error);
+	id->cusum_high = fmax(0.0, id->cusum_high + z - IDENT_CUSUM_DRIFT);
+	id->cusum_low = fmax(0.0, id->cusum_low - z - IDENT_CUSUM_DRIFT);
+	if (id->cusum_high < IDENT_CUSUM_LIMIT &&
+	    id->cusum_low < IDENT_CUSUM_LIMIT) {
+		return 0;
+	}
+
+	for (i = 0; i < IDENT_DELAYS; ++i) {
+		struct ident_rls *r = &id->rls[i];
+		const double loss = 1.0 - r->theta[0];
+		if (loss <= 0.0) {
+			continue;
+		}
+
+		/* a and c change with the loss coefficient l as
+		 * (-1, T_ambient) l, b stays the same */
+		const double v[3] = { -1.0, 0.0, r->theta[2] / loss };
+		const double q = (IDENT_LOAD_CHANGE_LOSS * loss) *
+				 (IDENT_LOAD_CHANGE_LOSS * loss);
+		for (j = 0; j < 9; ++j) {
+			r->p[j / 3][j % 3] += q * v[j / 3] * v[j % 3];
+		}
+	}
+	id->cusum_high = 0.0;
+	id->cusum_low = 0.0;
+	id->settled = 0;
+	return 1;
+}
+
+static int step(ident_t *id, const double duty, const double temperature,
+		const struct timespec *timestamp)
+{
+	unsigned int d, best_error = 0;
+	double e = 0.0;
+	double phi[3], z[3];
+
+	id->duty[id->duty_next] = duty;
+	id->duty_next = (id->duty_next + 1) % IDENT_DELAYS;
+
+	phi[0] = id->temperature;
+	phi[2] = 1.0;
+	z[0] = id->steps ? id->previous_temperature : id->temperature;
+	z[2] = 1.0;
+	for (d = 0; d < IDENT_DELAYS && d <= id->steps; ++d) {
+		phi[1] = id->duty[(id->duty_next + IDENT_DELAYS - 1 - d) %
+				  IDENT_DELAYS];
+		z[1] = phi[1];
+		const double error = rls_update(&id->rls[d], phi, z,
+						temperature, id->forgetting);
+		if (d == id->best) {
+			e = error;
+		}
+		if (id->rls[d].error < id->rls[best_error].error) {
+			best_error = d;
+		}
+	}
+	++id->steps;
+	++id->settled;
+
+	/* test the estimator that made the prediction, then switch */
+	const int load_change = detect_load_change(id, e);
+	if (id->rls[best_error].error <
+	    (1.0 - IDENT_DELAY_MARGIN) * id->rls[id->best].error) {
+		id->best = best_error;
+	}
+	publish(id, load_change ? timestamp : NULL);
+	return load_change;
+}
+
+/* Feed the duty cycle (0 to 1) applied since the previous call and the
+ * temperature measured at timestamp. Returns 1 when the step detected a
+ * load change, 0 otherwise. */
+int ident_update(ident_t *id, const double duty, const double temperature,
+		 const struct timespec *timestamp)
+{
+	assert(id != NULL);
+	assert(timestamp != NULL);
+
+	if (!id->started) {
+		id->started = 1;
+		id->step_start = *timestamp;
+		id->last_input = *timestamp;
+		id->temperature = temperature;
+		return 0;
+	}
+
+	const double dt = elapsed_s(&id->last_input, timestamp);
+	if (dt <= 0.0) {
+		return 0;
+	}
+	id->duty_integral += duty * dt;
+	id->last_input = *timestamp;
+
+	const double elapsed = elapsed_s(&id->step_start, timestamp);
+	if (elapsed < id->step_s) {
+		return 0;
+	}
+
+	const int load_change =
+	    step(id, id->duty_integral / elapsed, temperature, timestamp);
+	id->step_start = *timestamp;
+	id->duty_integral = 0.0;
+	id->previous_temperature = id->temperature;
+	id->temperature = temperature;
+	return load_change;
+}
+
+void ident_get_model(ident_t *id, struct ident_model *model)
+{
+	assert(id != NULL);
+	assert(model != NULL);
+
+	pthread_mutex_lock(&id->model_mtx);
+	*model = id->model;
+	pthread_mutex_unlock(&id->model_mtx);
+}
+
+static int relative_change(const double a, const double b)
+{
+	return fabs(a - b) > IDENT_STABLE_CHANGE * fabs(b);
+}
+
+/* Whether two models differ by more than the estimates wander, e.g. to
+ * decide if a controller should take a new stable model */
+int ident_model_differs(const struct ident_model *a,
+			const struct ident_model *b)
+{
+	assert(a != NULL);
+	assert(b != NULL);
+
+	return a->dead_time != b->dead_time ||
+	       relative_change(a->gain, b->gain) ||
+	       relative_change(a->time_constant, b->time_constant) ||
+	       fabs(a->ambient - b->ambient) > IDENT_STABLE_AMBIENT;
+}
@@ -0,0 +1,110 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_IDENT_H
+#define SOUSVIDED_IDENT_H
+
+#include <pthread.h>
+#include <time.h>
+
+/* Online identification of a first order plus dead time model of the bath
+ * from the heater duty cycle u (0 to 1) and the temperature T. Every step
+ * the model
+ *
+ *   T[k+1] = a T[k] + b u[k-d] + c
+ *
+ * is fitted by recursive least squares (with instrumental variables and
+ * exponential forgetting), one estimator per candidate dead time d. The
+ * estimator that predicts best gives the model. Each step is a fixed number
+ * of 3x3 operations per candidate.
+ *
+ * A load change (cold food, a lid taken off) shows as a run of prediction
+ * errors that the model can't explain. It is counted and lets the
+ * estimates follow the new parameters quickly. */
+
+/* Candidate dead times, in steps */
+#define IDENT_DELAYS 12
+
+/* Published model in physical units. While valid is 0 the estimates are
+ * the last valid ones, if any. A valid model can still wander from step to
+ * step, stable is only set once it stayed close to where it was for a
+ * while (and never right after a load change). Controllers should only
+ * take stable models. */
+struct ident_model
+{
+	int valid;
+	int stable;
+	unsigned int stable_steps; /* since the model last moved */
+	double gain;          /* K above ambient at full heater power */
+	double time_constant; /* s */
+	double dead_time;     /* s */
+	double loss;          /* share of the heater power lost per K */
+	double ambient;       /* degrees Celsius */
+	double error;         /* K, RMS of the one step prediction error */
+	unsigned int load_changes;
+	struct timespec last_load_change;
+};
+
+struct ident_rls
+{
+	double theta[3]; /* a, b, c */
+	double p[3][3];  /* covariance */
+	double error;    /* mean squared prediction error, forgotten like P */
+	unsigned int updates;
+};
+
+struct ident
+{
+	double step_s;
+	double forgetting;
+
+	/* duty cycle averaged over the current step */
+	int started;
+	struct timespec step_start;
+	struct timespec last_input;
+	double duty_integral; /* duty cycle x s */
+
+	double temperature; /* at the start of the current step */
+	double previous_temperature; /* one step earlier */
+	double duty[IDENT_DELAYS]; /* past steps, newest at duty_next - 1 */
+	unsigned int duty_next;
+	unsigned int steps;
+	unsigned int settled; /* steps since the start or a load change */
+	struct ident_model reference; /* at the start of the stable steps */
+
+	struct ident_rls rls[IDENT_DELAYS];
+	unsigned int best;
+	double cusum_high;
+	double cusum_low;
+
+	pthread_mutex_t model_mtx;
+	struct ident_model model; /* protected by model_mtx */
+};
+typedef struct ident ident_t;
+
+void ident_init(ident_t *id, const double step_s, const double forgetting);
+void ident_cleanup(ident_t *id);
+void ident_reset(ident_t *id);
+int ident_update(ident_t *id, const double duty, const double temperature,
+		 const struct timespec *timestamp);
+void ident_get_model(ident_t *id, struct ident_model *model);
+int ident_model_differs(const struct ident_model *a,
+			const struct ident_model *b);
+
+#endif /* SOUSVIDED_IDENT_H */
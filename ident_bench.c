@@ -0,0 +1,153 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Benchmark and check of the online plant identification.
+ *
+ * Usage: ident_bench [HOURS]
+ *
+ * Runs the PID controller against the simulated bath at one step per
+ * second: heating up to 55 degrees Celsius, a set point change to 60 after
+ * two hours, cold food added (the bath drops by 5 K) after four hours and
+ * the lid taken off (twice the heat loss) after six hours. Prints the
+ * identified model every half hour next to the one derived from the
+ * simulation parameters, with the steps it has been stable for, the
+ * detected load changes and the CPU time per ident_update(). Run it on the
+ * target (e.g. ARMv6) to get meaningful timings.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ident.h"
+#include "pid.h"
+#include "sim_plant.h"
+
+#define STEP_S 5.0
+#define FORGETTING 0.999
+
+static double elapsed_ns(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1.0E9 +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+static void print_model(const unsigned int t, const sim_plant_t *plant,
+			ident_t *id)
+{
+	const struct sim_plant_params *p = &plant->params;
+	struct ident_model model;
+
+	ident_get_model(id, &model);
+	printf("%6.1f h  %8.1f %8.1f %8.0f %8.0f %6.0f %6.0f %8.4f %8.4f "
+	       "%6u\n",
+	       t / 3600.0, p->heater_power / p->loss, model.gain,
+	       (p->heater_capacity + p->bath_capacity) / p->loss,
+	       model.time_constant, p->sensor_lag + p->heater_capacity /
+	       p->mixing_full, model.dead_time, model.error,
+	       model.valid ? model.loss : NAN, model.stable_steps);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int hours = 8;
+	if (argc == 2) {
+		hours = strtoul(argv[1], NULL, 10);
+		if (!hours) {
+			fprintf(stderr, "need at least one hour\n");
+			return EXIT_FAILURE;
+		}
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [HOURS]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	sim_plant_t plant;
+	sim_plant_init(&plant, NULL);
+
+	pidctrl_t *pid =
+	    pidctrl_init(55.0, 500.0, 2.5, 50.0, 2.0, NULL, NULL, 1000, 0.0,
+			 1000.0);
+	if (!pid) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	ident_t id;
+	ident_init(&id, STEP_S, FORGETTING);
+
+	printf("%8s  %8s %8s %8s %8s %6s %6s %8s %8s %6s\n", "time", "gain",
+	       "est.", "tau s", "est.", "dead", "est.", "rms K", "loss",
+	       "stable");
+
+	struct timespec now = { 0, 0 };
+	struct timespec start, end;
+	double duty = 0.0, total_ns = 0.0, step_ns = 0.0, max_ns = 0.0;
+	unsigned int t, steps = 0;
+
+	for (t = 0; t < hours * 3600; ++t) {
+		if (t == 2 * 3600) {
+			pidctrl_set_set_point(pid, 60.0);
+		} else if (t == 4 * 3600) {
+			printf("food added\n");
+			plant.bath_temperature -= 5.0;
+			plant.heater_temperature -= 5.0;
+		} else if (t == 6 * 3600) {
+			printf("lid off\n");
+			plant.params.loss *= 2.0;
+		}
+
+		sim_plant_step(&plant, 1.0, duty / 1000.0, 1.0);
+		++now.tv_sec;
+		const double temperature = sim_plant_read_sensor(&plant);
+
+		const unsigned int before = id.steps;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		const int load_change =
+		    ident_update(&id, duty / 1000.0, temperature, &now);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		const double ns = elapsed_ns(&start, &end);
+		total_ns += ns;
+		max_ns = ns > max_ns ? ns : max_ns;
+		if (id.steps != before) {
+			step_ns += ns;
+			++steps;
+		}
+
+		if (load_change) {
+			printf("load change detected at %.2f h\n",
+			       t / 3600.0);
+		}
+		if ((t + 1) % 1800 == 0) {
+			print_model(t + 1, &plant, &id);
+		}
+
+		duty = pidctrl_update(pid, temperature, &now);
+	}
+
+	printf("ident_update: %.0f ns per call, %.0f ns per model step, "
+	       "%.0f ns max\n",
+	       total_ns / t, steps ? step_ns / steps : 0.0, max_ns);
+
+	ident_cleanup(&id);
+	pidctrl_free(pid);
+	return EXIT_SUCCESS;
+}
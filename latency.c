@@ -0,0 +1,74 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "latency.h"
+
+#include <assert.h>
+
+#include "histogram.h"
+
+/* the zero initialized counts are an empty histogram */
+static histogram_t LATENCY[LATENCY_MAX] = {
+	[LATENCY_CONTROL_PERIOD] = { .name = "control period error" },
+	[LATENCY_SPI_READ] = { .name = "spi read" },
+	[LATENCY_PID_COMPUTE] = { .name = "pid compute" },
+	[LATENCY_MPC_SOLVE] = { .name = "mpc solve" },
+	[LATENCY_SSR_WRITE] = { .name = "ssr write" },
+	[LATENCY_SET_POINT] = { .name = "set point change" }
+};
+
+void latency_record(const enum LATENCY_TIMING timing, const uint64_t ns)
+{
+	assert(timing < LATENCY_MAX);
+	histogram_record(&LATENCY[timing], ns);
+}
+
+void latency_record_since(const enum LATENCY_TIMING timing,
+			  const struct timespec *start)
+{
+	struct timespec now;
+
+	assert(start != NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const int64_t ns = (int64_t)(now.tv_sec - start->tv_sec) * 1000000000 +
+			   (now.tv_nsec - start->tv_nsec);
+	latency_record(timing, ns > 0 ? ns : 0);
+}
+
+void latency_print(FILE *stream)
+{
+	unsigned int i;
+
+	assert(stream != NULL);
+
+	histogram_print_header(stream);
+	for (i = 0; i < LATENCY_MAX; ++i) {
+		histogram_print(&LATENCY[i], stream);
+	}
+	fflush(stream);
+}
+
+void latency_reset(void)
+{
+	unsigned int i;
+	for (i = 0; i < LATENCY_MAX; ++i) {
+		histogram_reset(&LATENCY[i]);
+	}
+}
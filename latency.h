@@ -0,0 +1,52 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_LATENCY_H
+#define SOUSVIDED_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* Always-on latency histograms of the control path, see histogram.h */
+enum LATENCY_TIMING {
+	/* deviation of the control period from PID_CONTROL_LOOP_MS */
+	LATENCY_CONTROL_PERIOD = 0,
+	/* SPI transfers of MAX31865 register reads */
+	LATENCY_SPI_READ,
+	/* PID controller update */
+	LATENCY_PID_COMPUTE,
+	/* model predictive controller update */
+	LATENCY_MPC_SOLVE,
+	/* switching the SSR GPIO */
+	LATENCY_SSR_WRITE,
+	/* from a button press or key until the controller runs with the new
+	 * set point */
+	LATENCY_SET_POINT,
+	LATENCY_MAX
+};
+
+void latency_record(const enum LATENCY_TIMING timing, const uint64_t ns);
+void latency_record_since(const enum LATENCY_TIMING timing,
+			  const struct timespec *start);
+
+void latency_print(FILE *stream);
+void latency_reset(void);
+
+#endif /* SOUSVIDED_LATENCY_H */
@@ -23,11 +23,19 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <pthread.h>
+#include <sched.h>
 
-#include "bcm2835.h"
-#include "rtd_table.h"
+#include "hal.h"
+#include "latency.h"
+#include "trace.h"
+
+static void spi_transfer(const max31865_t *m, uint8_t *data, const size_t n)
+{
+	spi_device_transfer(&m->spi, data, n);
+}
 
 static uint8_t read_register8(const max31865_t *m,
 			      const enum MAX31865_REGISTER reg)
@@ -36,7 +44,7 @@ static uint8_t read_register8(const max31865_t *m,
 	assert(reg != MAX31865_REGISTER_MAX);
 
 	uint8_t data[2] = { reg & 0x7F, 0x00 };
-	bcm2835_spi_transfern((char *)data, sizeof(data));
+	spi_transfer(m, data, sizeof(data));
 	return data[1];
 }
 
@@ -47,20 +55,104 @@ static uint16_t read_register16(const max31865_t *m,
 	assert(reg != MAX31865_REGISTER_MAX);
 
 	uint8_t data[3] = { reg & 0x7F, 0x00, 0x00 };
-	bcm2835_spi_transfern((char *)&data, sizeof(data));
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	spi_transfer(m, data, sizeof(data));
+	latency_record_since(LATENCY_SPI_READ, &start);
 	return (((uint16_t)data[1] << 8) | (uint16_t)data[2]);
 }
 
-static uint32_t read_register32(const max31865_t *m,
-				const enum MAX31865_REGISTER reg)
+/* Register accesses that are transferred back to back in a single SPI
+ * batch, each in its own chip select cycle */
+#define MAX31865_BATCH_SIZE 3
+
+struct register_batch
 {
-	assert(m != NULL);
-	assert(reg != MAX31865_REGISTER_MAX);
+	struct hal_spi_message messages[MAX31865_BATCH_SIZE];
+	uint8_t data[MAX31865_BATCH_SIZE][1 + MAX31865_REGISTER_MAX];
+	size_t n;
+};
+
+static uint8_t *batch_add(struct register_batch *batch, const uint8_t address,
+			  const size_t n)
+{
+	assert(batch->n < MAX31865_BATCH_SIZE);
+	assert(n <= MAX31865_REGISTER_MAX);
+
+	uint8_t *data = batch->data[batch->n];
+	memset(data, 0, 1 + n);
+	data[0] = address;
+	batch->messages[batch->n].data = data;
+	batch->messages[batch->n].n = 1 + n;
+	++batch->n;
+	return data + 1;
+}
+
+/* Returns where the n registers starting at reg will be after the
+ * transfer */
+static const uint8_t *batch_read(struct register_batch *batch,
+				 const enum MAX31865_REGISTER reg,
+				 const size_t n)
+{
+	return batch_add(batch, reg & 0x7F, n);
+}
 
-	uint8_t data[5] = { reg & 0x7F, 0, 0, 0, 0 };
-	bcm2835_spi_transfern((char *)&data, sizeof(data));
-	return (((uint32_t)data[1] << 24) | ((uint32_t)data[2] << 16) |
-		((uint32_t)data[3] << 8) | (uint32_t)data[4]);
+static void batch_write8(struct register_batch *batch,
+			 const enum MAX31865_REGISTER reg, const uint8_t value)
+{
+	batch_add(batch, 0x80 | reg, 1)[0] = value;
+}
+
+static void batch_transfer(const max31865_t *m, struct register_batch *batch)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	spi_device_transfer_batch(&m->spi, batch->messages, batch->n);
+	latency_record_since(LATENCY_SPI_READ, &start);
+}
+
+/* Transfer a batch that reads the whole register file to regs and cache
+ * the result. snapshot may be NULL. */
+static void transfer_snapshot(max31865_t *m, struct register_batch *batch,
+			      const uint8_t *regs,
+			      struct max31865_snapshot *snapshot)
+{
+	struct timespec now;
+
+	pthread_mutex_lock(&m->snapshot_mtx);
+	batch_transfer(m, batch);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	const uint16_t rtd = ((uint16_t)regs[MAX31865_REGISTER_RTD_MSB] << 8) |
+			     regs[MAX31865_REGISTER_RTD_LSB];
+	m->snapshot.timestamp = now;
+	m->snapshot.config = regs[MAX31865_REGISTER_CONFIG];
+	m->snapshot.rtd = rtd >> 1;
+	m->snapshot.rtd_fault = rtd & 0x0001;
+	m->snapshot.fault_ht =
+	    ((uint16_t)regs[MAX31865_REGISTER_FAULT_HT_MSB] << 8) |
+	    regs[MAX31865_REGISTER_FAULT_HT_LSB];
+	m->snapshot.fault_lt =
+	    ((uint16_t)regs[MAX31865_REGISTER_FAULT_LT_MSB] << 8) |
+	    regs[MAX31865_REGISTER_FAULT_LT_LSB];
+	m->snapshot.fault_status = regs[MAX31865_REGISTER_FAULT_STATUS];
+	m->fault_ht = m->snapshot.fault_ht;
+	m->fault_lt = m->snapshot.fault_lt;
+	if (snapshot) {
+		*snapshot = m->snapshot;
+	}
+	pthread_mutex_unlock(&m->snapshot_mtx);
+}
+
+/* Read the whole register file in a single transfer, the MAX31865 increments
+ * the register address after each byte. Also releases DRDY, like any read of
+ * the RTD registers. */
+static void read_snapshot(max31865_t *m, struct max31865_snapshot *snapshot)
+{
+	struct register_batch batch = { .n = 0 };
+	const uint8_t *regs =
+	    batch_read(&batch, MAX31865_REGISTER_CONFIG, MAX31865_REGISTER_MAX);
+	transfer_snapshot(m, &batch, regs, snapshot);
 }
 
 static void write_register8(const max31865_t *m,
@@ -71,7 +163,7 @@ static void write_register8(const max31865_t *m,
 	assert(reg != MAX31865_REGISTER_MAX);
 
 	uint8_t data[2] = { 0x80 | reg, value };
-	bcm2835_spi_transfern((char *)data, sizeof(data));
+	spi_transfer(m, data, sizeof(data));
 }
 
 static void write_register16(const max31865_t *m,
@@ -82,7 +174,7 @@ static void write_register16(const max31865_t *m,
 	assert(reg != MAX31865_REGISTER_MAX);
 
 	uint8_t data[3] = { 0x80 | reg, (value & 0xFF00) >> 8, value & 0xFF };
-	bcm2835_spi_transfern((char *)&data, sizeof(data));
+	spi_transfer(m, data, sizeof(data));
 }
 
 static void write_register32(const max31865_t *m,
@@ -95,7 +187,7 @@ static void write_register32(const max31865_t *m,
 	uint8_t data[5] = {
 	    0x80 | reg, (value & 0xFF000000) >> 24, (value & 0x00FF0000) >> 16, 
 	    (value & 0x0000FF00) >> 8, (value & 0x000000FF) };
-	bcm2835_spi_transfern((char *)&data, sizeof(data));
+	spi_transfer(m, data, sizeof(data));
 }
 
 int max31865_init(max31865_t *m, const uint8_t cs_pin, const uint8_t drdy_pin,
@@ -104,55 +196,49 @@ int max31865_init(max31865_t *m, const uint8_t cs_pin, const uint8_t drdy_pin,
 	assert(m != NULL);
 	assert(!m->initialized);
 
-	m->rtd = 0;
 	m->cs_pin = cs_pin;
 	m->drdy_pin = drdy_pin;
 	m->rtd_type = rtd_type;
 	m->query_mode = 0;
 	m->last_query.tv_sec = 0;
 	m->last_query.tv_nsec = 0;
-
-	/* initialize GPIO pins for SPI operations */
-	bcm2835_spi_begin();
-
-	/* set SPI bit order to most significant bit first.
-	 * NOTE: This is the only mode the BCM2835 chip supports, fortunately so
-	 *       does the MAX31865.
-	 */
-	bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
-
-	/* set SPI to operate in mode 1 (clock polarity = 0, clock phase = 1) */
-	bcm2835_spi_setDataMode(BCM2835_SPI_MODE1);
-
-	/* set SPI clock frequency to 5 MHz (base clock is 250 MHz) */
-	bcm2835_spi_setClockDivider(50);
-	
-	/* set SPI chip select pin to be asserted on data transfer */
-	bcm2835_spi_chipSelect(cs_pin);
-
-	/* set SPI CS0 polarity to be active low (the default) */
-	bcm2835_spi_setChipSelectPolarity(m->cs_pin, LOW);
+	m->table = NULL;
+	m->drdy.fd = -1;
+	m->sample_callback = NULL;
+	m->sample_user_data = NULL;
+	atomic_init(&m->acquisition, MAX31865_ACQUISITION_POLL);
+	atomic_init(&m->stop_acquisition, 0);
+	atomic_flag_clear(&m->polling);
+	sample_ring_init(&m->ring);
+	atomic_init(&m->fault_cycle, MAX31865_FAULT_CYCLE_NONE);
+	atomic_init(&m->fault_interval_ms, 0);
+	atomic_init(&m->fault_suspected, 0);
+	atomic_init(&m->fault, 0);
+	m->last_fault_check.tv_sec = 0;
+	m->last_fault_check.tv_nsec = 0;
+	pthread_mutex_init(&m->snapshot_mtx, NULL);
+	memset(&m->snapshot, 0, sizeof(m->snapshot));
+
+	/* The MAX31865 operates in SPI mode 1 (clock polarity = 0, clock
+	 * phase = 1), at up to 5 MHz */
+	spi_device_init(&m->spi, cs_pin, HAL_SPI_MODE1, 5000000);
 
 	/* configure input detection on DRDY pin:
 	 *   - set drdy_pin as input
 	 *   - disable pull up/down resistors
 	 *   - enable low detect on DRDY pin
 	 */
-	bcm2835_gpio_fsel(m->drdy_pin, BCM2835_GPIO_FSEL_INPT);
-	bcm2835_gpio_set_pud(m->drdy_pin, BCM2835_GPIO_PUD_OFF);
-	bcm2835_gpio_len(m->drdy_pin);
+	hal_gpio_function(m->drdy_pin, HAL_GPIO_INPUT);
+	hal_gpio_pull(m->drdy_pin, HAL_GPIO_PULL_OFF);
+	hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 1);
 
 	m->initialized = 1;
 
-	int rc = max31865_set_configuration(
+	/* the config read back also caches the initial fault thresholds */
+	return max31865_set_configuration(
 	    m, MAX31865_VBIAS_ON, MAX31865_CONV_MODE_AUTO,
 	    MAX31865_ONE_SHOT_OFF, rtd_type, 0,
 	    MAX31865_FAULT_STATUS_AUTO_CLEAR, MAX31865_NOISE_FILTER_50HZ);
-	
-	/* read initial fault thresholds */
-	max31865_get_fault_thresholds(m, NULL, NULL);
-
-	return rc;
 }
 
 void max31865_cleanup(max31865_t *m)
@@ -160,6 +246,15 @@ void max31865_cleanup(max31865_t *m)
 	assert(m != NULL);
 	assert(m->initialized);
 
+	switch (atomic_load(&m->acquisition)) {
+	case MAX31865_ACQUISITION_THREAD:
+		max31865_stop_acquisition(m);
+		break;
+	case MAX31865_ACQUISITION_ONE_SHOT:
+		gpio_event_cleanup(&m->drdy);
+		break;
+	}
+
 	/* turn off automatic conversion */
 	max31865_set_configuration(
 	    m, MAX31865_VBIAS_OFF, MAX31865_CONV_MODE_NORMALLY_OFF,
@@ -167,20 +262,39 @@ void max31865_cleanup(max31865_t *m)
 	    MAX31865_FAULT_STATUS_AUTO_CLEAR, MAX31865_NOISE_FILTER_50HZ);
 
 	/* disable low detect enable */
-	bcm2835_gpio_clr_len(m->drdy_pin);
+	hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 0);
 
 	/* clear EDS flag */
-	bcm2835_gpio_set_eds(m->drdy_pin);
+	hal_gpio_clear_event_status(m->drdy_pin);
 
 	/* enable pull down resistor */
-	bcm2835_gpio_set_pud(m->drdy_pin, BCM2835_GPIO_PUD_DOWN);
+	hal_gpio_pull(m->drdy_pin, HAL_GPIO_PULL_DOWN);
 
-	/* return the GPIO SPI pins to their default setting */
-	bcm2835_spi_end();
+	spi_device_cleanup(&m->spi);
+	pthread_mutex_destroy(&m->snapshot_mtx);
 
 	m->initialized = 0;
 }
 
+/* Call callback (may be NULL) for every sample of this chip, in the thread
+ * that acquired it. Should be set before starting the acquisition. */
+void max31865_set_sample_callback(max31865_t *m, max31865_sample_fn callback,
+				  void *user_data)
+{
+	assert(m != NULL);
+
+	m->sample_callback = callback;
+	m->sample_user_data = user_data;
+}
+
+/* Convert readouts of this chip with the given RTD table instead of the
+ * process wide default table */
+void max31865_set_rtd_table(max31865_t *m, const rtd_table_t *table)
+{
+	assert(m != NULL);
+	m->table = table;
+}
+
 uint8_t max31865_get_configuration(max31865_t *m)
 {
 	assert(m != NULL);
@@ -220,7 +334,7 @@ int max31865_set_configuration(max31865_t *m, enum MAX31865_VBIAS vbias,
 	}
 
 	if (fault_detection_ctrl) {
-		config |= ((fault_detection_ctrl & 0x03) << 3);
+		config |= ((fault_detection_ctrl & 0x03) << 2);
 	}
 
 	if (rtd_type == MAX31865_3WIRE_RTD) {
@@ -247,16 +361,21 @@ int max31865_set_configuration(max31865_t *m, enum MAX31865_VBIAS vbias,
 		config |= 0x80;
 	}
 
-	write_register8(m, MAX31865_REGISTER_CONFIG, config);
-
 	/* Don't save fault status auto-clear and fault detection cycle control
 	 * bits, as the MAX31865 resets them to 0 after a fault detection cylce
 	 * or after clearing the fault status register */
 	m->config = config & ~(0x0E);
 
 	/* read the config register back to see if the chip accepted our
-	 * desired settings */
-	config = read_register8(m, MAX31865_REGISTER_CONFIG);
+	 * desired settings, refreshing the rest of the cached registers on
+	 * the way */
+	struct register_batch batch = { .n = 0 };
+	struct max31865_snapshot snapshot;
+	batch_write8(&batch, MAX31865_REGISTER_CONFIG, config);
+	const uint8_t *regs =
+	    batch_read(&batch, MAX31865_REGISTER_CONFIG, MAX31865_REGISTER_MAX);
+	transfer_snapshot(m, &batch, regs, &snapshot);
+	config = snapshot.config;
 	if (m->config != (config & (~0x0E))) {
 		write_register8(m, MAX31865_REGISTER_CONFIG, 0);
 		fprintf(stderr, "Couldn't read back config (0x%02X != 0x%02X)\n",
@@ -274,57 +393,413 @@ static uint32_t delta_t_ms(const struct timespec *start, const struct timespec *
 	assert(end != NULL);
 
 	return ((end->tv_sec - start->tv_sec) * 1000 +
-		(end->tv_nsec - start->tv_nsec) * 1000000);
+		(end->tv_nsec - start->tv_nsec) / 1000000);
 }
 
-pthread_mutex_t rtd_mtx = PTHREAD_MUTEX_INITIALIZER;
+static float convert(const max31865_t *m, const uint16_t rtd)
+{
+	if (m->table) {
+		return rtd_table_lookup(m->table, rtd);
+	}
+	return rtd_table_query(rtd);
+}
 
-uint16_t max31865_read_rtd(max31865_t *m, uint8_t *fault)
+/* Sequence number the next published sample gets, which identifies it in
+ * the trace */
+static uint32_t next_sequence(const max31865_t *m)
 {
-	assert(m != NULL);
-	assert(m->initialized);
+	const uint32_t sequence = sample_ring_head(&m->ring) + 1;
+	return sequence ? sequence : 1;
+}
+
+static uint16_t read_rtd_register(max31865_t *m, const enum TRACE_FLOW flow)
+{
+	const uint64_t start = trace_now();
+	const uint16_t rtd = read_register16(m, MAX31865_REGISTER_RTD_MSB);
+	trace_slice("spi read", start, next_sequence(m), flow);
+	return rtd;
+}
 
-	pthread_mutex_lock(&rtd_mtx);
+static void publish_sample(max31865_t *m, const uint16_t rtd,
+			   const struct timespec *timestamp)
+{
+	struct rtd_sample sample;
+	sample.timestamp = *timestamp;
+	sample.rtd = (rtd >> 1) & 0x7FFF;
+	sample.fault = rtd & 0x0001;
+
+	const uint64_t start = trace_now();
+	sample.temperature = convert(m, sample.rtd);
+	trace_slice("rtd lookup", start, next_sequence(m), TRACE_FLOW_STEP);
+	sample.sequence = sample_ring_push(&m->ring, &sample);
+
+	/* the fault bit only tells that some fault status bit is set, the
+	 * next fault detection cycle confirms and decodes it */
+	if (sample.fault) {
+		atomic_store(&m->fault_suspected, 1);
+	}
+
+	if (m->sample_callback) {
+		m->sample_callback(&sample, m->sample_user_data);
+	}
+}
+
+/* Read a new conversion result from the chip if one is available, used when
+ * there is no acquisition thread */
+static void poll_rtd(max31865_t *m)
+{
+	struct timespec now;
 
-	/* check if DRDY signaled new temperature readout */
 	if (!m->query_mode) {
-		if (bcm2835_gpio_eds(m->drdy_pin)) {
-			m->rtd = read_register16(m, MAX31865_REGISTER_RTD_MSB);
-			if (fault) {
-				*fault = m->rtd & 0x0001;
-			}
-			m->rtd >>= 1;
-			bcm2835_gpio_set_eds(m->drdy_pin);
+		/* check if DRDY signaled new temperature readout */
+		if (hal_gpio_event_status(m->drdy_pin)) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			publish_sample(
+			    m, read_rtd_register(m, TRACE_FLOW_START), &now);
+			hal_gpio_clear_event_status(m->drdy_pin);
 		}
 	} else {
-		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		if (delta_t_ms(&m->last_query, &now) >= 50) {
 			/* The MAX31865 takes about 20ms per conversion,
 			 * so we need to only query the chip if a new
 			 * measurement is available
 			 */
-			uint16_t rtd = read_register16(m, MAX31865_REGISTER_RTD_MSB);
-			if (fault) {
-				*fault = rtd & 0x0001;
-			}
-			m->rtd = (rtd >> 1) & 0x7FFF;
+			publish_sample(
+			    m, read_rtd_register(m, TRACE_FLOW_START), &now);
 			m->last_query = now;
-		} else if (fault) {
-			*fault = 0;
 		}
 	}
+}
+
+/* Return the latest RTD value. Without an acquisition thread the caller
+ * polls the chip, unless another thread is already doing so, in which case
+ * it returns the latest sample instead of waiting for the SPI transfer. */
+uint16_t max31865_read_rtd(max31865_t *m, uint8_t *fault)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+
+	if (atomic_load(&m->acquisition) == MAX31865_ACQUISITION_POLL &&
+	    !atomic_flag_test_and_set(&m->polling)) {
+		/* the acquisition may have started in the meantime, see
+		 * stop_polling() */
+		if (atomic_load(&m->acquisition) ==
+		    MAX31865_ACQUISITION_POLL) {
+			poll_rtd(m);
+		}
+		atomic_flag_clear(&m->polling);
+	}
+
+	struct rtd_sample sample;
+	if (!sample_ring_latest(&m->ring, &sample)) {
+		sample.rtd = 0;
+		sample.fault = 0;
+	}
+
+	if (fault) {
+		*fault = sample.fault;
+	}
+	return sample.rtd;
+}
+
+/* Kernels before 5.7 report line events in CLOCK_REALTIME. Fall back to the
+ * wakeup time if the event timestamp is obviously on another clock. */
+static void sample_timestamp(const struct timespec *event,
+			     struct timespec *timestamp)
+{
+	clock_gettime(CLOCK_MONOTONIC, timestamp);
+	const time_t age = timestamp->tv_sec - event->tv_sec;
+	if (age >= 0 && age < 2) {
+		*timestamp = *event;
+	}
+}
+
+static int run_fault_detection(max31865_t *m,
+			       const struct timespec *deadline);
+
+/* Reading the conversion result that pulled DRDY low also releases DRDY
+ * until the next conversion completes */
+static void *acquisition_thread(void *user_data)
+{
+	max31865_t *m = (max31865_t *)user_data;
+	struct timespec event, timestamp;
+
+	trace_thread_name("max31865");
+	while (!atomic_load(&m->stop_acquisition)) {
+		/* Conversions complete every 17-20ms in automatic mode, so a
+		 * timeout means an edge was lost, e.g. because DRDY was
+		 * already low when the thread started. Reading the RTD
+		 * register re-arms DRDY. */
+		int rc = gpio_event_wait(&m->drdy, 100, NULL, &event);
+		if (rc == 1) {
+			sample_timestamp(&event, &timestamp);
+		} else if (rc == 0) {
+			if (gpio_event_get_value(&m->drdy) != 0) {
+				continue;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &timestamp);
+		} else {
+			fprintf(stderr, "max31865: failed to wait for DRDY\n");
+			break;
+		}
+
+		/* from the DRDY edge until the thread got to read it */
+		trace_slice("drdy", trace_timestamp(&timestamp),
+			    next_sequence(m), TRACE_FLOW_START);
+		publish_sample(m, read_rtd_register(m, TRACE_FLOW_STEP),
+			       &timestamp);
+
+		/* the next conversion is at least 16ms away and nobody waits
+		 * for this thread, there is no deadline to miss */
+		run_fault_detection(m, NULL);
+	}
+	return NULL;
+}
+
+/* The ring has a single producer: stop new pollers, then wait for a poll
+ * that is already running to finish */
+static void stop_polling(max31865_t *m, const enum MAX31865_ACQUISITION mode)
+{
+	atomic_store(&m->acquisition, mode);
+	while (atomic_flag_test_and_set(&m->polling)) {
+		sched_yield();
+	}
+	atomic_flag_clear(&m->polling);
+}
+
+/* Start a thread that reads every conversion as soon as the MAX31865 pulls
+ * DRDY low. The callback (may be NULL) runs on the acquisition thread for
+ * each sample. While the acquisition runs, max31865_read_rtd() and
+ * max31865_get_temperature() return the latest sample without accessing the
+ * chip. */
+int max31865_start_acquisition(max31865_t *m, max31865_sample_fn callback,
+			       void *user_data)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+	assert(atomic_load(&m->acquisition) == MAX31865_ACQUISITION_POLL);
+
+	/* the kernel owns the edge detection of the line from now on, a
+	 * pending low level detect would keep its interrupt firing */
+	hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 0);
+	hal_gpio_clear_event_status(m->drdy_pin);
+
+	if (gpio_event_init(&m->drdy, GPIO_EVENT_CHIP, m->drdy_pin,
+			    GPIO_EVENT_FALLING_EDGE, "max31865-drdy") == -1) {
+		hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 1);
+		return -1;
+	}
+
+	m->sample_callback = callback;
+	m->sample_user_data = user_data;
+	atomic_store(&m->stop_acquisition, 0);
+
+	stop_polling(m, MAX31865_ACQUISITION_THREAD);
+
+	int rc = pthread_create(&m->acquisition_thread, NULL,
+				&acquisition_thread, m);
+	if (rc != 0) {
+		atomic_store(&m->acquisition, MAX31865_ACQUISITION_POLL);
+		gpio_event_cleanup(&m->drdy);
+		hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 1);
+		errno = rc;
+		return -1;
+	}
+	return 0;
+}
+
+void max31865_stop_acquisition(max31865_t *m)
+{
+	assert(m != NULL);
+	assert(atomic_load(&m->acquisition) == MAX31865_ACQUISITION_THREAD);
+
+	atomic_store(&m->stop_acquisition, 1);
+	pthread_join(m->acquisition_thread, NULL);
+	gpio_event_cleanup(&m->drdy);
+
+	/* go back to polling the event detect status */
+	hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 1);
+	atomic_store(&m->acquisition, MAX31865_ACQUISITION_POLL);
+}
+
+/* Copy the latest sample. Returns 0 if no sample was acquired yet, 1
+ * otherwise. Callers can compare sample->sequence to tell whether a new
+ * sample arrived since their last call. Never blocks. */
+int max31865_get_sample(const max31865_t *m, struct rtd_sample *sample)
+{
+	assert(m != NULL);
+	assert(sample != NULL);
+
+	return sample_ring_latest(&m->ring, sample);
+}
+
+/* Copy up to count of the most recent samples in chronological order and
+ * return how many were copied. Never blocks. */
+size_t max31865_get_samples(const max31865_t *m, struct rtd_sample *samples,
+			    const size_t count)
+{
+	assert(m != NULL);
+
+	return sample_ring_window(&m->ring, samples, count);
+}
+
+/* Stop automatic conversions and turn off the bias voltage between
+ * conversions, which are then triggered by max31865_read_one_shot(). This
+ * keeps the RTD from self-heating and avoids reading samples nobody uses. */
+int max31865_enable_one_shot(max31865_t *m)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+	assert(atomic_load(&m->acquisition) == MAX31865_ACQUISITION_POLL);
+
+	const enum MAX31865_NOISE_FILTER_HZ filter = m->config & 0x01;
+	if (max31865_set_configuration(
+		m, MAX31865_VBIAS_OFF, MAX31865_CONV_MODE_NORMALLY_OFF,
+		MAX31865_ONE_SHOT_OFF, m->rtd_type, 0,
+		MAX31865_FAULT_STATUS_AUTO_CLEAR, filter) == -1) {
+		return -1;
+	}
+
+	/* wait for DRDY with line events if possible, otherwise fall back to
+	 * polling the low level detect status */
+	hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 0);
+	if (gpio_event_init(&m->drdy, GPIO_EVENT_CHIP, m->drdy_pin,
+			    GPIO_EVENT_FALLING_EDGE, "max31865-drdy") == -1) {
+		hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 1);
+	}
+	hal_gpio_clear_event_status(m->drdy_pin);
+
+	stop_polling(m, MAX31865_ACQUISITION_ONE_SHOT);
+	return 0;
+}
+
+/* Go back to automatic conversions */
+int max31865_disable_one_shot(max31865_t *m)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+	assert(atomic_load(&m->acquisition) == MAX31865_ACQUISITION_ONE_SHOT);
+
+	if (m->drdy.fd != -1) {
+		gpio_event_cleanup(&m->drdy);
+		hal_gpio_detect(m->drdy_pin, HAL_GPIO_DETECT_LOW, 1);
+	}
+	hal_gpio_clear_event_status(m->drdy_pin);
+	atomic_store(&m->acquisition, MAX31865_ACQUISITION_POLL);
+
+	const enum MAX31865_NOISE_FILTER_HZ filter = m->config & 0x01;
+	return max31865_set_configuration(
+	    m, MAX31865_VBIAS_ON, MAX31865_CONV_MODE_AUTO,
+	    MAX31865_ONE_SHOT_OFF, m->rtd_type, 0,
+	    MAX31865_FAULT_STATUS_AUTO_CLEAR, filter);
+}
+
+/* Time from calling max31865_read_one_shot() until the sample is available:
+ * bias settling plus a single conversion (62.5ms with the 50Hz filter,
+ * 52ms with the 60Hz filter). A control loop that needs a sample at time t
+ * should trigger the conversion at t - lead. */
+uint32_t max31865_get_one_shot_lead_us(const max31865_t *m)
+{
+	assert(m != NULL);
+
+	return MAX31865_BIAS_SETTLE_US + ((m->config & 0x01) ? 62500 : 52000);
+}
+
+static int wait_drdy(max31865_t *m, struct timespec *timestamp)
+{
+	struct timespec event;
+
+	if (m->drdy.fd != -1) {
+		if (gpio_event_wait(&m->drdy,
+				    MAX31865_BIAS_SETTLE_US / 1000 + 100, NULL,
+				    &event) != 1) {
+			return -1;
+		}
+		sample_timestamp(&event, timestamp);
+		return 0;
+	}
+
+	unsigned int i;
+	for (i = 0; i < 200; ++i) {
+		if (hal_gpio_event_status(m->drdy_pin)) {
+			hal_gpio_clear_event_status(m->drdy_pin);
+			clock_gettime(CLOCK_MONOTONIC, timestamp);
+			return 0;
+		}
+		hal_delay_us(500);
+	}
+	return -1;
+}
+
+/* Turn on the bias voltage, let it settle, run a single conversion and read
+ * it as soon as DRDY signals the result. The sample is published like any
+ * other and copied to sample if that isn't NULL. Blocks for about
+ * max31865_get_one_shot_lead_us(). Returns -1 with errno set to ETIMEDOUT if
+ * the conversion didn't complete. */
+int max31865_read_one_shot(max31865_t *m, struct rtd_sample *sample)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+	assert(atomic_load(&m->acquisition) == MAX31865_ACQUISITION_ONE_SHOT);
+
+	/* drop edges of an earlier conversion that timed out */
+	struct timespec timestamp;
+	if (m->drdy.fd != -1) {
+		while (gpio_event_wait(&m->drdy, 0, NULL, &timestamp) == 1) {
+		}
+	} else {
+		hal_gpio_clear_event_status(m->drdy_pin);
+	}
 
-	pthread_mutex_unlock(&rtd_mtx);
+	/* the configuration register is written directly, the 1-shot bit
+	 * clears itself and can't be verified by reading it back */
+	write_register8(m, MAX31865_REGISTER_CONFIG, m->config | 0x80);
+	hal_delay_us(MAX31865_BIAS_SETTLE_US);
+	write_register8(m, MAX31865_REGISTER_CONFIG, m->config | 0xA0);
+
+	/* read the result and turn the bias voltage off again in one go */
+	int rc = wait_drdy(m, &timestamp);
+	struct register_batch batch = { .n = 0 };
+	const uint8_t *rtd = NULL;
+	if (rc == 0) {
+		trace_slice("drdy", trace_timestamp(&timestamp),
+			    next_sequence(m), TRACE_FLOW_START);
+		rtd = batch_read(&batch, MAX31865_REGISTER_RTD_MSB, 2);
+	}
+	batch_write8(&batch, MAX31865_REGISTER_CONFIG, m->config);
+	const uint64_t start = trace_now();
+	batch_transfer(m, &batch);
+	if (rtd) {
+		trace_slice("spi read", start, next_sequence(m),
+			    TRACE_FLOW_STEP);
+		publish_sample(m, ((uint16_t)rtd[0] << 8) | rtd[1], &timestamp);
+	}
 
-	return m->rtd;
+	if (rc == -1) {
+		fprintf(stderr, "max31865: one-shot conversion timed out\n");
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	if (sample) {
+		sample_ring_latest(&m->ring, sample);
+	}
+	return 0;
 }
 
 float max31865_get_temperature(max31865_t *m, uint8_t *fault)
 {
 	assert(m != NULL);
 	assert(m->initialized);
-	return rtd_table_query(max31865_read_rtd(m, fault));
+
+	max31865_read_rtd(m, fault);
+
+	/* the sample was converted when it was acquired */
+	struct rtd_sample sample;
+	if (sample_ring_latest(&m->ring, &sample)) {
+		return sample.temperature;
+	}
+	return convert(m, 0);
 }
 
 float max31865_convert_rtd_to_temperature(const uint16_t rtd)
@@ -337,10 +812,8 @@ void max31865_get_fault_thresholds(max31865_t *m, uint16_t *high, uint16_t *low)
 	assert(m != NULL);
 	assert(m->initialized);
 
-	uint32_t value = read_register32(m, MAX31865_REGISTER_FAULT_HT_MSB);
-	m->fault_ht = (value & 0xFFFF0000) >> 16;
-	m->fault_lt = (value & 0x0000FFFF);
-
+	/* the thresholds only change through max31865_set_fault_thresholds()
+	 * and were read with the last snapshot, no need to ask the chip */
 	if (high && high != &m->fault_ht) {
 		*high = m->fault_ht;
 	}
@@ -385,5 +858,226 @@ uint8_t max31865_get_fault_status(max31865_t *m)
 	assert(m != NULL);
 	assert(m->initialized);
 
-	return read_register8(m, MAX31865_REGISTER_FAULT_STATUS);
+	struct max31865_snapshot snapshot;
+	read_snapshot(m, &snapshot);
+	return snapshot.fault_status;
+}
+
+/* Check every interval_ms (0 only checks after a sample had its fault bit
+ * set) whether the RTD wiring is broken, using the given fault detection
+ * cycle. The automatic cycle assumes the RTD input filter settles within
+ * 100us, larger filter capacitors need the manual cycle, which waits
+ * MAX31865_BIAS_SETTLE_US for each of its two steps. The acquisition
+ * thread runs the cycles by itself, otherwise the thread that triggers the
+ * conversions calls max31865_run_fault_detection(). */
+void max31865_set_fault_detection(max31865_t *m,
+				  const enum MAX31865_FAULT_CYCLE cycle,
+				  const uint32_t interval_ms)
+{
+	assert(m != NULL);
+	assert(cycle != MAX31865_FAULT_CYCLE_MANUAL_2);
+
+	atomic_store(&m->fault_interval_ms, interval_ms);
+	atomic_store(&m->fault_cycle, cycle);
+}
+
+static uint32_t fault_cycle_us(const enum MAX31865_FAULT_CYCLE cycle)
+{
+	if (cycle == MAX31865_FAULT_CYCLE_AUTO) {
+		return MAX31865_FAULT_CYCLE_AUTO_US;
+	}
+	return 2 * MAX31865_BIAS_SETTLE_US + MAX31865_FAULT_CYCLE_AUTO_US;
+}
+
+/* The chip resets the cycle control bits D3:D2 when the cycle is done */
+static int wait_fault_cycle(const max31865_t *m)
+{
+	unsigned int i;
+	for (i = 0; i < 50; ++i) {
+		if (!(read_register8(m, MAX31865_REGISTER_CONFIG) & 0x0C)) {
+			return 0;
+		}
+		hal_delay_us(100);
+	}
+	return -1;
+}
+
+/* Each step is a separate SPI transfer, the bus is free for other chips
+ * while the cycle runs */
+static int run_fault_cycle(max31865_t *m,
+			   const enum MAX31865_FAULT_CYCLE cycle,
+			   uint8_t *status)
+{
+	struct register_batch batch = { .n = 0 };
+	struct max31865_snapshot snapshot;
+
+	/* The threshold faults are latched by the conversions, the cycle
+	 * itself only checks the voltages on the RTD inputs. The cycle runs
+	 * with the bias voltage on and conversions off, the fault status can
+	 * only be cleared with D5, D3 and D2 at 0. */
+	const uint8_t config = (m->config & ~0x60) | 0x80;
+	const uint8_t *regs =
+	    batch_read(&batch, MAX31865_REGISTER_CONFIG, MAX31865_REGISTER_MAX);
+	batch_write8(&batch, MAX31865_REGISTER_CONFIG, config | 0x02);
+	if (cycle == MAX31865_FAULT_CYCLE_AUTO) {
+		batch_write8(&batch, MAX31865_REGISTER_CONFIG, config | 0x04);
+	} else {
+		batch_write8(&batch, MAX31865_REGISTER_CONFIG, config | 0x08);
+	}
+	transfer_snapshot(m, &batch, regs, &snapshot);
+	const uint8_t latched =
+	    snapshot.fault_status &
+	    (MAX31865_FAULT_RTD_HIGH | MAX31865_FAULT_RTD_LOW);
+
+	int rc;
+	if (cycle == MAX31865_FAULT_CYCLE_AUTO) {
+		rc = wait_fault_cycle(m);
+	} else {
+		hal_delay_us(MAX31865_BIAS_SETTLE_US);
+		write_register8(m, MAX31865_REGISTER_CONFIG, config | 0x0C);
+		hal_delay_us(MAX31865_BIAS_SETTLE_US);
+		rc = wait_fault_cycle(m);
+	}
+
+	batch.n = 0;
+	regs =
+	    batch_read(&batch, MAX31865_REGISTER_CONFIG, MAX31865_REGISTER_MAX);
+	batch_write8(&batch, MAX31865_REGISTER_CONFIG, m->config);
+	transfer_snapshot(m, &batch, regs, &snapshot);
+
+	if (rc == -1) {
+		fprintf(stderr, "max31865: fault detection cycle timed out\n");
+		errno = ETIMEDOUT;
+		return -1;
+	}
+	*status = latched | (snapshot.fault_status & MAX31865_FAULT_MASK);
+	return 0;
+}
+
+static int run_fault_detection(max31865_t *m,
+			       const struct timespec *deadline)
+{
+	const enum MAX31865_FAULT_CYCLE cycle = atomic_load(&m->fault_cycle);
+	if (cycle == MAX31865_FAULT_CYCLE_NONE) {
+		return 0;
+	}
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	const uint32_t interval_ms = atomic_load(&m->fault_interval_ms);
+	if (!atomic_load(&m->fault_suspected) &&
+	    (!interval_ms ||
+	     delta_t_ms(&m->last_fault_check, &now) < interval_ms)) {
+		return 0;
+	}
+
+	/* postpone the cycle rather than delaying the next conversion */
+	if (deadline) {
+		const int64_t remaining_us =
+		    (deadline->tv_sec - now.tv_sec) * 1000000LL +
+		    (deadline->tv_nsec - now.tv_nsec) / 1000;
+		if (remaining_us < fault_cycle_us(cycle)) {
+			return 0;
+		}
+	}
+
+	uint8_t status;
+	m->last_fault_check = now;
+	atomic_store(&m->fault_suspected, 0);
+	if (run_fault_cycle(m, cycle, &status) == -1) {
+		return -1;
+	}
+
+	const uint8_t previous = atomic_exchange(&m->fault, status);
+	if (status != previous) {
+		char description[128];
+		max31865_format_fault(status, description,
+				      sizeof(description));
+		fprintf(stderr, "max31865: fault status 0x%02X (%s)\n",
+			(unsigned int)status, description);
+	}
+	return 1;
+}
+
+/* Run the fault detection cycle if it is due and finishes before deadline
+ * (may be NULL), otherwise it is postponed to the next call. Must be called
+ * from the thread that triggers the conversions, between two conversions.
+ * Returns 1 if the cycle ran, 0 if it didn't and -1 with errno set to
+ * ETIMEDOUT if the chip didn't finish the cycle. */
+int max31865_run_fault_detection(max31865_t *m,
+				 const struct timespec *deadline)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+	assert(atomic_load(&m->acquisition) != MAX31865_ACQUISITION_THREAD);
+
+	return run_fault_detection(m, deadline);
+}
+
+/* Fault status bits confirmed by the last fault detection cycle, 0 if the
+ * RTD is fine. Never blocks. */
+uint8_t max31865_get_fault(const max31865_t *m)
+{
+	assert(m != NULL);
+
+	return atomic_load(&m->fault);
+}
+
+/* Describe the fault status bits in buffer, returns the length of the
+ * description like snprintf() */
+size_t max31865_format_fault(const uint8_t status, char *buffer,
+			     const size_t size)
+{
+	static const struct {
+		uint8_t bit;
+		const char *description;
+	} FAULTS[] = {
+	    { MAX31865_FAULT_RTD_HIGH, "RTD above high threshold" },
+	    { MAX31865_FAULT_RTD_LOW, "RTD below low threshold" },
+	    { MAX31865_FAULT_REFIN_HIGH, "REFIN- > 0.85 x VBIAS" },
+	    { MAX31865_FAULT_REFIN_LOW, "REFIN- < 0.85 x VBIAS, FORCE- open" },
+	    { MAX31865_FAULT_RTDIN_LOW, "RTDIN- < 0.85 x VBIAS, FORCE- open" },
+	    { MAX31865_FAULT_VOLTAGE, "overvoltage or undervoltage" },
+	};
+
+	assert(buffer != NULL);
+	assert(size > 0);
+
+	size_t length = 0;
+	unsigned int i;
+	for (i = 0; i < sizeof(FAULTS) / sizeof(FAULTS[0]); ++i) {
+		if (!(status & FAULTS[i].bit)) {
+			continue;
+		}
+		const size_t offset = length < size ? length : size - 1;
+		length += snprintf(buffer + offset, size - offset, "%s%s",
+				   length ? ", " : "", FAULTS[i].description);
+	}
+	if (!length) {
+		length = snprintf(buffer, size, "no fault");
+	}
+	return length;
+}
+
+/* Read config, RTD, fault thresholds and fault status in one SPI transfer
+ * and cache them. snapshot may be NULL to only refresh the cache. */
+void max31865_read_snapshot(max31865_t *m, struct max31865_snapshot *snapshot)
+{
+	assert(m != NULL);
+	assert(m->initialized);
+
+	read_snapshot(m, snapshot);
+}
+
+/* Copy the registers cached by the last snapshot without accessing the
+ * chip, for diagnostics that don't need to be up to date */
+void max31865_get_snapshot(max31865_t *m, struct max31865_snapshot *snapshot)
+{
+	assert(m != NULL);
+	assert(snapshot != NULL);
+
+	pthread_mutex_lock(&m->snapshot_mtx);
+	*snapshot = m->snapshot;
+	pthread_mutex_unlock(&m->snapshot_mtx);
 }
@@ -20,9 +20,18 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef SOUSVIDED_MAX31865
 #define SOUSVIDED_MAX31865
 
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <time.h>
 
+#include <pthread.h>
+
+#include "gpio_event.h"
+#include "rtd_table.h"
+#include "sample_ring.h"
+#include "spi_bus.h"
+
 enum MAX31865_REGISTER {
 	MAX31865_REGISTER_CONFIG = 0x00,
 	MAX31865_REGISTER_RTD_MSB = 0x01,
@@ -59,9 +68,61 @@ enum MAX31865_NOISE_FILTER_HZ {
 	MAX31865_NOISE_FILTER_60HZ = 1
 };
 
+/* How conversion results get from the chip into the sample ring */
+enum MAX31865_ACQUISITION {
+	MAX31865_ACQUISITION_POLL = 0, /* readers poll DRDY */
+	MAX31865_ACQUISITION_THREAD,   /* automatic conversion, DRDY events */
+	MAX31865_ACQUISITION_ONE_SHOT  /* conversions triggered on demand */
+};
+
+/* Time for the bias voltage to settle before a one-shot conversion, 10.5
+ * time constants of the RTD input filter plus 1ms according to the data
+ * sheet. 5ms covers the recommended 100nF filter with up to a 4k
+ * reference resistor. */
+#ifndef MAX31865_BIAS_SETTLE_US
+#define MAX31865_BIAS_SETTLE_US 5000
+#endif
+
+/* Duration of the automatic fault detection cycle, about 550us according to
+ * the data sheet plus the SPI transfers that start it and read the result */
+#ifndef MAX31865_FAULT_CYCLE_AUTO_US
+#define MAX31865_FAULT_CYCLE_AUTO_US 1000
+#endif
+
 #define MAX31865_FAULT_STATUS_NO_CLEAR 0
 #define MAX31865_FAULT_STATUS_AUTO_CLEAR 1
 
+/* Fault detection cycle control bits D3:D2 of the config register */
+enum MAX31865_FAULT_CYCLE {
+	MAX31865_FAULT_CYCLE_NONE = 0,
+	MAX31865_FAULT_CYCLE_AUTO = 1,
+	MAX31865_FAULT_CYCLE_MANUAL_1 = 2,
+	MAX31865_FAULT_CYCLE_MANUAL_2 = 3
+};
+
+/* Fault status register bits */
+#define MAX31865_FAULT_RTD_HIGH 0x80   /* RTD above high threshold */
+#define MAX31865_FAULT_RTD_LOW 0x40    /* RTD below low threshold */
+#define MAX31865_FAULT_REFIN_HIGH 0x20 /* REFIN- > 0.85 x VBIAS */
+#define MAX31865_FAULT_REFIN_LOW 0x10  /* REFIN- < 0.85 x VBIAS, FORCE- open */
+#define MAX31865_FAULT_RTDIN_LOW 0x08  /* RTDIN- < 0.85 x VBIAS, FORCE- open */
+#define MAX31865_FAULT_VOLTAGE 0x04    /* overvoltage or undervoltage */
+#define MAX31865_FAULT_MASK 0xFC
+
+/* Register file of the chip, read in a single SPI transfer */
+struct max31865_snapshot
+{
+	struct timespec timestamp;
+	uint8_t config;
+	uint16_t rtd;
+	uint8_t rtd_fault;
+	uint16_t fault_ht;
+	uint16_t fault_lt;
+	uint8_t fault_status;
+};
+
+typedef void (*max31865_sample_fn)(const struct rtd_sample *, void *);
+
 struct max31865
 {
 	uint8_t initialized;
@@ -70,10 +131,32 @@ struct max31865
 	uint8_t config;
 	uint8_t cs_pin;
 	uint8_t drdy_pin;
-	uint16_t rtd;
 	uint16_t fault_ht;
 	uint16_t fault_lt;
 	struct timespec last_query;
+	const rtd_table_t *table;
+
+	spi_device_t spi;
+	pthread_mutex_t snapshot_mtx;
+	struct max31865_snapshot snapshot; /* protected by snapshot_mtx */
+
+	/* event driven and one-shot acquisition */
+	atomic_int acquisition;
+	atomic_flag polling;
+	atomic_int stop_acquisition;
+	gpio_event_t drdy;
+	pthread_t acquisition_thread;
+	max31865_sample_fn sample_callback;
+	void *sample_user_data;
+
+	sample_ring_t ring;
+
+	/* fault detection, see max31865_set_fault_detection() */
+	atomic_int fault_cycle;
+	atomic_uint fault_interval_ms;
+	atomic_int fault_suspected;
+	atomic_uint fault;
+	struct timespec last_fault_check; /* owned by the sample producer */
 };
 typedef struct max31865 max31865_t;
 
@@ -81,6 +164,22 @@ int max31865_init(max31865_t *m, const uint8_t cs_pin, const uint8_t drdy_pin,
 		  const uint8_t rtd_type);
 void max31865_cleanup(max31865_t *m);
 
+void max31865_set_rtd_table(max31865_t *m, const rtd_table_t *table);
+void max31865_set_sample_callback(max31865_t *m, max31865_sample_fn callback,
+				  void *user_data);
+
+int max31865_start_acquisition(max31865_t *m, max31865_sample_fn callback,
+			       void *user_data);
+void max31865_stop_acquisition(max31865_t *m);
+int max31865_get_sample(const max31865_t *m, struct rtd_sample *sample);
+size_t max31865_get_samples(const max31865_t *m, struct rtd_sample *samples,
+			    const size_t count);
+
+int max31865_enable_one_shot(max31865_t *m);
+int max31865_disable_one_shot(max31865_t *m);
+uint32_t max31865_get_one_shot_lead_us(const max31865_t *m);
+int max31865_read_one_shot(max31865_t *m, struct rtd_sample *sample);
+
 uint8_t max31865_get_configuration(max31865_t *m);
 uint8_t max31865_read_configuration(max31865_t *m);
 int max31865_set_configuration(max31865_t *m, enum MAX31865_VBIAS vbias,
@@ -104,4 +203,16 @@ void max31865_set_fault_low_threshold(max31865_t *m, const uint16_t low);
 
 uint8_t max31865_get_fault_status(max31865_t *m);
 
+void max31865_set_fault_detection(max31865_t *m,
+				  const enum MAX31865_FAULT_CYCLE cycle,
+				  const uint32_t interval_ms);
+int max31865_run_fault_detection(max31865_t *m,
+				 const struct timespec *deadline);
+uint8_t max31865_get_fault(const max31865_t *m);
+size_t max31865_format_fault(const uint8_t status, char *buffer,
+			     const size_t size);
+
+void max31865_read_snapshot(max31865_t *m, struct max31865_snapshot *snapshot);
+void max31865_get_snapshot(max31865_t *m, struct max31865_snapshot *snapshot);
+
 #endif /* SOUSVIDED_MAX31865 */
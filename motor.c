@@ -22,9 +22,9 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <assert.h>
 #include <stddef.h>
 
-#include "bcm2835.h"
+#include "hal.h"
 
-#define MOTOR_PWM_PIN RPI_V2_GPIO_P1_12
+#define MOTOR_PWM_PIN 18 /* P1-12 */
 #define MOTOR_PWM_CHANNEL 0
 #define MOTOR_MARKSPACE_MODE 1
 
@@ -42,26 +42,25 @@ void motor_init(motor_t *m, const uint32_t pwm_clock_divider,
 	m->status = MOTOR_STATUS_OFF;
 
 	/* set alternate function 5 for pin to provide PWM output */
-	bcm2835_gpio_fsel(MOTOR_PWM_PIN, BCM2835_GPIO_FSEL_ALT5);
+	hal_gpio_function(MOTOR_PWM_PIN, HAL_GPIO_PWM);
 
 	/* set PWM clock divider to select PWM frequency (base clock is
 	 * 19.2 MHz) */
-	bcm2835_pwm_set_clock(m->pwm_clock_divider);
+	hal_pwm_clock(m->pwm_clock_divider);
 
 	/* set MARKSPACE mode and provide no PWM output */
-	bcm2835_pwm_set_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE,
-				m->status);
-	bcm2835_delay(10);
+	hal_pwm_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE, m->status);
+	hal_delay_us(10000);
 
 	/* set duty cycle range */
-	bcm2835_pwm_set_range(MOTOR_PWM_CHANNEL, m->duty_cycle_range);
+	hal_pwm_range(MOTOR_PWM_CHANNEL, m->duty_cycle_range);
 
 	/* PWM is off, but still set the current duty cycle to zero */
-	bcm2835_pwm_set_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
+	hal_pwm_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
 
 	m->initialized = 1;
 
-	bcm2835_delay(10);
+	hal_delay_us(10000);
 }
 
 void motor_cleanup(motor_t *m)
@@ -70,16 +69,16 @@ void motor_cleanup(motor_t *m)
 	assert(m->initialized);
 
 	/* set duty cycle to 0 to stop motor */
-	bcm2835_pwm_set_data(MOTOR_PWM_CHANNEL, 0);
+	hal_pwm_data(MOTOR_PWM_CHANNEL, 0);
 
 	/* disable PWM if it is currently active */
 	if (m->status == MOTOR_STATUS_ON) {
-		bcm2835_pwm_set_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE, 0);
+		hal_pwm_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE, 0);
 		m->status = MOTOR_STATUS_OFF;
 	}
 
 	/* return GPIO pin to input state */
-	bcm2835_gpio_fsel(MOTOR_PWM_PIN, BCM2835_GPIO_FSEL_INPT);
+	hal_gpio_function(MOTOR_PWM_PIN, HAL_GPIO_INPUT);
 
 	m->duty_cycle = 0;
 	m->duty_cycle_range = 0;
@@ -97,7 +96,7 @@ void motor_set_duty_cycle(motor_t *m, const uint32_t duty_cycle)
 	}
 
 	if (m->status == MOTOR_STATUS_ON) {
-		bcm2835_pwm_set_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
+		hal_pwm_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
 	}
 }
 
@@ -114,12 +113,12 @@ void motor_set_duty_cycle_range(motor_t *m, const uint32_t duty_cycle_range)
 	if (m->status == MOTOR_STATUS_ON) {
 		if (m->duty_cycle > duty_cycle_range) {
 			/* update duty cycle first, then set new range */
-			bcm2835_pwm_set_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
-			bcm2835_pwm_set_range(MOTOR_PWM_CHANNEL, m->duty_cycle_range);
+			hal_pwm_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
+			hal_pwm_range(MOTOR_PWM_CHANNEL, m->duty_cycle_range);
 		} else {
 			/* set new range first, then update duty cycle */
-			bcm2835_pwm_set_range(MOTOR_PWM_CHANNEL, m->duty_cycle_range);
-			bcm2835_pwm_set_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
+			hal_pwm_range(MOTOR_PWM_CHANNEL, m->duty_cycle_range);
+			hal_pwm_data(MOTOR_PWM_CHANNEL, m->duty_cycle);
 		}
 	}
 }
@@ -163,9 +162,9 @@ void motor_start(motor_t *m)
 
 	if (m->status == MOTOR_STATUS_OFF) {
 		m->status = MOTOR_STATUS_ON;
-		bcm2835_pwm_set_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE,
-					m->status);
-		bcm2835_delay(10);
+		hal_pwm_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE,
+			     m->status);
+		hal_delay_us(10000);
 	}
 }
 
@@ -176,8 +175,8 @@ void motor_stop(motor_t *m)
 
 	if (m->status == MOTOR_STATUS_ON) {
 		m->status = MOTOR_STATUS_OFF;
-		bcm2835_pwm_set_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE,
-				     m->status);
-		bcm2835_delay(10);
+		hal_pwm_mode(MOTOR_PWM_CHANNEL, MOTOR_MARKSPACE_MODE,
+			     m->status);
+		hal_delay_us(10000);
 	}
 }
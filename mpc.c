@@ -0,0 +1,331 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "mpc.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "latency.h"
+
+/* First period of each block the outputs are held for, the last block
+ * lasts until the end of the horizon */
+static const unsigned int BLOCK_START[MPC_MOVES] = { 0, 2, 10, 40 };
+
+/* Weight of the squared output moves (as a share of output_max) against
+ * the squared temperature errors in K, summed over the horizon */
+#define MPC_DEFAULT_MOVE_WEIGHT 10.0
+
+/* Sweeps of the coordinate descent solver, it starts from the previous
+ * solution and converges in a few */
+#define MPC_ITERATIONS 20
+
+/* Share of the one step prediction error that goes into the disturbance
+ * estimate each period */
+#define MPC_DISTURBANCE_GAIN 0.02
+
+static double clamp(const double v, const double min, const double max)
+{
+	return v < min ? min : (v > max ? max : v);
+}
+
+static double delta_t_s(const struct timespec *start,
+			const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) * 1.0E-9;
+}
+
+/* Output of the period n periods back, 1 for the last one */
+static double past_output(const mpc_t *m, const unsigned int n)
+{
+	assert(n > 0 && n <= MPC_MAX_DELAY);
+	return m->history[(m->history_next + MPC_MAX_DELAY - n) %
+			  MPC_MAX_DELAY];
+}
+
+/* The model is given in physical units, the time step is the period */
+void mpc_init(mpc_t *m, const double sp, const struct mpc_model *model,
+	      const double period_s, const double output_min,
+	      const double output_max, const double output_step)
+{
+	assert(m != NULL);
+	assert(model != NULL);
+	assert(period_s > 0.0);
+	assert(output_min >= 0.0 && output_max > output_min);
+	assert(output_step >= 0.0);
+
+	memset(m, 0, sizeof(*m));
+	m->set_point = sp;
+	m->period_s = period_s;
+	m->output_min = output_min;
+	m->output_max = output_max;
+	m->output_step = output_step;
+	m->move_weight = MPC_DEFAULT_MOVE_WEIGHT;
+	mpc_set_model(m, model);
+}
+
+double mpc_get_set_point(mpc_t *m)
+{
+	assert(m != NULL);
+	return m->set_point;
+}
+
+void mpc_set_set_point(mpc_t *m, const double sp)
+{
+	assert(m != NULL);
+	m->set_point = sp;
+}
+
+void mpc_get_model(const mpc_t *m, struct mpc_model *model)
+{
+	assert(m != NULL);
+	assert(model != NULL);
+	*model = m->model;
+}
+
+/* Takes a new model, e.g. from the online identification. The disturbance
+ * estimate is kept, it adapts to the new model by itself. */
+void mpc_set_model(mpc_t *m, const struct mpc_model *model)
+{
+	assert(m != NULL);
+	assert(model != NULL);
+	assert(model->gain > 0.0);
+	assert(model->time_constant > 0.0);
+	assert(model->dead_time >= 0.0);
+
+	unsigned int n;
+
+	m->model = *model;
+	m->delay = lround(model->dead_time / m->period_s);
+	if (m->delay >= MPC_MAX_DELAY) {
+		m->delay = MPC_MAX_DELAY - 1;
+	}
+	m->alpha = exp(-m->period_s / model->time_constant);
+
+	/* a unit step at period 0 shows after the dead time */
+	double decay = 1.0;
+	for (n = 0; n <= MPC_HORIZON; ++n) {
+		if (n > m->delay) {
+			decay *= m->alpha;
+		}
+		m->response[n] = model->gain * (1.0 - decay);
+	}
+}
+
+void mpc_set_move_weight(mpc_t *m, const double weight)
+{
+	assert(m != NULL);
+	assert(weight >= 0.0);
+	m->move_weight = weight;
+}
+
+/* Forgets everything but the output applied until now, which is taken as
+ * the output of the whole dead time. The heat on its way through the bath
+ * is then predicted instead of being made up for. */
+void mpc_reset(mpc_t *m, const double output)
+{
+	assert(m != NULL);
+
+	const double u = clamp(output, m->output_min, m->output_max);
+	unsigned int i;
+
+	for (i = 0; i < MPC_MAX_DELAY; ++i) {
+		m->history[i] = u / m->output_max;
+	}
+	for (i = 0; i < MPC_MOVES; ++i) {
+		m->moves[i] = u / m->output_max;
+	}
+	m->history_next = 0;
+	m->has_input = 0;
+	m->disturbance = 0.0;
+	m->output = u;
+}
+
+/* Replaces the last output in the history with the one the heater actually
+ * got, see controller_ops */
+void mpc_set_applied(mpc_t *m, const double output)
+{
+	assert(m != NULL);
+
+	const double u = clamp(output, m->output_min, m->output_max);
+	m->history[(m->history_next + MPC_MAX_DELAY - 1) % MPC_MAX_DELAY] =
+	    u / m->output_max;
+}
+
+/* The one step prediction error, scaled to the input, is the disturbance
+ * the model missed in the last period */
+static void estimate_disturbance(mpc_t *m, const double input)
+{
+	const struct mpc_model *model = &m->model;
+	const double u = past_output(m, m->delay + 1) + m->disturbance;
+	const double predicted =
+	    m->alpha * m->last_input +
+	    (1.0 - m->alpha) * (model->ambient + model->gain * u);
+	const double error = input - predicted;
+
+	m->disturbance = clamp(
+	    m->disturbance + MPC_DISTURBANCE_GAIN * error /
+				 ((1.0 - m->alpha) * model->gain),
+	    -1.0, 1.0);
+}
+
+static void solve(mpc_t *m, const double input)
+{
+	const struct mpc_model *model = &m->model;
+	const double u_last = past_output(m, 1);
+	double h[MPC_MOVES][MPC_MOVES];
+	double g[MPC_MOVES];
+	double gj[MPC_MOVES];
+	double y = input;
+	unsigned int i, j, k;
+
+	memset(h, 0, sizeof(h));
+	memset(g, 0, sizeof(g));
+
+	for (j = 1; j <= MPC_HORIZON; ++j) {
+		/* free response: the past outputs still on their way through
+		 * the dead time, nothing after them */
+		const double u =
+		    (j <= m->delay ? past_output(m, m->delay + 1 - j) : 0.0) +
+		    m->disturbance;
+		y = m->alpha * y +
+		    (1.0 - m->alpha) * (model->ambient + model->gain * u);
+
+		/* effect of each block of outputs on period j */
+		for (i = 0; i < MPC_MOVES; ++i) {
+			const unsigned int end = i + 1 < MPC_MOVES
+						     ? BLOCK_START[i + 1]
+						     : MPC_HORIZON;
+			gj[i] = (j > BLOCK_START[i]
+				     ? m->response[j - BLOCK_START[i]]
+				     : 0.0) -
+				(j > end ? m->response[j - end] : 0.0);
+		}
+
+		const double error = y - m->set_point;
+		for (i = 0; i < MPC_MOVES; ++i) {
+			g[i] += gj[i] * error;
+			for (k = i; k < MPC_MOVES; ++k) {
+				h[i][k] += gj[i] * gj[k];
+			}
+		}
+	}
+
+	/* move penalty, the first move is against the last output */
+	for (i = 0; i < MPC_MOVES; ++i) {
+		h[i][i] += m->move_weight * (i + 1 < MPC_MOVES ? 2.0 : 1.0);
+		if (i + 1 < MPC_MOVES) {
+			h[i][i + 1] -= m->move_weight;
+		}
+		for (k = 0; k < i; ++k) {
+			h[i][k] = h[k][i];
+		}
+	}
+	g[0] -= m->move_weight * u_last;
+
+	/* minimize v'Hv / 2 + g'v subject to 0 <= v <= 1, one coordinate at
+	 * a time */
+	const double v_max = 1.0;
+	const double v_min = m->output_min / m->output_max;
+	for (k = 0; k < MPC_ITERATIONS; ++k) {
+		for (i = 0; i < MPC_MOVES; ++i) {
+			double sum = g[i];
+			for (j = 0; j < MPC_MOVES; ++j) {
+				if (j != i) {
+					sum += h[i][j] * m->moves[j];
+				}
+			}
+			m->moves[i] = clamp(-sum / h[i][i], v_min, v_max);
+		}
+	}
+}
+
+/* Feed a measurement taken at timestamp and return the output to apply for
+ * the next period. The model runs on the nominal period, a measurement
+ * that isn't newer than the previous one leaves the output unchanged. */
+double mpc_update(mpc_t *m, const double input,
+		  const struct timespec *timestamp)
+{
+	assert(m != NULL);
+	assert(timestamp != NULL);
+
+	if (m->has_input) {
+		if (delta_t_s(&m->last_update, timestamp) <= 0.0) {
+			return m->output;
+		}
+		estimate_disturbance(m, input);
+	}
+	m->has_input = 1;
+	m->last_input = input;
+	m->last_update = *timestamp;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	solve(m, input);
+
+	/* the SSR can only switch whole half waves */
+	double output = m->moves[0] * m->output_max;
+	if (m->output_step > 0.0) {
+		output = round(output / m->output_step) * m->output_step;
+	}
+	m->output = clamp(output, m->output_min, m->output_max);
+
+	m->history[m->history_next] = m->output / m->output_max;
+	m->history_next = (m->history_next + 1) % MPC_MAX_DELAY;
+	latency_record_since(LATENCY_MPC_SOLVE, &start);
+	return m->output;
+}
+
+static double controller_update_fn(void *state, const double input,
+				   const struct timespec *timestamp)
+{
+	return mpc_update((mpc_t *)state, input, timestamp);
+}
+
+static double controller_get_set_point_fn(void *state)
+{
+	return mpc_get_set_point((mpc_t *)state);
+}
+
+static void controller_set_set_point_fn(void *state, const double sp)
+{
+	mpc_set_set_point((mpc_t *)state, sp);
+}
+
+static void controller_reset_fn(void *state, const double output)
+{
+	mpc_reset((mpc_t *)state, output);
+}
+
+static void controller_set_applied_fn(void *state, const double output)
+{
+	mpc_set_applied((mpc_t *)state, output);
+}
+
+const struct controller_ops mpc_controller_ops = {
+	.name = "mpc",
+	.update = &controller_update_fn,
+	.get_set_point = &controller_get_set_point_fn,
+	.set_set_point = &controller_set_set_point_fn,
+	.reset = &controller_reset_fn,
+	.set_applied = &controller_set_applied_fn,
+};
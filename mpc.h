@@ -0,0 +1,98 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_MPC_H
+#define SOUSVIDED_MPC_H
+
+#include <time.h>
+
+#include "controller.h"
+
+/* Model predictive temperature controller. Every period it predicts the
+ * temperature over the next MPC_HORIZON periods with a first order plus
+ * dead time model of the bath, and picks the outputs that keep it closest
+ * to the set point without moving the output too much. The outputs are
+ * held for blocks of periods, which leaves MPC_MOVES variables for a small
+ * box constrained quadratic program. The first output is applied, rounded
+ * to the SSR's granularity, and the whole problem is solved again next
+ * period.
+ *
+ * The model's gain and ambient temperature are never exact. An input
+ * disturbance, estimated from the one step prediction errors, makes up for
+ * them and gives the controller integral action. */
+
+#define MPC_HORIZON 180
+#define MPC_MOVES 4
+#define MPC_MAX_DELAY 128 /* periods of dead time */
+
+struct mpc_model
+{
+	double gain;          /* K above ambient at full output */
+	double time_constant; /* s */
+	double dead_time;     /* s */
+	double ambient;       /* degrees Celsius */
+};
+
+struct mpc
+{
+	double set_point;
+	double output_min;
+	double output_max;
+	double output_step;
+	double period_s;
+	double move_weight;
+
+	struct mpc_model model;
+	unsigned int delay; /* dead time in periods */
+	double alpha;       /* decay of the model per period */
+	double response[MPC_HORIZON + 1]; /* to a unit step at period 0 */
+
+	/* outputs as a share of output_max, newest at history_next - 1 */
+	double history[MPC_MAX_DELAY];
+	unsigned int history_next;
+
+	double last_input;
+	struct timespec last_update;
+	int has_input;
+	double disturbance;       /* share of output_max */
+	double moves[MPC_MOVES];  /* last solution, to start the next one */
+	double output;
+};
+typedef struct mpc mpc_t;
+
+void mpc_init(mpc_t *m, const double sp, const struct mpc_model *model,
+	      const double period_s, const double output_min,
+	      const double output_max, const double output_step);
+
+double mpc_get_set_point(mpc_t *m);
+void mpc_set_set_point(mpc_t *m, const double sp);
+
+void mpc_get_model(const mpc_t *m, struct mpc_model *model);
+void mpc_set_model(mpc_t *m, const struct mpc_model *model);
+void mpc_set_move_weight(mpc_t *m, const double weight);
+
+void mpc_reset(mpc_t *m, const double output);
+void mpc_set_applied(mpc_t *m, const double output);
+double mpc_update(mpc_t *m, const double input,
+		  const struct timespec *timestamp);
+
+/* mpc_t as a controller_t */
+extern const struct controller_ops mpc_controller_ops;
+
+#endif /* SOUSVIDED_MPC_H */
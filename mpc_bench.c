@@ -0,0 +1,273 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Comparison of the temperature controllers on the simulated bath.
+ *
+ * Usage: mpc_bench [LITRES]
+ *
+ * Heats a bath of LITRES (10 by default) from 20 to 55 degrees Celsius,
+ * changes the set point to 60 after two hours and adds cold food (the bath
+ * drops by 5 K) after three hours, with the PID controller, the model
+ * predictive controller and the Smith predictor. The MPC and the Smith
+ * predictor use the model of the 10 l bath, other sizes show how they cope
+ * with a wrong model. Both run once more with the model handed over from
+ * the online identification, the way sousvided does it (+id). Reports the
+ * overshoot and settling time of each phase, the RMS error once settled
+ * and the CPU time per controller update. Run it on the target (e.g. a Pi
+ * Zero) to get meaningful timings.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "controller.h"
+#include "ident.h"
+#include "mpc.h"
+#include "pid.h"
+#include "sim_plant.h"
+#include "smith.h"
+
+#define PERIOD_MS 1000
+#define OUTPUT_MAX 1000.0
+#define SETTLED_K 0.2
+
+/* online identification like in sousvided */
+#define IDENT_STEP_S 5.0
+#define IDENT_FORGETTING 0.999
+
+struct phase
+{
+	unsigned int start_s;
+	unsigned int end_s;
+	double set_point;
+};
+
+static const struct phase PHASES[] = {
+	{ 0, 2 * 3600, 55.0 },
+	{ 2 * 3600, 3 * 3600, 60.0 },
+	{ 3 * 3600, 5 * 3600, 60.0 },
+};
+#define NUM_PHASES (sizeof(PHASES) / sizeof(PHASES[0]))
+
+static double elapsed_ns(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1.0E9 +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+/* Share of the period the heater is on, rounded like sousvided does */
+static double applied(const double duty)
+{
+	if (duty < 10.0) {
+		return 0.0;
+	}
+	const double on_ms = ceil(PERIOD_MS * duty / OUTPUT_MAX / 10.0) * 10.0;
+	return on_ms > PERIOD_MS ? 1.0 : on_ms / PERIOD_MS;
+}
+
+/* Hand a new stable model to the controller like sousvided does, returns 1
+ * if it did */
+static int follow_model(controller_t *c, ident_t *id,
+			 struct ident_model *used)
+{
+	struct ident_model identified;
+
+	ident_get_model(id, &identified);
+	if (!identified.stable ||
+	    (used->stable && !ident_model_differs(&identified, used))) {
+		return 0;
+	}
+	*used = identified;
+
+	if (c->ops == &mpc_controller_ops) {
+		const struct mpc_model model = {
+			.gain = identified.gain,
+			.time_constant = identified.time_constant,
+			.dead_time = identified.dead_time,
+			.ambient = identified.ambient,
+		};
+		mpc_set_model((mpc_t *)c->state, &model);
+	} else if (c->ops == &smith_controller_ops) {
+		smith_set_model((smith_t *)c->state, identified.gain,
+				identified.time_constant,
+				identified.dead_time);
+	}
+	return 1;
+}
+
+/* With id the controller follows the identified model */
+static void run(controller_t *c, const char *name,
+		const struct sim_plant_params *params, ident_t *id)
+{
+	struct ident_model used = { 0 };
+	unsigned int models = 0;
+
+	sim_plant_t plant;
+	sim_plant_init(&plant, params);
+
+	struct timespec now = { 0, 0 };
+	struct timespec start, end;
+	double duty = 0.0, total_ns = 0.0, max_ns = 0.0;
+	unsigned int t = 0, p;
+
+	for (p = 0; p < NUM_PHASES; ++p) {
+		const struct phase *phase = &PHASES[p];
+		double overshoot = 0.0, squared = 0.0;
+		unsigned int settled = 0, samples = 0;
+
+		controller_set_set_point(c, phase->set_point);
+		if (p == 2) {
+			plant.bath_temperature -= 5.0;
+			plant.heater_temperature -= 5.0;
+		}
+
+		for (; t < phase->end_s; ++t) {
+			sim_plant_step(&plant, PERIOD_MS / 1000.0,
+				       applied(duty), 1.0);
+			++now.tv_sec;
+			const double temperature =
+			    sim_plant_read_sensor(&plant);
+			if (id) {
+				ident_update(id, duty / OUTPUT_MAX,
+					     temperature, &now);
+				models += follow_model(c, id, &used);
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			duty = controller_update(c, temperature, &now);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			const double ns = elapsed_ns(&start, &end);
+			total_ns += ns;
+			max_ns = ns > max_ns ? ns : max_ns;
+
+			/* against the noise free bath temperature */
+			const double error =
+			    plant.bath_temperature - phase->set_point;
+			if (error > overshoot) {
+				overshoot = error;
+			}
+			if (fabs(error) > SETTLED_K) {
+				settled = 0;
+				squared = 0.0;
+				samples = 0;
+			} else {
+				if (!settled) {
+					settled = t + 1;
+				}
+				squared += error * error;
+				++samples;
+			}
+		}
+
+		printf("%-8s %6.1f C %10.2f %10.0f %10.3f\n", name,
+		       phase->set_point, overshoot,
+		       settled ? (double)(settled - phase->start_s) : NAN,
+		       samples ? sqrt(squared / samples) : NAN);
+	}
+	printf("%-8s %.0f ns per update, %.0f ns max\n", name, total_ns / t,
+	       max_ns);
+	if (id) {
+		printf("%-8s %u models, the last one: gain %.1f K, time "
+		       "constant %.0f s, dead time %.0f s\n",
+		       name, models, used.gain, used.time_constant,
+		       used.dead_time);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	double litres = 10.0;
+	if (argc == 2) {
+		litres = strtod(argv[1], NULL);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [LITRES]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (litres < 1.0) {
+		fprintf(stderr, "need at least 1 l\n");
+		return EXIT_FAILURE;
+	}
+
+	/* the model is the one of the default 10 l bath */
+	struct sim_plant_params params;
+	sim_plant_default_params(&params);
+	const double capacity = params.heater_capacity + params.bath_capacity;
+	const struct mpc_model model = {
+		.gain = params.heater_power / params.loss,
+		.time_constant = capacity / params.loss,
+		.dead_time = params.sensor_lag +
+			     params.heater_capacity / params.mixing_full,
+		.ambient = params.ambient,
+	};
+	params.bath_capacity = (litres - 0.5) * 4186.0;
+	params.loss *= litres / 10.0;
+
+	pidctrl_t *pid = pidctrl_init(20.0, 500.0, 2.5, 50.0, 2.0, NULL, NULL,
+				      PERIOD_MS, 0.0, OUTPUT_MAX);
+	/* the Smith predictor takes care of the dead time, its PID can
+	 * react much faster */
+	pidctrl_t *fast = pidctrl_init(20.0, 4000.0, 1.0, 0.0, 2.0, NULL, NULL,
+				       PERIOD_MS, 0.0, OUTPUT_MAX);
+	if (!pid || !fast) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	mpc_t mpc;
+	mpc_init(&mpc, 20.0, &model, PERIOD_MS / 1000.0, 0.0, OUTPUT_MAX,
+		 OUTPUT_MAX * 10 / PERIOD_MS);
+
+	controller_t c;
+	printf("%-8s %8s %10s %10s %10s\n", "", "set", "overshoot",
+	       "settled s", "rms K");
+	controller_init(&c, &pidctrl_controller_ops, pid);
+	run(&c, "pid", &params, NULL);
+	controller_init(&c, &mpc_controller_ops, &mpc);
+	run(&c, "mpc", &params, NULL);
+	smith_t smith;
+	if (smith_init(&smith, fast, model.gain, model.time_constant,
+		       model.dead_time, PERIOD_MS / 1000.0, OUTPUT_MAX) < 0) {
+		return EXIT_FAILURE;
+	}
+	controller_init(&c, &smith_controller_ops, &smith);
+	run(&c, "smith", &params, NULL);
+
+	/* the same with a fresh start and the identified model */
+	ident_t id;
+	ident_init(&id, IDENT_STEP_S, IDENT_FORGETTING);
+	mpc_init(&mpc, 20.0, &model, PERIOD_MS / 1000.0, 0.0, OUTPUT_MAX,
+		 OUTPUT_MAX * 10 / PERIOD_MS);
+	controller_init(&c, &mpc_controller_ops, &mpc);
+	run(&c, "mpc+id", &params, &id);
+
+	ident_reset(&id);
+	smith_set_model(&smith, model.gain, model.time_constant,
+			model.dead_time);
+	smith_reset(&smith, 0.0);
+	controller_init(&c, &smith_controller_ops, &smith);
+	run(&c, "smith+id", &params, &id);
+	ident_cleanup(&id);
+
+	smith_cleanup(&smith);
+	pidctrl_free(fast);
+	pidctrl_free(pid);
+	return EXIT_SUCCESS;
+}
@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "latency.h"
+
 static double clamp(const double v, const double min, const double max)
 {
 	if (v < min) {
@@ -50,41 +52,45 @@ static uint32_t delta_t_ms(const struct timespec *start,
 	assert(end != NULL);
 
 	return (end->tv_sec - start->tv_sec) * 1000 +
-	       (end->tv_nsec - start->tv_sec) / 1000000;
+	       (end->tv_nsec - start->tv_nsec) / 1000000;
 }
 
-static void update_output(pidctrl_t *p)
+static double delta_t_s(const struct timespec *start,
+			const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) * 1.0E-9;
+}
+
+static void compute_output(pidctrl_t *p, const double input, const double dt)
 {
-	const double input = p->query_fn(p->user_data);
 	const double error = p->set_point - input;
+	const double delta_input = input - p->last_input;
+	p->last_input = input;
 
 	/* Don't to PID control when target temperature is off by more than the
 	   error limit to avoid overshoot through integral windup */
 	if (error > p->error_limit) {
 		p->integral = 0.0;
-		p->last_input = 0.0;
 		p->output = p->output_max;
 		return;
 	}
 
-	const double delta_input = input - p->last_input;
-
-	p->integral =
-	    clamp(p->integral + (p->ki * error), p->output_min, p->output_max);
-	p->last_input = input;
-	p->output = clamp(p->kp * error + p->integral - (p->kd * delta_input),
+	p->integral = clamp(p->integral + (p->ki * dt * error), p->output_min,
+			    p->output_max);
+	p->output = clamp(p->kp * error + p->integral -
+			      (p->kd / dt * delta_input),
 			  p->output_min, p->output_max);
-	fprintf(stderr, "PID: IN=%f, OUT=%f, ERR=%f, INT=%f, DERIV=%f\n",
-                input, p->output, error, p->integral, delta_input);
 }
 
+/* query_fn is only needed by pidctrl_get_output(), controllers fed with
+ * pidctrl_update() can pass NULL */
 pidctrl_t *pidctrl_init(const double sp, const double kp, const double ki,
 			const double kd, const double error_limit,
 			pidctrl_query_fn query_fn, void *user_data,
 			const uint32_t delta_t_ms, const double output_min,
 			const double output_max)
 {
-	assert(query_fn != NULL);
 	assert(delta_t_ms > 0);
 
 	pidctrl_t *p = (pidctrl_t *)malloc(sizeof(pidctrl_t));
@@ -92,8 +98,8 @@ pidctrl_t *pidctrl_init(const double sp, const double kp, const double ki,
 		p->set_point = sp;
 
 		p->kp = kp;
-		p->ki = ki * (delta_t_ms * 0.001);
-		p->kd = kd / (delta_t_ms * 0.001);
+		p->ki = ki;
+		p->kd = kd;
 
 		p->error_limit = error_limit;
 		p->integral = 0.0;
@@ -106,7 +112,10 @@ pidctrl_t *pidctrl_init(const double sp, const double kp, const double ki,
 
 		p->delta_t = delta_t_ms;
 
-		p->last_input = query_fn(user_data);
+		/* the first measurement starts the derivative and the
+		 * measured time steps */
+		p->last_input = 0.0;
+		p->has_input = 0;
 		clock_gettime(CLOCK_MONOTONIC, &p->last_query);
 	}
 	return p;
@@ -142,8 +151,21 @@ void pidctrl_tune(pidctrl_t *p, const double kp, const double ki,
 	assert(p != NULL);
 
 	p->kp = kp;
-	p->ki = ki * (p->delta_t * 1.0E-3);
-	p->kd = kd / (p->delta_t * 1.0E-31);
+	p->ki = ki;
+	p->kd = kd;
+}
+
+/* Forget the last measurement, e.g. after the output was driven by
+ * something else for a while. The integral starts at the output applied
+ * until now, so the output doesn't jump when the PID takes over close to
+ * the set point. */
+void pidctrl_reset(pidctrl_t *p, const double output)
+{
+	assert(p != NULL);
+
+	p->integral = clamp(output, p->output_min, p->output_max);
+	p->output = p->integral;
+	p->has_input = 0;
 }
 
 void pidctrl_set_limits(pidctrl_t *p, const double min, const double max)
@@ -185,17 +207,79 @@ void pidctrl_set_user_data(pidctrl_t *p, void *user_data)
 	p->user_data = user_data;
 }
 
+/* Feed a measurement taken at timestamp and return the new output. The
+ * integral and derivative terms use the time since the previous
+ * measurement, the first one assumes delta_t. A measurement that isn't
+ * newer than the previous one leaves the output unchanged. Runs in constant
+ * time and never blocks. */
+double pidctrl_update(pidctrl_t *p, const double input,
+		      const struct timespec *timestamp)
+{
+	assert(p != NULL);
+	assert(timestamp != NULL);
+
+	double dt = p->delta_t * 1.0E-3;
+	if (p->has_input) {
+		dt = delta_t_s(&p->last_update, timestamp);
+		if (dt <= 0.0) {
+			return p->output;
+		}
+	} else {
+		p->last_input = input;
+		p->has_input = 1;
+	}
+	p->last_update = *timestamp;
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	compute_output(p, input, dt);
+	latency_record_since(LATENCY_PID_COMPUTE, &start);
+	return p->output;
+}
+
+/* Compatibility with callers that poll the controller: queries the input
+ * through the callback once delta_t has passed since the last query */
 double pidctrl_get_output(pidctrl_t *p)
 {
 	assert(p != NULL);
+	assert(p->query_fn != NULL);
 
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 
 	if (delta_t_ms(&p->last_query, &now) >= p->delta_t) {
 		p->last_query = now;
-		update_output(p);
+		pidctrl_update(p, p->query_fn(p->user_data), &now);
 	}
 
 	return p->output;
 }
+
+static double controller_update_fn(void *state, const double input,
+				   const struct timespec *timestamp)
+{
+	return pidctrl_update((pidctrl_t *)state, input, timestamp);
+}
+
+static double controller_get_set_point_fn(void *state)
+{
+	return pidctrl_get_set_point((pidctrl_t *)state);
+}
+
+static void controller_set_set_point_fn(void *state, const double sp)
+{
+	pidctrl_set_set_point((pidctrl_t *)state, sp);
+}
+
+static void controller_reset_fn(void *state, const double output)
+{
+	pidctrl_reset((pidctrl_t *)state, output);
+}
+
+const struct controller_ops pidctrl_controller_ops = {
+	.name = "pid",
+	.update = &controller_update_fn,
+	.get_set_point = &controller_get_set_point_fn,
+	.set_set_point = &controller_set_set_point_fn,
+	.reset = &controller_reset_fn,
+};
@@ -23,6 +23,8 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <stdint.h>
 #include <time.h>
 
+#include "controller.h"
+
 typedef double (*pidctrl_query_fn)(void *);
 
 struct pidctrl
@@ -44,7 +46,9 @@ struct pidctrl
 	void *user_data;
 
 	struct timespec last_query;
-	uint32_t delta_t;
+	struct timespec last_update; /* timestamp of the last measurement */
+	uint8_t has_input;
+	uint32_t delta_t; /* nominal */
 };
 
 typedef struct pidctrl pidctrl_t;
@@ -64,6 +68,8 @@ void pidctrl_set_set_point(pidctrl_t *p, const double sp);
 void pidctrl_tune(pidctrl_t *p, const double kp, const double ki,
 		  const double kd);
 
+void pidctrl_reset(pidctrl_t *p, const double output);
+
 void pidctrl_set_limits(pidctrl_t *p, const double min, const double max);
 void pidctrl_get_limits(const pidctrl_t *p, double *min, double *max);
 
@@ -75,6 +81,11 @@ void pidctrl_set_query_callback(pidctrl_t *p, pidctrl_query_fn query_fn,
 
 void pidctrl_set_user_data(pidctrl_t *p, void *user_data);
 
+double pidctrl_update(pidctrl_t *p, const double input,
+		      const struct timespec *timestamp);
 double pidctrl_get_output(pidctrl_t *p);
 
+/* pidctrl_t as a controller_t */
+extern const struct controller_ops pidctrl_controller_ops;
+
 #endif /* SOUSVIDED_PID_H */
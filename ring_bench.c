@@ -0,0 +1,293 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Stress benchmark of the sample ring.
+ *
+ * Usage: ring_bench [READERS [SECONDS [PRODUCER_PERIOD_US]]]
+ *
+ * One producer publishes samples (back to back by default, to maximize
+ * contention) while READERS threads take the latest sample or a window of
+ * samples as fast as they can. Reports the reader latency percentiles for
+ * the lock-free ring and for a mutex protected sample, the way max31865.c
+ * used to share the latest readout, and checks every sample read for torn
+ * copies. Latencies include the clock_gettime() overhead, which is reported
+ * separately.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "sample_ring.h"
+
+#define MAX_READERS 64
+#define MAX_LATENCIES (1 << 20)
+#define WINDOW 16
+
+enum MODE {
+	MODE_CLOCK = 0,
+	MODE_RING_LATEST,
+	MODE_RING_WINDOW,
+	MODE_MUTEX_LATEST
+};
+
+static const char *MODE_NAMES[] = { "clock_gettime", "ring latest",
+				     "ring window 16", "mutex latest" };
+
+static sample_ring_t RING;
+static pthread_mutex_t MUTEX = PTHREAD_MUTEX_INITIALIZER;
+static struct rtd_sample LOCKED_SAMPLE;
+
+static volatile int STOP;
+static enum MODE CURRENT_MODE;
+static unsigned int PRODUCER_PERIOD_US;
+
+struct reader
+{
+	pthread_t thread;
+	unsigned int *latencies;
+	size_t count;
+	unsigned long long reads;
+	unsigned long long torn;
+};
+
+static unsigned int elapsed_ns(const struct timespec *start,
+			       const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000000u +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+/* Every field of a sample is derived from its sequence number, so a copy
+ * mixing two samples is detected */
+static void make_sample(struct rtd_sample *sample, const uint32_t sequence)
+{
+	sample->timestamp.tv_sec = sequence;
+	sample->timestamp.tv_nsec = sequence % 1000000000u;
+	sample->sequence = sequence;
+	sample->rtd = sequence & 0x7FFF;
+	sample->fault = sequence & 1;
+	sample->temperature = (float)(sequence & 0xFFFF);
+}
+
+static int is_torn(const struct rtd_sample *sample)
+{
+	struct rtd_sample expected;
+	make_sample(&expected, sample->sequence);
+	return sample->timestamp.tv_sec != expected.timestamp.tv_sec ||
+	       sample->timestamp.tv_nsec != expected.timestamp.tv_nsec ||
+	       sample->rtd != expected.rtd || sample->fault != expected.fault ||
+	       sample->temperature != expected.temperature;
+}
+
+static void *producer_thread(void *user_data)
+{
+	struct rtd_sample sample;
+	uint32_t sequence = 0;
+
+	while (!STOP) {
+		++sequence;
+		if (sequence == 0) {
+			sequence = 1;
+		}
+		make_sample(&sample, sequence);
+		if (CURRENT_MODE == MODE_MUTEX_LATEST) {
+			pthread_mutex_lock(&MUTEX);
+			LOCKED_SAMPLE = sample;
+			pthread_mutex_unlock(&MUTEX);
+		} else {
+			sample_ring_push(&RING, &sample);
+		}
+		if (PRODUCER_PERIOD_US) {
+			usleep(PRODUCER_PERIOD_US);
+		}
+	}
+	return NULL;
+}
+
+static void *reader_thread(void *user_data)
+{
+	struct reader *reader = (struct reader *)user_data;
+	struct rtd_sample samples[WINDOW];
+	struct timespec start, end;
+	size_t i, n = 0;
+
+	while (!STOP) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		switch (CURRENT_MODE) {
+		case MODE_CLOCK:
+			break;
+		case MODE_RING_LATEST:
+			n = sample_ring_latest(&RING, samples);
+			break;
+		case MODE_RING_WINDOW:
+			n = sample_ring_window(&RING, samples, WINDOW);
+			break;
+		case MODE_MUTEX_LATEST:
+			pthread_mutex_lock(&MUTEX);
+			samples[0] = LOCKED_SAMPLE;
+			pthread_mutex_unlock(&MUTEX);
+			n = samples[0].sequence != 0;
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		for (i = 0; i < n; ++i) {
+			reader->torn += is_torn(&samples[i]);
+			/* a window has to be consecutive samples */
+			if (i > 0 && samples[i].sequence !=
+					 samples[i - 1].sequence + 1) {
+				++reader->torn;
+			}
+		}
+
+		reader->latencies[reader->count++ & (MAX_LATENCIES - 1)] =
+		    elapsed_ns(&start, &end);
+		++reader->reads;
+	}
+	return NULL;
+}
+
+static int compare_uint(const void *a, const void *b)
+{
+	const unsigned int x = *(const unsigned int *)a;
+	const unsigned int y = *(const unsigned int *)b;
+	return (x > y) - (x < y);
+}
+
+static int run(const enum MODE mode, struct reader *readers,
+	       const unsigned int num_readers, const unsigned int seconds)
+{
+	pthread_t producer;
+	unsigned int i;
+
+	CURRENT_MODE = mode;
+	STOP = 0;
+	sample_ring_init(&RING);
+	memset(&LOCKED_SAMPLE, 0, sizeof(LOCKED_SAMPLE));
+
+	for (i = 0; i < num_readers; ++i) {
+		readers[i].count = 0;
+		readers[i].reads = 0;
+		readers[i].torn = 0;
+	}
+
+	if (pthread_create(&producer, NULL, &producer_thread, NULL) != 0) {
+		fprintf(stderr, "failed to create producer thread\n");
+		return -1;
+	}
+	for (i = 0; i < num_readers; ++i) {
+		if (pthread_create(&readers[i].thread, NULL, &reader_thread,
+				   &readers[i]) != 0) {
+			fprintf(stderr, "failed to create reader thread\n");
+			STOP = 1;
+			break;
+		}
+	}
+
+	sleep(seconds);
+	STOP = 1;
+
+	pthread_join(producer, NULL);
+	while (i--) {
+		pthread_join(readers[i].thread, NULL);
+	}
+
+	/* pool the latencies of all readers */
+	size_t total = 0;
+	unsigned long long reads = 0, torn = 0;
+	for (i = 0; i < num_readers; ++i) {
+		size_t n = readers[i].count;
+		if (n > MAX_LATENCIES) {
+			n = MAX_LATENCIES;
+		}
+		memmove(readers[0].latencies + total, readers[i].latencies,
+			sizeof(unsigned int) * n);
+		total += n;
+		reads += readers[i].reads;
+		torn += readers[i].torn;
+	}
+	qsort(readers[0].latencies, total, sizeof(unsigned int), &compare_uint);
+
+	const unsigned int *l = readers[0].latencies;
+	printf("%-16s %10.1f %8u %8u %8u %8u %8llu\n", MODE_NAMES[mode],
+	       reads / (seconds * 1.0E6), l[total / 2], l[total * 99 / 100],
+	       l[total * 999 / 1000], l[total - 1], torn);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int num_readers = 4;
+	unsigned int seconds = 2;
+
+	if (argc > 4) {
+		fprintf(stderr, "usage: %s [READERS [SECONDS "
+				"[PRODUCER_PERIOD_US]]]\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (argc > 1) {
+		num_readers = strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2) {
+		seconds = strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3) {
+		PRODUCER_PERIOD_US = strtoul(argv[3], NULL, 10);
+	}
+	if (num_readers == 0 || num_readers > MAX_READERS || seconds == 0) {
+		fprintf(stderr, "invalid arguments\n");
+		return EXIT_FAILURE;
+	}
+
+	/* the first reader's buffer holds the pooled latencies */
+	struct reader readers[MAX_READERS];
+	unsigned int i;
+	memset(readers, 0, sizeof(readers));
+	for (i = 0; i < num_readers; ++i) {
+		const size_t n = i == 0 ? (size_t)num_readers * MAX_LATENCIES
+					: MAX_LATENCIES;
+		readers[i].latencies = malloc(sizeof(unsigned int) * n);
+		if (!readers[i].latencies) {
+			fprintf(stderr, "out of memory\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("%u readers, producer period %u us, %u s per run\n", num_readers,
+	       PRODUCER_PERIOD_US, seconds);
+	printf("%-16s %10s %8s %8s %8s %8s %8s\n", "reader", "Mreads/s",
+	       "p50 ns", "p99 ns", "p99.9 ns", "max ns", "torn");
+
+	int rc = 0;
+	enum MODE mode;
+	for (mode = MODE_CLOCK; mode <= MODE_MUTEX_LATEST && rc == 0; ++mode) {
+		rc = run(mode, readers, num_readers, seconds);
+	}
+
+	for (i = 0; i < num_readers; ++i) {
+		free(readers[i].latencies);
+	}
+	return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,249 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Benchmark of the RTD temperature converters.
+ *
+ * Usage: rtd_bench [R0 REFERENCE_RESISTANCE TEMP_MIN TEMP_MAX]
+ *
+ * Reports the footprint, the lookup latency (sequential and random ADC codes,
+ * one at a time and through rtd_table_lookup_batch()) and the maximum error
+ * against the float table and against solving the Callendar Van Dusen
+ * equation with newton_approx() for each converter.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cvd.h"
+#include "rtd_table.h"
+
+#define NUM_QUERIES (1 << 22)
+
+static uint16_t *SEQUENTIAL_ADC;
+static uint16_t *RANDOM_ADC;
+static float *OUTPUT;
+static volatile float SINK;
+
+/* newton_approx() results for the ADC codes covered by the temperature range */
+static double *EXACT;
+static unsigned int ADC_MIN, ADC_MAX;
+static unsigned int R0 = 1000, REFERENCE_RESISTANCE = 1400;
+
+static double elapsed_ns(const struct timespec *start,
+			 const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1.0E9 +
+	       (end->tv_nsec - start->tv_nsec);
+}
+
+static double time_lookups(const rtd_table_t *table, const uint16_t *adc)
+{
+	struct timespec start, end;
+	float sum = 0.0f;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NUM_QUERIES; ++i) {
+		sum += rtd_table_lookup(table, adc[i]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	SINK = sum;
+
+	return elapsed_ns(&start, &end) / NUM_QUERIES;
+}
+
+static double time_batch(const rtd_table_t *table, const uint16_t *adc)
+{
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	rtd_table_lookup_batch(table, adc, OUTPUT, NUM_QUERIES);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	SINK = OUTPUT[NUM_QUERIES - 1];
+
+	/* make sure the batch results match the single lookups */
+	unsigned int i;
+	double max = 0.0;
+	for (i = 0; i < NUM_QUERIES; ++i) {
+		double diff = fabs(OUTPUT[i] - rtd_table_lookup(table, adc[i]));
+		if (diff > max) {
+			max = diff;
+		}
+	}
+	if (max > 1.0E-3) {
+		fprintf(stderr, "batch lookup differs by up to %g\n", max);
+	}
+
+	return elapsed_ns(&start, &end) / NUM_QUERIES;
+}
+
+static double time_newton(const uint16_t *adc)
+{
+	struct timespec start, end;
+	double sum = 0.0;
+	unsigned int i;
+
+	/* way too slow to run the full set of queries */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < NUM_QUERIES / 64; ++i) {
+		sum += newton_approx(
+		    resistance_from_adc(adc[i], REFERENCE_RESISTANCE), R0,
+		    1.0e-6, 0.0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	SINK = sum;
+
+	return elapsed_ns(&start, &end) / (NUM_QUERIES / 64);
+}
+
+static double max_error(const rtd_table_t *table,
+			const rtd_table_t *reference)
+{
+	double max = 0.0;
+	unsigned int adc;
+	for (adc = 0; adc < 32768; ++adc) {
+		double error = fabs(rtd_table_lookup(table, adc) -
+				    rtd_table_lookup(reference, adc));
+		if (error > max) {
+			max = error;
+		}
+	}
+	return max;
+}
+
+static double max_error_exact(const rtd_table_t *table)
+{
+	double max = 0.0;
+	unsigned int adc;
+	for (adc = ADC_MIN; adc <= ADC_MAX; ++adc) {
+		double error =
+		    fabs(rtd_table_lookup(table, adc) - EXACT[adc - ADC_MIN]);
+		if (error > max) {
+			max = error;
+		}
+	}
+	return max;
+}
+
+static void report(const char *name, const rtd_table_t *table,
+		   const rtd_table_t *reference)
+{
+	printf("%-16s %8zu %10.2f %10.2f %10.2f %12.6f %12.6f\n", name,
+	       rtd_table_footprint(table),
+	       time_lookups(table, SEQUENTIAL_ADC),
+	       time_lookups(table, RANDOM_ADC), time_batch(table, RANDOM_ADC),
+	       max_error(table, reference), max_error_exact(table));
+}
+
+int main(int argc, char **argv)
+{
+	double temperature_min = 0.0, temperature_max = 100.0;
+
+	if (argc == 5) {
+		R0 = strtoul(argv[1], NULL, 10);
+		REFERENCE_RESISTANCE = strtoul(argv[2], NULL, 10);
+		temperature_min = strtod(argv[3], NULL);
+		temperature_max = strtod(argv[4], NULL);
+	} else if (argc != 1) {
+		fprintf(stderr, "usage: %s [R0 RREF TMIN TMAX]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* don't leave cache files behind */
+	rtd_table_set_cache_dir(NULL);
+
+	rtd_table_t *reference = rtd_table_create(
+	    temperature_min, temperature_max, R0, REFERENCE_RESISTANCE);
+	if (!reference) {
+		return EXIT_FAILURE;
+	}
+
+	SEQUENTIAL_ADC = malloc(sizeof(uint16_t) * NUM_QUERIES);
+	RANDOM_ADC = malloc(sizeof(uint16_t) * NUM_QUERIES);
+	OUTPUT = malloc(sizeof(float) * NUM_QUERIES);
+	if (!SEQUENTIAL_ADC || !RANDOM_ADC || !OUTPUT) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	unsigned int i;
+	srand(42);
+	for (i = 0; i < NUM_QUERIES; ++i) {
+		SEQUENTIAL_ADC[i] = i & 0x7FFF;
+		RANDOM_ADC[i] = rand() & 0x7FFF;
+	}
+
+	cvd_adc_range(temperature_min, temperature_max, R0,
+		      REFERENCE_RESISTANCE, &ADC_MIN, &ADC_MAX);
+	/* skip the codes just outside the range, which the converters clamp */
+	++ADC_MIN;
+	--ADC_MAX;
+	EXACT = malloc(sizeof(double) * (ADC_MAX - ADC_MIN + 1));
+	if (!EXACT) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+	for (i = ADC_MIN; i <= ADC_MAX; ++i) {
+		EXACT[i - ADC_MIN] = newton_approx(
+		    resistance_from_adc(i, REFERENCE_RESISTANCE), R0, 1.0e-6,
+		    0.0);
+	}
+
+	printf("\n%-16s %8s %10s %10s %10s %12s %12s\n", "converter", "bytes",
+	       "seq ns/q", "rand ns/q", "batch ns/q", "err vs table",
+	       "err vs exact");
+	printf("%-16s %8d %10.2f %10.2f %10s %12s %12s\n", "newton_approx", 0,
+	       time_newton(SEQUENTIAL_ADC), time_newton(RANDOM_ADC), "-", "-",
+	       "-");
+	report("float table", reference, reference);
+
+	rtd_table_t *analytic = rtd_table_create_converter(
+	    RTD_CONVERTER_ANALYTIC, 1, temperature_min, temperature_max, R0,
+	    REFERENCE_RESISTANCE);
+	if (!analytic) {
+		return EXIT_FAILURE;
+	}
+	report("analytic", analytic, reference);
+	rtd_table_destroy(analytic);
+
+	unsigned int stride;
+	for (stride = 1; stride <= RTD_TABLE_MAX_STRIDE; stride <<= 1) {
+		rtd_table_t *table = rtd_table_create_converter(
+		    RTD_CONVERTER_FIXED, stride, temperature_min,
+		    temperature_max, R0, REFERENCE_RESISTANCE);
+		if (!table) {
+			return EXIT_FAILURE;
+		}
+
+		char name[32];
+		snprintf(name, sizeof(name), "fixed stride %u", stride);
+		report(name, table, reference);
+		rtd_table_destroy(table);
+	}
+
+	rtd_table_destroy(reference);
+	free(EXACT);
+	free(OUTPUT);
+	free(RANDOM_ADC);
+	free(SEQUENTIAL_ADC);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "rtd_cache.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cvd.h"
+
+#define RTD_CACHE_MAGIC "SVDRTD\0"
+#define RTD_CACHE_VERSION 1
+
+/* On-disk header, followed by `size` floats. The file is only valid on the
+ * machine (and ABI) that wrote it, which is all a cache needs. */
+struct rtd_cache_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t R0;
+	uint32_t reference_resistance;
+	double temperature_min;
+	double temperature_max;
+	double cvd_a;
+	double cvd_b;
+	double cvd_c;
+	uint32_t base;
+	uint32_t size;
+	uint32_t checksum;
+	uint32_t reserved;
+};
+
+static const char *CACHE_DIR = RTD_TABLE_CACHE_DIR;
+
+/* Set the cache directory, NULL disables the cache */
+void rtd_cache_set_dir(const char *dir)
+{
+	CACHE_DIR = dir;
+}
+
+/* 32 bit FNV-1a hash */
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t length)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	while (length--) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void init_header(struct rtd_cache_header *header,
+			const struct rtd_cache_key *key)
+{
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, RTD_CACHE_MAGIC, sizeof(header->magic));
+	header->version = RTD_CACHE_VERSION;
+	header->header_size = sizeof(*header);
+	header->R0 = key->R0;
+	header->reference_resistance = key->reference_resistance;
+	header->temperature_min = key->temperature_min;
+	header->temperature_max = key->temperature_max;
+	header->cvd_a = CVD_A;
+	header->cvd_b = CVD_B;
+	header->cvd_c = CVD_C;
+}
+
+/* The file name is derived from everything the table depends on, the header
+ * is checked against the key on load anyway */
+static int cache_path(char *path, const size_t length,
+		      const struct rtd_cache_key *key)
+{
+	struct rtd_cache_header header;
+	init_header(&header, key);
+
+	uint32_t hash = fnv1a(2166136261u, &header, sizeof(header));
+	int n = snprintf(path, length, "%s/rtd-%u-%u-%08x.v%d.tbl", CACHE_DIR,
+			 key->R0, key->reference_resistance, hash,
+			 RTD_CACHE_VERSION);
+	if (n < 0 || (size_t)n >= length) {
+		return -1;
+	}
+	return 0;
+}
+
+int rtd_cache_load(const struct rtd_cache_key *key, struct rtd_cache_map *map)
+{
+	assert(key != NULL);
+	assert(map != NULL);
+
+	char path[PATH_MAX];
+	if (!CACHE_DIR || cache_path(path, sizeof(path), key) == -1) {
+		return -1;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		return -1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 ||
+	    (size_t)st.st_size < sizeof(struct rtd_cache_header)) {
+		close(fd);
+		return -1;
+	}
+
+	void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		return -1;
+	}
+
+	const struct rtd_cache_header *header =
+	    (const struct rtd_cache_header *)addr;
+	struct rtd_cache_header expected;
+	init_header(&expected, key);
+	expected.base = header->base;
+	expected.size = header->size;
+	expected.checksum = header->checksum;
+
+	const float *data = (const float *)(header + 1);
+	if (memcmp(header, &expected, sizeof(expected)) != 0 ||
+	    header->base + header->size > 32768 ||
+	    (size_t)st.st_size !=
+		sizeof(*header) + sizeof(float) * header->size ||
+	    fnv1a(2166136261u, data, sizeof(float) * header->size) !=
+		header->checksum) {
+		fprintf(stderr, "rtd_cache_load: ignoring invalid cache file "
+				"%s\n",
+			path);
+		munmap(addr, st.st_size);
+		return -1;
+	}
+
+	printf("rtd_cache_load: using cached RTD table %s\n", path);
+
+	map->addr = addr;
+	map->length = st.st_size;
+	map->data = data;
+	map->base = header->base;
+	map->size = header->size;
+	return 0;
+}
+
+void rtd_cache_unmap(struct rtd_cache_map *map)
+{
+	assert(map != NULL);
+
+	if (map->addr) {
+		munmap(map->addr, map->length);
+		map->addr = NULL;
+		map->data = NULL;
+	}
+}
+
+static int write_all(int fd, const void *data, size_t length)
+{
+	const char *p = (const char *)data;
+	while (length) {
+		ssize_t n = write(fd, p, length);
+		if (n == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		p += n;
+		length -= n;
+	}
+	return 0;
+}
+
+/* Store a table in the cache. The file is written under a temporary name and
+ * renamed into place, so concurrent readers only ever see complete files. */
+int rtd_cache_store(const struct rtd_cache_key *key, const float *data,
+		    const unsigned int base, const unsigned int size)
+{
+	assert(key != NULL);
+	assert(data != NULL);
+
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX];
+	if (!CACHE_DIR || cache_path(path, sizeof(path), key) == -1 ||
+	    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >=
+		(int)sizeof(tmp_path)) {
+		return -1;
+	}
+
+	if (mkdir(CACHE_DIR, 0755) == -1 && errno != EEXIST) {
+		fprintf(stderr, "rtd_cache_store: failed to create %s: %s\n",
+			CACHE_DIR, strerror(errno));
+		return -1;
+	}
+
+	int fd = mkstemp(tmp_path);
+	if (fd == -1) {
+		fprintf(stderr, "rtd_cache_store: failed to create %s: %s\n",
+			tmp_path, strerror(errno));
+		return -1;
+	}
+
+	struct rtd_cache_header header;
+	init_header(&header, key);
+	header.base = base;
+	header.size = size;
+	header.checksum = fnv1a(2166136261u, data, sizeof(float) * size);
+
+	if (fchmod(fd, 0644) == -1 ||
+	    write_all(fd, &header, sizeof(header)) == -1 ||
+	    write_all(fd, data, sizeof(float) * size) == -1 ||
+	    fsync(fd) == -1) {
+		fprintf(stderr, "rtd_cache_store: failed to write %s: %s\n",
+			tmp_path, strerror(errno));
+		close(fd);
+		unlink(tmp_path);
+		return -1;
+	}
+	close(fd);
+
+	if (rename(tmp_path, path) == -1) {
+		fprintf(stderr, "rtd_cache_store: failed to rename %s: %s\n",
+			tmp_path, strerror(errno));
+		unlink(tmp_path);
+		return -1;
+	}
+
+	printf("rtd_cache_store: cached RTD table in %s\n", path);
+	return 0;
+}
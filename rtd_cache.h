@@ -0,0 +1,60 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_RTD_CACHE_H
+#define SOUSVIDED_RTD_CACHE_H
+
+/* Persistent cache for RTD tables generated at runtime.
+ *
+ * Tables are stored as versioned, checksummed files, one per set of table
+ * parameters, and mapped read-only on later starts. Several processes using
+ * the same table therefore share the same physical pages.
+ */
+
+#include <stddef.h>
+
+#ifndef RTD_TABLE_CACHE_DIR
+#define RTD_TABLE_CACHE_DIR "/var/cache/sousvided"
+#endif
+
+struct rtd_cache_key
+{
+	unsigned int R0;
+	unsigned int reference_resistance;
+	double temperature_min;
+	double temperature_max;
+};
+
+struct rtd_cache_map
+{
+	void *addr;
+	size_t length;
+	const float *data;
+	unsigned int base;
+	unsigned int size;
+};
+
+void rtd_cache_set_dir(const char *dir);
+
+int rtd_cache_load(const struct rtd_cache_key *key, struct rtd_cache_map *map);
+void rtd_cache_unmap(struct rtd_cache_map *map);
+int rtd_cache_store(const struct rtd_cache_key *key, const float *data,
+		    const unsigned int base, const unsigned int size);
+
+#endif /* SOUSVIDED_RTD_CACHE_H */
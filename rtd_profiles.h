@@ -0,0 +1,40 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_RTD_PROFILES_H
+#define SOUSVIDED_RTD_PROFILES_H
+
+/* Precompiled RTD tables. The definitions are generated at build time by
+ * rtd_table_gen from the RTD_TABLE_PROFILES list in the Makefile. */
+
+struct rtd_profile
+{
+	unsigned int R0;
+	unsigned int reference_resistance;
+	double temperature_min;
+	double temperature_max;
+	unsigned int base;
+	unsigned int size;
+	const float *data;
+};
+
+extern const struct rtd_profile RTD_PROFILES[];
+extern const unsigned int RTD_PROFILES_COUNT;
+
+#endif /* SOUSVIDED_RTD_PROFILES_H */
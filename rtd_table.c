@@ -17,207 +17,908 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+#include "rtd_table.h"
+
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-struct rtd_table
-{
-	float *data;
-	unsigned int base;
-	unsigned int size;
-	float min_temp;
-	float max_temp;
-};
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
-struct rtd_table RTD_TABLE = { NULL, 0, 32768, 0.0f, 100.0f };
+#include "cvd.h"
+#include "rtd_profiles.h"
+#include "rtd_table_private.h"
 
-static const double CVD_A = 3.9083E-3;
-static const double CVD_B = -5.775E-7;
-static const double CVD_C = -4.18301E-12;
+static rtd_table_t *RTD_TABLE = NULL;
 
-/* Calculate the normalized resistance at temperature T (in degrees Celsius)
- * using the Callendar Van Dusen Equation */
-static double callendar_van_dusen(const double T)
+/* Look for a table that has been generated at build time for the given
+ * parameters */
+static const struct rtd_profile *find_profile(
+    const double temperature_min, const double temperature_max,
+    const unsigned int R0, const unsigned int reference_resistance)
 {
-	/* R(T) = 1 + AT + BT^2                 (T >= 0)
-	 *        1 + AT + BT^2 + C(T - 100)T^3	(T < 0)
-	 */
-	if (T < 0.0) {
-		return (((CVD_C * (T - 100.0) * T - CVD_B) * T + CVD_A) * T +
-			1.0);
+	unsigned int i;
+	for (i = 0; i < RTD_PROFILES_COUNT; ++i) {
+		const struct rtd_profile *profile = &RTD_PROFILES[i];
+		if (profile->R0 == R0 &&
+		    profile->reference_resistance == reference_resistance &&
+		    profile->temperature_min == temperature_min &&
+		    profile->temperature_max == temperature_max) {
+			return profile;
+		}
 	}
-#ifdef FP_FAST_FMA
-	/* Use hardware fused multiply-add if possible */
-	return fma(fma(CVD_B, T, CVD_A), T, 1.0);
-#else
-	return ((CVD_B * T + CVD_A) * T + 1.0);
-#endif /* FP_FAST_FMA */
+	return NULL;
 }
 
-/* Calculate the derivative of the normalized resistance at temperature T (in
- * degrees Celsius), using the Callendar Van Dusen Equation */
-static double callendar_van_dusen_derivative(const double T)
+static int check_parameters(const double temperature_min,
+			    const double temperature_max,
+			    const unsigned int R0)
 {
-	/* dR/dt = A + 2BT                            (T >= 0.0)
-	 *         A + 2BT + C * (-300 T^2 + 4 T ^3)  (T < 0.0)
-	 */
+	if (R0 < 100) {
+		fprintf(stderr, "generate_rtd_table: R0 too small (%d < 100)\n",
+			R0);
+		return -1;
+	}
 
-	if (T < 0.0) {
-		return ((4.0 * T - 300.0) * CVD_C * T - 2.0 * CVD_B) * T +
-		       CVD_A;
+	if (temperature_min >= temperature_max) {
+		fprintf(stderr, "generate_rtd_table: invalid temperature "
+				"boundaries (%f > %f)\n",
+			temperature_min, temperature_max);
+		return -1;
 	}
-#ifdef FP_FAST_FMA
-	/* Use hardware fused multiply-add if possible */
-	return fma(2.0 * CVD_B, T, CVD_A);
-#else
-	return CVD_A + (2.0 * CVD_B * T);
-#endif /* FP_FAST_FMA */
+
+	return 0;
 }
 
-/* approximate the temperature for a given resistance using Newton's method */
-double newton_approx(const double R, const unsigned int R0,
-		     const double max_residual)
+static double elapsed_ms(const struct timespec *start,
+			 const struct timespec *end)
 {
-	double T = 0.0;
-	double residual;
-	do {
-		residual = R - R0 * callendar_van_dusen(T);
-		T += residual / (R0 * callendar_van_dusen_derivative(T));
-	} while (fabs(residual) > max_residual);
-	return T;
+	return (end->tv_sec - start->tv_sec) * 1.0E3 +
+	       (end->tv_nsec - start->tv_nsec) * 1.0E-6;
 }
 
-static double resistance_from_adc(const unsigned int adc,
-				  const unsigned int reference_resistance)
+static int is_identity(const double *correction)
 {
-	assert(adc < 32768);
-	return ((adc * reference_resistance) / 32768.0);
+	return correction[0] == 0.0 && correction[1] == 1.0 &&
+	       correction[2] == 0.0;
 }
 
-static unsigned int find_minimum_adc(const double resistance_min,
-				     const unsigned int reference_resistance)
+static double correct(const double *correction, const double T)
 {
-	unsigned int adc = 0;
-	while (adc < 32768 && (resistance_from_adc(adc, reference_resistance) <
-			       resistance_min)) {
-		++adc;
-	}
-
-	if (adc > 0) {
-		--adc;
-	}
+	return (correction[2] * T + correction[1]) * T + correction[0];
+}
 
-	return adc;
+/* Lookups outside the range return the corrected ends of it, so all
+ * converters clamp to the same temperatures after a calibration */
+static void set_limits(struct rtd_table_data *table,
+		       const double temperature_min,
+		       const double temperature_max, const double *correction)
+{
+	const double a = correct(correction, temperature_min);
+	const double b = correct(correction, temperature_max);
+	table->min_temp = fmin(a, b);
+	table->max_temp = fmax(a, b);
 }
 
-static unsigned int find_maximum_adc(const double resistance_max,
-				     const unsigned int reference_resistance,
-				     const unsigned int adc_min)
+/* Apply a calibration correction to a float table. Precompiled and cached
+ * tables are shared, so they are copied first. */
+static int apply_correction(struct rtd_table_data *table,
+			    const double *correction)
 {
-	unsigned int adc = 32767;
-	while (adc > 0 && (resistance_from_adc(adc, reference_resistance) >
-			   resistance_max)) {
-		--adc;
+	memcpy(table->correction, correction, sizeof(table->correction));
+	if (is_identity(correction)) {
+		return 0;
 	}
 
-	if (!adc) {
-		++adc;
+	float *data = table->buffer;
+	if (!data) {
+		table->buffer_size = sizeof(float) * table->size;
+		data = malloc(table->buffer_size);
+		if (!data) {
+			fprintf(stderr, "apply_correction: failed to "
+					"allocate table.\n");
+			return -1;
+		}
+		memcpy(data, table->data, table->buffer_size);
+		table->buffer = data;
+		table->data = data;
+		rtd_cache_unmap(&table->map);
 	}
 
-	if (adc <= adc_min) {
-		adc = adc_min + 1;
+	unsigned int i;
+	for (i = 0; i < table->size; ++i) {
+		data[i] = correct(correction, data[i]);
 	}
-
-	return adc;
+	return 0;
 }
 
-static int generate_rtd_table(struct rtd_table *table,
+static int generate_rtd_table(struct rtd_table_data *table,
 			      const double temperature_min,
 			      const double temperature_max,
 			      const unsigned int R0,
-			      const unsigned int reference_resistance)
+			      const unsigned int reference_resistance,
+			      const double *correction)
 {
 	assert(table != NULL);
 
-	if (R0 < 100) {
-		fprintf(stderr, "generate_rtd_table: R0 too small (%d < 100)\n",
-			R0);
+	if (check_parameters(temperature_min, temperature_max, R0) == -1) {
 		return -1;
 	}
 
-	if (temperature_min >= temperature_max) {
-		fprintf(stderr, "generate_rtd_table: invalid temperature "
-				"boundaries (%f > %f)\n",
-			temperature_min, temperature_max);
-		return -1;
+	table->converter = RTD_CONVERTER_TABLE;
+	table->fixed = NULL;
+	table->shift = 0;
+	table->scale = 1.0f;
+	set_limits(table, temperature_min, temperature_max, correction);
+
+	const struct rtd_profile *profile = find_profile(
+	    temperature_min, temperature_max, R0, reference_resistance);
+	if (profile) {
+		printf("generate_rtd_table: using precompiled RTD table "
+		       "(%u:%u:%g:%g)\n",
+		       R0, reference_resistance, temperature_min,
+		       temperature_max);
+		table->data = profile->data;
+		table->buffer = NULL;
+		table->buffer_size = 0;
+		table->base = profile->base;
+		table->size = profile->size;
+		return apply_correction(table, correction);
 	}
 
-	const double resistance_min = R0 * callendar_van_dusen(temperature_min);
-	const double resistance_max = R0 * callendar_van_dusen(temperature_max);
+	/* Next best thing is a table cached by a previous run */
+	const struct rtd_cache_key key = { R0, reference_resistance,
+					   temperature_min, temperature_max };
+	if (rtd_cache_load(&key, &table->map) == 0) {
+		table->data = table->map.data;
+		table->buffer = NULL;
+		table->buffer_size = 0;
+		table->base = table->map.base;
+		table->size = table->map.size;
+		return apply_correction(table, correction);
+	}
 
-	const unsigned int adc_min =
-	    find_minimum_adc(resistance_min, reference_resistance);
-	const unsigned int adc_max =
-	    find_maximum_adc(resistance_max, reference_resistance, adc_min);
+	unsigned int adc_min, adc_max;
+	cvd_adc_range(temperature_min, temperature_max, R0,
+		      reference_resistance, &adc_min, &adc_max);
 
-	table->data = malloc(sizeof(float) * (adc_max - adc_min + 1));
-	if (!table->data) {
+	table->buffer_size = sizeof(float) * (adc_max - adc_min + 1);
+	table->buffer = malloc(table->buffer_size);
+	if (!table->buffer) {
 		fprintf(stderr,
 			"generate_rtd_table: failed to allocate table.\n");
 		return -1;
 	}
 	printf("generate_rtd_table: allocated %zu bytes for RTD table\n",
-	       sizeof(float) * (adc_max - adc_min + 1));
+	       table->buffer_size);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	unsigned int num_threads =
+	    cvd_fill_table(table->buffer, adc_min, adc_max - adc_min + 1, R0,
+			   reference_resistance);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("generate_rtd_table: generated %u entries in %.3f ms "
+	       "(%u threads)\n",
+	       adc_max - adc_min + 1, elapsed_ms(&start, &end), num_threads);
+
+	table->data = table->buffer;
+	table->base = adc_min;
+	table->size = adc_max - adc_min + 1;
+
+	/* failing to cache the table is not fatal, only uncorrected tables
+	 * are cached */
+	rtd_cache_store(&key, table->data, table->base, table->size);
+
+	return apply_correction(table, correction);
+}
+
+/* Generate a fixed-point table with one int16 entry every `stride` ADC codes.
+ * Entries are stored in Q(frac_bits) format, where frac_bits is the largest
+ * value that still fits the temperature range into an int16. Queries linearly
+ * interpolate between neighbouring entries. */
+static int generate_fixed_table(struct rtd_table_data *table,
+				const double temperature_min,
+				const double temperature_max,
+				const unsigned int R0,
+				const unsigned int reference_resistance,
+				const unsigned int stride,
+				const double *correction)
+{
+	assert(table != NULL);
+
+	if (check_parameters(temperature_min, temperature_max, R0) == -1) {
+		return -1;
+	}
+
+	if (stride == 0 || stride > RTD_TABLE_MAX_STRIDE ||
+	    (stride & (stride - 1))) {
+		fprintf(stderr, "generate_fixed_table: invalid stride %u "
+				"(must be a power of two <= %d)\n",
+			stride, RTD_TABLE_MAX_STRIDE);
+		return -1;
+	}
+
+	unsigned int adc_min, adc_max;
+	cvd_adc_range(temperature_min, temperature_max, R0,
+		      reference_resistance, &adc_min, &adc_max);
+
+	unsigned int shift = 0;
+	while ((1u << shift) < stride) {
+		++shift;
+	}
 
-	unsigned int adc;
-	for (adc = adc_min; adc < adc_max; ++adc) {
-		double resistance =
-		    resistance_from_adc(adc, reference_resistance);
-		table->data[adc - adc_min] =
-		    newton_approx(resistance, R0, 1.0e-6);
+	/* one extra entry past the last ADC code, so interpolation never
+	 * reads out of bounds */
+	const unsigned int size = adc_max - adc_min + 1;
+	const unsigned int count = ((size - 1) >> shift) + 2;
+
+	/* Reuse a precompiled float table if there is one, otherwise solve for
+	 * each entry. The last entry may lie beyond the precompiled table (or
+	 * even beyond ADC code 32767), so it is always solved for. */
+	const struct rtd_profile *profile = find_profile(
+	    temperature_min, temperature_max, R0, reference_resistance);
+	double *values = malloc(sizeof(double) * count);
+	if (!values) {
+		fprintf(stderr,
+			"generate_fixed_table: failed to allocate table.\n");
+		return -1;
 	}
 
+	double max_abs = 0.0;
+	unsigned int i;
+	for (i = 0; i < count; ++i) {
+		const unsigned int adc = adc_min + (i << shift);
+		if (profile && adc - profile->base < profile->size) {
+			values[i] = profile->data[adc - profile->base];
+		} else {
+			const double resistance =
+			    ((double)adc * reference_resistance) / 32768.0;
+			values[i] = newton_approx(
+			    resistance, R0, 1.0e-6,
+			    callendar_van_dusen_inverse(resistance / R0));
+		}
+		values[i] = correct(correction, values[i]);
+		if (fabs(values[i]) > max_abs) {
+			max_abs = fabs(values[i]);
+		}
+	}
+
+	int frac_bits = 14;
+	while (frac_bits > 0 && max_abs * (1 << frac_bits) > INT16_MAX) {
+		--frac_bits;
+	}
+	if (max_abs * (1 << frac_bits) > INT16_MAX) {
+		fprintf(stderr, "generate_fixed_table: temperature range "
+				"exceeds fixed-point format\n");
+		free(values);
+		return -1;
+	}
+
+	table->buffer_size = sizeof(int16_t) * count;
+	int16_t *fixed = malloc(table->buffer_size);
+	if (!fixed) {
+		fprintf(stderr,
+			"generate_fixed_table: failed to allocate table.\n");
+		free(values);
+		return -1;
+	}
+	printf("generate_fixed_table: allocated %zu bytes for RTD table "
+	       "(stride %u, resolution %g \xB0""C)\n",
+	       table->buffer_size, stride, 1.0 / (1 << frac_bits));
+
+	for (i = 0; i < count; ++i) {
+		fixed[i] = (int16_t)lrint(values[i] * (1 << frac_bits));
+	}
+	free(values);
+
+	table->converter = RTD_CONVERTER_FIXED;
+	table->data = NULL;
+	table->fixed = fixed;
+	table->buffer = fixed;
 	table->base = adc_min;
-	table->size = adc_max - adc_min + 1;
-	table->min_temp = temperature_min;
-	table->max_temp = temperature_max;
+	table->size = size;
+	table->shift = shift;
+	table->scale = 1.0f / (float)(1u << (frac_bits + shift));
+	set_limits(table, temperature_min, temperature_max, correction);
+	memcpy(table->correction, correction, sizeof(table->correction));
+
+	return 0;
+}
+
+/* The analytic converter inverts the Callendar Van Dusen equation directly,
+ * so it needs neither table memory nor generation time */
+static int init_analytic(struct rtd_table_data *table,
+			 const double temperature_min,
+			 const double temperature_max, const unsigned int R0,
+			 const unsigned int reference_resistance,
+			 const double *correction)
+{
+	assert(table != NULL);
+
+	if (check_parameters(temperature_min, temperature_max, R0) == -1) {
+		return -1;
+	}
+
+	table->converter = RTD_CONVERTER_ANALYTIC;
+	table->data = NULL;
+	table->fixed = NULL;
+	table->buffer = NULL;
+	table->buffer_size = 0;
+	table->base = 0;
+	table->size = 32768;
+	table->shift = 0;
+	table->scale = 1.0f;
+	table->adc_ratio = (double)reference_resistance / (32768.0 * R0);
+	set_limits(table, temperature_min, temperature_max, correction);
+	memcpy(table->correction, correction, sizeof(table->correction));
 
 	return 0;
 }
 
+static const double IDENTITY[3] = { 0.0, 1.0, 0.0 };
+
+static void destroy_data(struct rtd_table_data *data)
+{
+	if (data) {
+		rtd_cache_unmap(&data->map);
+		free(data->buffer);
+		free(data);
+	}
+}
+
+static struct rtd_table_data *create_data(const rtd_table_t *table,
+					  const double *correction)
+{
+	struct rtd_table_data *data =
+	    (struct rtd_table_data *)malloc(sizeof(struct rtd_table_data));
+	if (!data) {
+		fprintf(stderr, "rtd_table_create: out of memory\n");
+		return NULL;
+	}
+	memset(data, 0, sizeof(struct rtd_table_data));
+
+	int rc;
+	switch (table->converter) {
+	case RTD_CONVERTER_TABLE:
+		rc = generate_rtd_table(data, table->temperature_min,
+					table->temperature_max, table->R0,
+					table->reference_resistance,
+					correction);
+		break;
+	case RTD_CONVERTER_FIXED:
+		rc = generate_fixed_table(data, table->temperature_min,
+					  table->temperature_max, table->R0,
+					  table->reference_resistance,
+					  table->stride, correction);
+		break;
+	case RTD_CONVERTER_ANALYTIC:
+		rc = init_analytic(data, table->temperature_min,
+				   table->temperature_max, table->R0,
+				   table->reference_resistance, correction);
+		break;
+	default:
+		fprintf(stderr, "rtd_table_create: unknown converter %d\n",
+			(int)table->converter);
+		rc = -1;
+	}
+
+	if (rc == -1) {
+		destroy_data(data);
+		return NULL;
+	}
+	return data;
+}
+
+rtd_table_t *rtd_table_create(const double temperature_min,
+			      const double temperature_max,
+			      const unsigned int R0,
+			      const unsigned int reference_resistance)
+{
+	return rtd_table_create_converter(RTD_CONVERTER_TABLE, 1,
+					  temperature_min, temperature_max, R0,
+					  reference_resistance);
+}
+
+rtd_table_t *rtd_table_create_converter(const enum RTD_CONVERTER converter,
+					const unsigned int stride,
+					const double temperature_min,
+					const double temperature_max,
+					const unsigned int R0,
+					const unsigned int reference_resistance)
+{
+	/* the reader slots must not share cache lines with anything else */
+	rtd_table_t *table = (rtd_table_t *)aligned_alloc(
+	    RTD_TABLE_CACHE_LINE, sizeof(rtd_table_t));
+	if (!table) {
+		fprintf(stderr, "rtd_table_create: out of memory\n");
+		return NULL;
+	}
+	memset(table, 0, sizeof(rtd_table_t));
+
+	table->converter = converter;
+	table->stride = stride;
+	table->temperature_min = temperature_min;
+	table->temperature_max = temperature_max;
+	table->R0 = R0;
+	table->reference_resistance = reference_resistance;
+
+	struct rtd_table_data *data = create_data(table, IDENTITY);
+	if (!data) {
+		free(table);
+		return NULL;
+	}
+
+	atomic_init(&table->current, data);
+	atomic_init(&table->shared_readers, 0);
+	unsigned int i;
+	for (i = 0; i < RTD_TABLE_READER_SLOTS; ++i) {
+		atomic_init(&table->readers[i].data, NULL);
+	}
+	atomic_init(&table->calibration_done, 0);
+	pthread_mutex_init(&table->calibration_mtx, NULL);
+
+	return table;
+}
+
+void rtd_table_destroy(rtd_table_t *table)
+{
+	if (table) {
+		pthread_mutex_lock(&table->calibration_mtx);
+		if (table->calibration_running) {
+			pthread_join(table->calibration_thread, NULL);
+		}
+		pthread_mutex_unlock(&table->calibration_mtx);
+		pthread_mutex_destroy(&table->calibration_mtx);
+
+		destroy_data(atomic_load(&table->current));
+		free(table);
+	}
+}
+
+/* Reader slot indices of the live threads, one bit each. A thread claims
+ * an index with its first table lookup and gives it back when it exits. */
+#define SHARED_READER_SLOT RTD_TABLE_READER_SLOTS
+static atomic_uint reader_slots_used;
+static pthread_once_t reader_once = PTHREAD_ONCE_INIT;
+static pthread_key_t reader_key;
+static _Thread_local int reader_slot = -1;
+
+/* Set if table updates can make all threads of the process execute a
+ * memory barrier. Readers then get away without one of their own. */
+static int update_barrier;
+
+static long membarrier(const int cmd)
+{
+	return syscall(__NR_membarrier, cmd, 0);
+}
+
+static void release_reader_slot(void *value)
+{
+	const unsigned int slot = (uintptr_t)value - 1;
+	atomic_fetch_and(&reader_slots_used, ~(1u << slot));
+}
+
+static void init_readers(void)
+{
+	pthread_key_create(&reader_key, &release_reader_slot);
+
+	const long cmds = membarrier(MEMBARRIER_CMD_QUERY);
+	update_barrier =
+	    cmds > 0 && (cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+	    membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED) == 0;
+}
+
+static unsigned int claim_reader_slot(void)
+{
+	unsigned int used = atomic_load(&reader_slots_used);
+	unsigned int slot;
+
+	pthread_once(&reader_once, &init_readers);
+	for (slot = 0; slot < RTD_TABLE_READER_SLOTS; ++slot) {
+		if (used & (1u << slot)) {
+			continue;
+		}
+		if (atomic_compare_exchange_strong(&reader_slots_used, &used,
+						   used | (1u << slot))) {
+			pthread_setspecific(reader_key,
+					    (void *)(uintptr_t)(slot + 1));
+			return slot;
+		}
+		/* used was reloaded, look at the slot again */
+		--slot;
+	}
+	return SHARED_READER_SLOT;
+}
+
+/* Readers publish the table data they use in their own slot and check that
+ * it is still the current one, so a table update either sees the slot or
+ * the reader sees the update. They never block, never write memory other
+ * threads write and never wait for each other or for a table update. The
+ * barrier between publishing and checking is usually left to the update,
+ * see synchronize(). */
+static inline const struct rtd_table_data *
+read_lock(const rtd_table_t *table, unsigned int *slot)
+{
+	/* the reader slots are the only mutable part of a table */
+	rtd_table_t *t = (rtd_table_t *)table;
+
+	if (reader_slot < 0) {
+		reader_slot = claim_reader_slot();
+	}
+	*slot = reader_slot;
+
+	if (*slot == SHARED_READER_SLOT) {
+		atomic_fetch_add(&t->shared_readers, 1);
+		return atomic_load(&t->current);
+	}
+
+	struct rtd_table_reader *reader = &t->readers[*slot];
+	const struct rtd_table_data *data;
+	assert(atomic_load_explicit(&reader->data, memory_order_relaxed) ==
+	       NULL);
+	do {
+		data = atomic_load_explicit(&t->current, memory_order_acquire);
+		if (update_barrier) {
+			atomic_store_explicit(&reader->data, data,
+					      memory_order_relaxed);
+			atomic_signal_fence(memory_order_seq_cst);
+		} else {
+			atomic_store(&reader->data, data);
+		}
+	} while (atomic_load_explicit(&t->current, memory_order_relaxed) !=
+		 data);
+	return data;
+}
+
+static inline void read_unlock(const rtd_table_t *table,
+			       const unsigned int slot)
+{
+	rtd_table_t *t = (rtd_table_t *)table;
+
+	if (slot == SHARED_READER_SLOT) {
+		atomic_fetch_sub(&t->shared_readers, 1);
+	} else {
+		atomic_store_explicit(&t->readers[slot].data, NULL,
+				      memory_order_release);
+	}
+}
+
+const struct rtd_table_data *rtd_table_read_lock(const rtd_table_t *table,
+						 unsigned int *slot)
+{
+	return read_lock(table, slot);
+}
+
+void rtd_table_read_unlock(const rtd_table_t *table, const unsigned int slot)
+{
+	read_unlock(table, slot);
+}
+
+/* Wait until no reader holds old, which was replaced before the call. The
+ * barrier on all threads makes the slots of the readers that loaded old
+ * visible here, or the replacement visible to them. A reader that
+ * published old after the replacement sees the new data when it checks
+ * and drops old without using it. Readers in the shared slot counted
+ * themselves before loading the data. */
+static void synchronize(rtd_table_t *table, const struct rtd_table_data *old)
+{
+	const struct timespec delay = { 0, 1000000 };
+	unsigned int i;
+
+	pthread_once(&reader_once, &init_readers);
+	if (update_barrier &&
+	    membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED) != 0) {
+		/* can't happen once registered */
+		abort();
+	}
+
+	for (i = 0; i < RTD_TABLE_READER_SLOTS; ++i) {
+		while (atomic_load_explicit(&table->readers[i].data,
+					    memory_order_acquire) == old) {
+			nanosleep(&delay, NULL);
+		}
+	}
+	while (atomic_load(&table->shared_readers) != 0) {
+		nanosleep(&delay, NULL);
+	}
+}
+
+/* Fit a correction polynomial T' = c0 + c1 T + c2 T^2 through the
+ * calibration points (offset, linear or quadratic correction) */
+static int fit_correction(const struct rtd_calibration_point *points,
+			  const unsigned int num_points, double *c)
+{
+	memcpy(c, IDENTITY, sizeof(IDENTITY));
+	if (num_points == 0) {
+		return 0;
+	}
+
+	unsigned int i, j;
+	for (i = 0; i < num_points; ++i) {
+		for (j = i + 1; j < num_points; ++j) {
+			if (fabs(points[i].measured - points[j].measured) <
+			    1.0) {
+				return -1;
+			}
+		}
+	}
+
+	const double m0 = points[0].measured, r0 = points[0].reference;
+	if (num_points == 1) {
+		c[0] = r0 - m0;
+		return 0;
+	}
+
+	/* Newton form r0 + d1 (T - m0) + d2 (T - m0)(T - m1) */
+	const double m1 = points[1].measured, r1 = points[1].reference;
+	const double d1 = (r1 - r0) / (m1 - m0);
+	double d2 = 0.0;
+	if (num_points == 3) {
+		const double m2 = points[2].measured, r2 = points[2].reference;
+		d2 = ((r2 - r1) / (m2 - m1) - d1) / (m2 - m0);
+	}
+
+	c[0] = r0 - d1 * m0 + d2 * m0 * m1;
+	c[1] = d1 - d2 * (m0 + m1);
+	c[2] = d2;
+	return 0;
+}
+
+static void *calibration_thread(void *user_data)
+{
+	rtd_table_t *table = (rtd_table_t *)user_data;
+
+	struct rtd_table_data *data =
+	    create_data(table, table->pending_correction);
+	if (data) {
+		struct rtd_table_data *old =
+		    atomic_exchange(&table->current, data);
+		synchronize(table, old);
+		destroy_data(old);
+		printf("rtd_table_calibrate: T' = %g + %g T + %g T^2\n",
+		       data->correction[0], data->correction[1],
+		       data->correction[2]);
+	} else {
+		fprintf(stderr, "rtd_table_calibrate: failed to build "
+				"calibrated table\n");
+	}
+
+	atomic_store(&table->calibration_done, 1);
+	return NULL;
+}
+
+/* Apply a one, two or three point calibration. Each point pairs a
+ * temperature reported by the uncalibrated table with the temperature of a
+ * reference thermometer, i.e. a new calibration replaces the previous one
+ * and calibrating with no points removes it. The calibrated table is built
+ * in the background and replaces the current one without blocking readers.
+ * Returns -1 with errno set to EINVAL for invalid points, or to EBUSY if a
+ * previous calibration is still being applied. */
+int rtd_table_calibrate(rtd_table_t *table,
+			const struct rtd_calibration_point *points,
+			const unsigned int num_points)
+{
+	assert(table != NULL);
+	assert(num_points == 0 || points != NULL);
+
+	double correction[3];
+	if (num_points > 3 ||
+	    fit_correction(points, num_points, correction) == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&table->calibration_mtx);
+	if (table->calibration_running) {
+		if (!atomic_load(&table->calibration_done)) {
+			pthread_mutex_unlock(&table->calibration_mtx);
+			errno = EBUSY;
+			return -1;
+		}
+		pthread_join(table->calibration_thread, NULL);
+		table->calibration_running = 0;
+	}
+
+	memcpy(table->pending_correction, correction, sizeof(correction));
+	atomic_store(&table->calibration_done, 0);
+	int rc = pthread_create(&table->calibration_thread, NULL,
+				&calibration_thread, table);
+	if (rc == 0) {
+		table->calibration_running = 1;
+	}
+	pthread_mutex_unlock(&table->calibration_mtx);
+
+	if (rc != 0) {
+		errno = rc;
+		return -1;
+	}
+	return 0;
+}
+
+void rtd_table_get_calibration(const rtd_table_t *table, double *correction)
+{
+	assert(table != NULL);
+	assert(correction != NULL);
+
+	unsigned int slot;
+	const struct rtd_table_data *data = read_lock(table, &slot);
+	memcpy(correction, data->correction, sizeof(data->correction));
+	read_unlock(table, slot);
+}
+
+enum RTD_CONVERTER rtd_table_get_converter(const rtd_table_t *table)
+{
+	assert(table != NULL);
+	return table->converter;
+}
+
+/* Number of bytes used by the table data */
+size_t rtd_table_footprint(const rtd_table_t *table)
+{
+	assert(table != NULL);
+
+	unsigned int slot;
+	const struct rtd_table_data *data = read_lock(table, &slot);
+	size_t size = 0;
+	switch (data->converter) {
+	case RTD_CONVERTER_TABLE:
+		size = sizeof(float) * data->size;
+		break;
+	case RTD_CONVERTER_FIXED:
+		size = sizeof(int16_t) *
+		       (((data->size - 1) >> data->shift) + 2);
+		break;
+	case RTD_CONVERTER_ANALYTIC:
+		break;
+	}
+	read_unlock(table, slot);
+	return size;
+}
+
+static float analytic_lookup(const struct rtd_table_data *table,
+			     const double adc)
+{
+	const double T = correct(
+	    table->correction,
+	    callendar_van_dusen_inverse(adc * table->adc_ratio));
+	if (T < table->min_temp) {
+		return table->min_temp;
+	} else if (T > table->max_temp) {
+		return table->max_temp;
+	}
+	return T;
+}
+
+static inline float data_lookup(const struct rtd_table_data *table,
+				const unsigned int adc)
+{
+	if (table->converter == RTD_CONVERTER_ANALYTIC) {
+		return analytic_lookup(table, adc);
+	}
+
+	if (adc < table->base) {
+		return table->min_temp;
+	} else if ((adc - table->base) >= table->size) {
+		return table->max_temp;
+	}
+
+	if (table->converter == RTD_CONVERTER_FIXED) {
+		const unsigned int offset = adc - table->base;
+		const unsigned int i = offset >> table->shift;
+		const int32_t frac = offset & ((1u << table->shift) - 1);
+		const int32_t a = table->fixed[i];
+		const int32_t b = table->fixed[i + 1];
+		/* a may be negative, scale it by multiplying, left shifting
+		 * a negative value is undefined */
+		return (a * (int32_t)(1u << table->shift) + (b - a) * frac) *
+		       table->scale;
+	}
+	return table->data[adc - table->base];
+}
+
+float rtd_table_data_lookup(const struct rtd_table_data *table,
+			    const unsigned int adc)
+{
+	return data_lookup(table, adc);
+}
+
+float rtd_table_lookup(const rtd_table_t *table, const unsigned int adc)
+{
+	assert(table != NULL);
+	assert(adc < 32768);
+
+	unsigned int slot;
+	const struct rtd_table_data *data = read_lock(table, &slot);
+	const float T = data_lookup(data, adc);
+	read_unlock(table, slot);
+	return T;
+}
+
+static float data_lookupf(const struct rtd_table_data *table, const float adc)
+{
+	if (table->converter == RTD_CONVERTER_ANALYTIC) {
+		return analytic_lookup(table, adc);
+	}
+
+	if (adc < table->base) {
+		return table->min_temp;
+	} else if (adc - table->base >= table->size - 1) {
+		return rtd_table_data_lookup(table,
+					     table->base + table->size - 1);
+	}
+
+	const float offset = adc - table->base;
+	if (table->converter == RTD_CONVERTER_FIXED) {
+		const float position = offset / (1u << table->shift);
+		const unsigned int i = (unsigned int)position;
+		const float a = table->fixed[i];
+		const float b = table->fixed[i + 1];
+		return (a + (b - a) * (position - i)) * table->scale *
+		       (1u << table->shift);
+	}
+
+	const unsigned int i = (unsigned int)offset;
+	const float a = table->data[i];
+	const float b = table->data[i + 1];
+	return a + (b - a) * (offset - i);
+}
+
+/* Convert a fractional ADC value, e.g. the output of a filter, by
+ * interpolating between table entries (or evaluating the analytic inverse) */
+float rtd_table_lookupf(const rtd_table_t *table, const float adc)
+{
+	assert(table != NULL);
+
+	unsigned int slot;
+	const struct rtd_table_data *data = read_lock(table, &slot);
+	const float T = data_lookupf(data, adc);
+	read_unlock(table, slot);
+	return T;
+}
+
 int rtd_table_init(const double temperature_min, const double temperature_max,
-		   const int R0, const int reference_resistance)
+		   const unsigned int R0,
+		   const unsigned int reference_resistance)
 {
-	assert(RTD_TABLE.data == NULL);
+	assert(RTD_TABLE == NULL);
 
-	struct rtd_table table;
-	if (generate_rtd_table(&table, temperature_min, temperature_max, R0,
-			       reference_resistance) == -1) {
+	RTD_TABLE = rtd_table_create(temperature_min, temperature_max, R0,
+				     reference_resistance);
+	if (!RTD_TABLE) {
 		fprintf(stderr, "failed to initialize RTD table\n");
 		return -1;
 	}
-	memcpy(&RTD_TABLE, &table, sizeof(table));
 	return 0;
 }
 
 void rtd_table_free()
 {
-	free(RTD_TABLE.data);
+	rtd_table_destroy(RTD_TABLE);
+	RTD_TABLE = NULL;
 }
 
 float rtd_table_query(const unsigned int adc)
 {
-	assert(adc < 32768);
-	assert(RTD_TABLE.data != NULL);
+	assert(RTD_TABLE != NULL);
+	return rtd_table_lookup(RTD_TABLE, adc);
+}
 
-	if (adc < RTD_TABLE.base) {
-		return RTD_TABLE.min_temp;
-	} else if ((adc - RTD_TABLE.base) >= RTD_TABLE.size) {
-		return RTD_TABLE.max_temp;
-	}
-	return RTD_TABLE.data[adc - RTD_TABLE.base];
+void rtd_table_query_batch(const uint16_t *adc, float *out, const size_t n)
+{
+	assert(RTD_TABLE != NULL);
+	rtd_table_lookup_batch(RTD_TABLE, adc, out, n);
+}
+
+/* Directory for caching tables generated at runtime, NULL disables caching */
+void rtd_table_set_cache_dir(const char *dir)
+{
+	rtd_cache_set_dir(dir);
 }
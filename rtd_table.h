@@ -20,9 +20,62 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #ifndef SOUSVIDED_RTD_TABLE_H
 #define SOUSVIDED_RTD_TABLE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct rtd_table rtd_table_t;
+
+enum RTD_CONVERTER {
+	/* one float per ADC code in the temperature range */
+	RTD_CONVERTER_TABLE = 0,
+	/* one fixed-point int16 per `stride` ADC codes, interpolated linearly.
+	 * Larger strides trade accuracy for a smaller footprint. */
+	RTD_CONVERTER_FIXED,
+	/* no table at all, inverts the Callendar Van Dusen equation on every
+	 * query (closed form for T >= 0, fitted polynomial below) */
+	RTD_CONVERTER_ANALYTIC
+};
+
+#define RTD_TABLE_MAX_STRIDE 256
+
+/* RTD table handles can be queried concurrently from multiple threads.
+ * Queries never block, not even while a calibration replaces the table. */
+rtd_table_t *rtd_table_create(const double temperature_min,
+			      const double temperature_max,
+			      const unsigned int R0,
+			      const unsigned int reference_resistance);
+rtd_table_t *rtd_table_create_converter(
+    const enum RTD_CONVERTER converter, const unsigned int stride,
+    const double temperature_min, const double temperature_max,
+    const unsigned int R0, const unsigned int reference_resistance);
+float rtd_table_lookup(const rtd_table_t *table, const unsigned int adc);
+float rtd_table_lookupf(const rtd_table_t *table, const float adc);
+void rtd_table_lookup_batch(const rtd_table_t *table, const uint16_t *adc,
+			    float *out, const size_t n);
+void rtd_table_destroy(rtd_table_t *table);
+
+struct rtd_calibration_point
+{
+	double measured;  /* temperature reported without calibration */
+	double reference; /* temperature of the reference thermometer */
+};
+
+int rtd_table_calibrate(rtd_table_t *table,
+			const struct rtd_calibration_point *points,
+			const unsigned int num_points);
+void rtd_table_get_calibration(const rtd_table_t *table, double *correction);
+
+void rtd_table_set_cache_dir(const char *dir);
+
+enum RTD_CONVERTER rtd_table_get_converter(const rtd_table_t *table);
+size_t rtd_table_footprint(const rtd_table_t *table);
+
+/* Process wide default table, kept for callers that only need a single
+ * R0/reference resistor pair */
 int rtd_table_init(const double temperature_min, const double temperature_max,
 		   const unsigned int R0, const unsigned int reference_resistance);
 float rtd_table_query(unsigned int adc);
+void rtd_table_query_batch(const uint16_t *adc, float *out, const size_t n);
 void rtd_table_free();
 
 #endif /* SOUSVIDED_RTD_TABLE_H */
@@ -0,0 +1,368 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Batch conversion of ADC codes to temperatures.
+ *
+ * Four codes are converted at a time with NEON (ARMv7/ARMv8) or SSE2 (x86,
+ * with AVX2 gathers if enabled at compile time), the remainder and other
+ * targets (e.g. ARMv6) fall back to rtd_table_lookup(). The table converters
+ * produce the same results as rtd_table_lookup(); the vectorized analytic
+ * converter works in single instead of double precision, which adds an error
+ * of about 1e-4 degrees Celsius.
+ */
+
+#include "rtd_table.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cvd.h"
+#include "rtd_table_private.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RTD_BATCH_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#define RTD_BATCH_SSE2
+#endif
+
+#ifdef RTD_BATCH_NEON
+
+static inline int32x4_t load4(const uint16_t *adc)
+{
+	return vreinterpretq_s32_u32(vmovl_u16(vld1_u16(adc)));
+}
+
+static inline float32x4_t gather_float(const float *data, int32x4_t index)
+{
+	int32_t i[4];
+	vst1q_s32(i, index);
+	const float v[4] = { data[i[0]], data[i[1]], data[i[2]], data[i[3]] };
+	return vld1q_f32(v);
+}
+
+/* Load the fixed-point entries at index and index + 1 */
+static inline void gather_fixed(const int16_t *fixed, int32x4_t index,
+				int32x4_t *a, int32x4_t *b)
+{
+	int32_t i[4];
+	vst1q_s32(i, index);
+	const int32_t va[4] = { fixed[i[0]], fixed[i[1]], fixed[i[2]],
+				fixed[i[3]] };
+	const int32_t vb[4] = { fixed[i[0] + 1], fixed[i[1] + 1],
+				fixed[i[2] + 1], fixed[i[3] + 1] };
+	*a = vld1q_s32(va);
+	*b = vld1q_s32(vb);
+}
+
+static size_t batch_table(const struct rtd_table_data *t, const uint16_t *adc,
+			  float *out, const size_t n)
+{
+	const int32x4_t base = vdupq_n_s32(t->base);
+	const int32x4_t last = vdupq_n_s32(t->size - 1);
+	const int32x4_t zero = vdupq_n_s32(0);
+	const float32x4_t min = vdupq_n_f32(t->min_temp);
+	const float32x4_t max = vdupq_n_f32(t->max_temp);
+	const int32x4_t shift = vdupq_n_s32(t->shift);
+	const int32x4_t mask = vdupq_n_s32((1 << t->shift) - 1);
+	const float32x4_t scale = vdupq_n_f32(t->scale);
+
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		const int32x4_t offset = vsubq_s32(load4(adc + i), base);
+		const uint32x4_t below = vcltq_s32(offset, zero);
+		const uint32x4_t above = vcgtq_s32(offset, last);
+		const int32x4_t index =
+		    vminq_s32(vmaxq_s32(offset, zero), last);
+
+		float32x4_t v;
+		if (t->converter == RTD_CONVERTER_FIXED) {
+			int32x4_t a, b;
+			const int32x4_t entry =
+			    vshlq_s32(index, vnegq_s32(shift));
+			gather_fixed(t->fixed, entry, &a, &b);
+			const float32x4_t frac =
+			    vcvtq_f32_s32(vandq_s32(index, mask));
+			const float32x4_t fa =
+			    vcvtq_f32_s32(vshlq_s32(a, shift));
+			const float32x4_t d = vcvtq_f32_s32(vsubq_s32(b, a));
+			v = vmulq_f32(vmlaq_f32(fa, d, frac), scale);
+		} else {
+			v = gather_float(t->data, index);
+		}
+
+		v = vbslq_f32(above, max, v);
+		vst1q_f32(out + i, vbslq_f32(below, min, v));
+	}
+	return i;
+}
+
+static inline float32x4_t sqrt_f32x4(const float32x4_t x)
+{
+#ifdef __aarch64__
+	return vsqrtq_f32(x);
+#else
+	/* x * 1/sqrt(x), refine the estimate with two Newton-Raphson steps */
+	float32x4_t e = vrsqrteq_f32(x);
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+	e = vmulq_f32(e, vrsqrtsq_f32(vmulq_f32(x, e), e));
+	return vmulq_f32(x, e);
+#endif
+}
+
+static inline float32x4_t div_f32x4(const float32x4_t a,
+				    const float32x4_t b)
+{
+#ifdef __aarch64__
+	return vdivq_f32(a, b);
+#else
+	float32x4_t e = vrecpeq_f32(b);
+	e = vmulq_f32(e, vrecpsq_f32(b, e));
+	e = vmulq_f32(e, vrecpsq_f32(b, e));
+	return vmulq_f32(a, e);
+#endif
+}
+
+static size_t batch_analytic(const struct rtd_table_data *t,
+			     const uint16_t *adc, float *out,
+			     const size_t n)
+{
+	const float32x4_t ratio = vdupq_n_f32(t->adc_ratio);
+	const float32x4_t one = vdupq_n_f32(1.0f);
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+	const float32x4_t min = vdupq_n_f32(t->min_temp);
+	const float32x4_t max = vdupq_n_f32(t->max_temp);
+	const float32x4_t a = vdupq_n_f32(CVD_A);
+	const float32x4_t a2 = vdupq_n_f32(CVD_A * CVD_A);
+	const float32x4_t b4 = vdupq_n_f32(4.0 * CVD_B);
+	const float32x4_t c0 = vdupq_n_f32(t->correction[0]);
+	const float32x4_t c1 = vdupq_n_f32(t->correction[1]);
+	const float32x4_t c2 = vdupq_n_f32(t->correction[2]);
+
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		const float32x4_t x = vsubq_f32(
+		    vmulq_f32(vcvtq_f32_s32(load4(adc + i)), ratio), one);
+
+		/* T >= 0: 2x / (A + sqrt(A^2 + 4Bx)) */
+		const float32x4_t root = sqrt_f32x4(vmlaq_f32(a2, b4, x));
+		const float32x4_t q =
+		    div_f32x4(vaddq_f32(x, x), vaddq_f32(a, root));
+
+		/* T < 0: fitted polynomial */
+		float32x4_t p = vdupq_n_f32(CVD_INV_C5);
+		p = vmlaq_f32(vdupq_n_f32(CVD_INV_C4), p, x);
+		p = vmlaq_f32(vdupq_n_f32(CVD_INV_C3), p, x);
+		p = vmlaq_f32(vdupq_n_f32(CVD_INV_C2), p, x);
+		p = vmlaq_f32(vdupq_n_f32(CVD_INV_C1), p, x);
+		p = vmulq_f32(p, x);
+
+		float32x4_t v = vbslq_f32(vcltq_f32(x, zero), p, q);
+
+		/* calibration correction */
+		v = vmlaq_f32(c0, vmlaq_f32(c1, c2, v), v);
+		vst1q_f32(out + i, vminq_f32(vmaxq_f32(v, min), max));
+	}
+	return i;
+}
+
+#elif defined(RTD_BATCH_SSE2)
+
+static inline __m128i load4(const uint16_t *adc)
+{
+	return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)adc),
+				  _mm_setzero_si128());
+}
+
+static inline __m128 select_ps(const __m128 mask, const __m128 a,
+			       const __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline __m128i select_epi32(const __m128i mask, const __m128i a,
+				   const __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static inline __m128 gather_float(const float *data, const __m128i index)
+{
+#ifdef __AVX2__
+	return _mm_i32gather_ps(data, index, 4);
+#else
+	int32_t i[4];
+	_mm_storeu_si128((__m128i *)i, index);
+	return _mm_setr_ps(data[i[0]], data[i[1]], data[i[2]], data[i[3]]);
+#endif
+}
+
+/* Load the fixed-point entries at index and index + 1 with one 32 bit load
+ * per lane (the table always has an entry past the last index) */
+static inline void gather_fixed(const int16_t *fixed, const __m128i index,
+				__m128i *a, __m128i *b)
+{
+#ifdef __AVX2__
+	const __m128i pair = _mm_i32gather_epi32((const int *)fixed, index, 2);
+#else
+	int32_t i[4], v[4];
+	_mm_storeu_si128((__m128i *)i, index);
+	memcpy(&v[0], fixed + i[0], sizeof(int32_t));
+	memcpy(&v[1], fixed + i[1], sizeof(int32_t));
+	memcpy(&v[2], fixed + i[2], sizeof(int32_t));
+	memcpy(&v[3], fixed + i[3], sizeof(int32_t));
+	const __m128i pair = _mm_loadu_si128((const __m128i *)v);
+#endif
+	*a = _mm_srai_epi32(_mm_slli_epi32(pair, 16), 16);
+	*b = _mm_srai_epi32(pair, 16);
+}
+
+static size_t batch_table(const struct rtd_table_data *t, const uint16_t *adc,
+			  float *out, const size_t n)
+{
+	const __m128i base = _mm_set1_epi32(t->base);
+	const __m128i last = _mm_set1_epi32(t->size - 1);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 min = _mm_set1_ps(t->min_temp);
+	const __m128 max = _mm_set1_ps(t->max_temp);
+	const __m128i shift = _mm_cvtsi32_si128(t->shift);
+	const __m128i mask = _mm_set1_epi32((1 << t->shift) - 1);
+	const __m128 scale = _mm_set1_ps(t->scale);
+
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		const __m128i offset = _mm_sub_epi32(load4(adc + i), base);
+		const __m128i below = _mm_cmplt_epi32(offset, zero);
+		const __m128i above = _mm_cmpgt_epi32(offset, last);
+		const __m128i index = select_epi32(
+		    above, last, _mm_andnot_si128(below, offset));
+
+		__m128 v;
+		if (t->converter == RTD_CONVERTER_FIXED) {
+			__m128i a, b;
+			gather_fixed(t->fixed, _mm_srl_epi32(index, shift), &a,
+				     &b);
+			const __m128 frac =
+			    _mm_cvtepi32_ps(_mm_and_si128(index, mask));
+			const __m128 fa =
+			    _mm_cvtepi32_ps(_mm_sll_epi32(a, shift));
+			const __m128 d = _mm_cvtepi32_ps(_mm_sub_epi32(b, a));
+			v = _mm_mul_ps(_mm_add_ps(fa, _mm_mul_ps(d, frac)),
+				       scale);
+		} else {
+			v = gather_float(t->data, index);
+		}
+
+		v = select_ps(_mm_castsi128_ps(above), max, v);
+		_mm_storeu_ps(out + i,
+			      select_ps(_mm_castsi128_ps(below), min, v));
+	}
+	return i;
+}
+
+static size_t batch_analytic(const struct rtd_table_data *t,
+			     const uint16_t *adc, float *out,
+			     const size_t n)
+{
+	const __m128 ratio = _mm_set1_ps(t->adc_ratio);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 min = _mm_set1_ps(t->min_temp);
+	const __m128 max = _mm_set1_ps(t->max_temp);
+	const __m128 a = _mm_set1_ps(CVD_A);
+	const __m128 a2 = _mm_set1_ps(CVD_A * CVD_A);
+	const __m128 b4 = _mm_set1_ps(4.0 * CVD_B);
+	const __m128 c0 = _mm_set1_ps(t->correction[0]);
+	const __m128 c1 = _mm_set1_ps(t->correction[1]);
+	const __m128 c2 = _mm_set1_ps(t->correction[2]);
+
+	size_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		const __m128 x = _mm_sub_ps(
+		    _mm_mul_ps(_mm_cvtepi32_ps(load4(adc + i)), ratio), one);
+
+		/* T >= 0: 2x / (A + sqrt(A^2 + 4Bx)) */
+		const __m128 root =
+		    _mm_sqrt_ps(_mm_add_ps(a2, _mm_mul_ps(b4, x)));
+		const __m128 q =
+		    _mm_div_ps(_mm_add_ps(x, x), _mm_add_ps(a, root));
+
+		/* T < 0: fitted polynomial */
+		__m128 p = _mm_set1_ps(CVD_INV_C5);
+		p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(CVD_INV_C4));
+		p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(CVD_INV_C3));
+		p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(CVD_INV_C2));
+		p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(CVD_INV_C1));
+		p = _mm_mul_ps(p, x);
+
+		__m128 v = select_ps(_mm_cmplt_ps(x, zero), p, q);
+
+		/* calibration correction */
+		v = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c2, v), c1), v),
+			       c0);
+		_mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(v, min), max));
+	}
+	return i;
+}
+
+#else
+
+static size_t batch_table(const struct rtd_table_data *t, const uint16_t *adc,
+			  float *out, const size_t n)
+{
+	return 0;
+}
+
+static size_t batch_analytic(const struct rtd_table_data *t,
+			     const uint16_t *adc, float *out,
+			     const size_t n)
+{
+	return 0;
+}
+
+#endif
+
+void rtd_table_lookup_batch(const rtd_table_t *table, const uint16_t *adc,
+			    float *out, const size_t n)
+{
+	assert(table != NULL);
+	assert(n == 0 || (adc != NULL && out != NULL));
+
+	/* the whole batch is converted with the same version of the table */
+	unsigned int slot;
+	const struct rtd_table_data *data = rtd_table_read_lock(table, &slot);
+
+	size_t i;
+	if (data->converter == RTD_CONVERTER_ANALYTIC) {
+		i = batch_analytic(data, adc, out, n);
+	} else {
+		i = batch_table(data, adc, out, n);
+	}
+
+	for (; i < n; ++i) {
+		out[i] = rtd_table_data_lookup(data, adc[i]);
+	}
+
+	rtd_table_read_unlock(table, slot);
+}
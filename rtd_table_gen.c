@@ -0,0 +1,118 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* Build-time RTD table generator.
+ *
+ * Usage: rtd_table_gen R0:REFERENCE_RESISTANCE:TEMP_MIN:TEMP_MAX ...
+ *
+ * Writes a C source file to stdout, which defines RTD_PROFILES (see
+ * rtd_profiles.h) with one const table per profile given on the command line.
+ * The tables end up in .rodata, so the daemon neither needs to allocate nor
+ * compute them at startup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cvd.h"
+
+static int parse_profile(const char *arg, unsigned int *R0,
+			 unsigned int *reference_resistance,
+			 double *temperature_min, double *temperature_max)
+{
+	char tail;
+	if (sscanf(arg, "%u:%u:%lf:%lf%c", R0, reference_resistance,
+		   temperature_min, temperature_max, &tail) != 4) {
+		return -1;
+	}
+
+	if (*R0 < 100 || *reference_resistance == 0 ||
+	    *temperature_min >= *temperature_max) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int *sizes = calloc(argc, sizeof(unsigned int));
+	unsigned int *bases = calloc(argc, sizeof(unsigned int));
+	if (!sizes || !bases) {
+		fprintf(stderr, "rtd_table_gen: out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("/* generated by rtd_table_gen, do not edit */\n\n");
+	printf("#include \"rtd_profiles.h\"\n\n");
+
+	int i;
+	for (i = 1; i < argc; ++i) {
+		unsigned int R0, reference_resistance;
+		double temperature_min, temperature_max;
+		if (parse_profile(argv[i], &R0, &reference_resistance,
+				  &temperature_min, &temperature_max) == -1) {
+			fprintf(stderr, "rtd_table_gen: invalid profile '%s' "
+					"(expected R0:RREF:TMIN:TMAX)\n",
+				argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		unsigned int adc_min, adc_max;
+		cvd_adc_range(temperature_min, temperature_max, R0,
+			      reference_resistance, &adc_min, &adc_max);
+		bases[i] = adc_min;
+		sizes[i] = adc_max - adc_min + 1;
+
+		float *data = malloc(sizeof(float) * sizes[i]);
+		if (!data) {
+			fprintf(stderr, "rtd_table_gen: out of memory\n");
+			return EXIT_FAILURE;
+		}
+		cvd_fill_table(data, adc_min, sizes[i], R0,
+			       reference_resistance);
+
+		printf("/* %s */\n", argv[i]);
+		printf("static const float RTD_PROFILE_%d[%u] = {", i,
+		       sizes[i]);
+		unsigned int j;
+		for (j = 0; j < sizes[i]; ++j) {
+			printf("%s%.9g,", (j % 6) ? " " : "\n\t", data[j]);
+		}
+		printf("\n};\n\n");
+		free(data);
+	}
+
+	printf("const struct rtd_profile RTD_PROFILES[] = {\n");
+	for (i = 1; i < argc; ++i) {
+		unsigned int R0, reference_resistance;
+		double temperature_min, temperature_max;
+		parse_profile(argv[i], &R0, &reference_resistance,
+			      &temperature_min, &temperature_max);
+		printf("\t{ %u, %u, %.17g, %.17g, %u, %u, RTD_PROFILE_%d },\n",
+		       R0, reference_resistance, temperature_min,
+		       temperature_max, bases[i], sizes[i], i);
+	}
+	printf("\t{ 0, 0, 0.0, 0.0, 0, 0, (const float *)0 }\n};\n\n");
+	printf("const unsigned int RTD_PROFILES_COUNT = %d;\n", argc - 1);
+
+	free(bases);
+	free(sizes);
+	return EXIT_SUCCESS;
+}
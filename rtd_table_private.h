@@ -0,0 +1,99 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_RTD_TABLE_PRIVATE_H
+#define SOUSVIDED_RTD_TABLE_PRIVATE_H
+
+/* Layout of rtd_table_t, shared between rtd_table.c and the batch conversion
+ * code in rtd_table_batch.c. Not part of the public interface. */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+
+#include "rtd_cache.h"
+#include "rtd_table.h"
+
+/* One immutable version of a table. Calibration publishes a new version and
+ * frees the old one once no reader can use it anymore. */
+struct rtd_table_data
+{
+	enum RTD_CONVERTER converter;
+	const float *data;     /* RTD_CONVERTER_TABLE */
+	const int16_t *fixed;  /* RTD_CONVERTER_FIXED */
+	void *buffer; /* only set if the table was generated at runtime */
+	size_t buffer_size;
+	struct rtd_cache_map map; /* only set if mapped from the cache */
+	unsigned int base;
+	unsigned int size;
+	unsigned int shift; /* log2 of the ADC stride between fixed entries */
+	float scale;        /* fixed-point entry to degrees Celsius */
+	double adc_ratio;   /* ADC code to R / R0 (RTD_CONVERTER_ANALYTIC) */
+	double correction[3]; /* calibration T' = c0 + c1 T + c2 T^2 */
+	float min_temp;
+	float max_temp;
+};
+
+/* Reader slots per table. Every thread that reads tables owns one slot
+ * index for its lifetime, threads beyond RTD_TABLE_READER_SLOTS share a
+ * counter instead. */
+#ifndef RTD_TABLE_READER_SLOTS
+#define RTD_TABLE_READER_SLOTS 32
+#endif
+#define RTD_TABLE_CACHE_LINE 64
+
+/* The table data a thread is reading, NULL if none. Only written by the
+ * owning thread and on a cache line of its own. */
+struct rtd_table_reader
+{
+	_Atomic(const struct rtd_table_data *) data;
+} __attribute__((aligned(RTD_TABLE_CACHE_LINE)));
+
+struct rtd_table
+{
+	/* RCU style publication of the current table data */
+	_Atomic(struct rtd_table_data *) current;
+	atomic_uint shared_readers;
+	struct rtd_table_reader readers[RTD_TABLE_READER_SLOTS];
+
+	/* parameters to regenerate the table with */
+	enum RTD_CONVERTER converter;
+	unsigned int stride;
+	double temperature_min;
+	double temperature_max;
+	unsigned int R0;
+	unsigned int reference_resistance;
+
+	pthread_mutex_t calibration_mtx;
+	pthread_t calibration_thread;
+	int calibration_running;
+	atomic_int calibration_done;
+	double pending_correction[3];
+};
+
+const struct rtd_table_data *rtd_table_read_lock(const rtd_table_t *table,
+						 unsigned int *slot);
+void rtd_table_read_unlock(const rtd_table_t *table, const unsigned int slot);
+
+float rtd_table_data_lookup(const struct rtd_table_data *table,
+			    const unsigned int adc);
+
+#endif /* SOUSVIDED_RTD_TABLE_PRIVATE_H */
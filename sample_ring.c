@@ -0,0 +1,155 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sample_ring.h"
+
+#include <assert.h>
+#include <string.h>
+
+_Static_assert((SAMPLE_RING_SIZE & (SAMPLE_RING_SIZE - 1)) == 0,
+	       "SAMPLE_RING_SIZE must be a power of two");
+
+#define SAMPLE_RING_MASK (SAMPLE_RING_SIZE - 1)
+
+void sample_ring_init(sample_ring_t *ring)
+{
+	assert(ring != NULL);
+
+	unsigned int i;
+	atomic_init(&ring->head, 0);
+	for (i = 0; i < SAMPLE_RING_SIZE; ++i) {
+		atomic_init(&ring->slots[i].sequence, 0);
+		memset(&ring->slots[i].sample, 0, sizeof(struct rtd_sample));
+	}
+}
+
+/* Publish a sample, overwriting the oldest one. Must only be called from a
+ * single thread. Returns the sequence number assigned to the sample. */
+uint32_t sample_ring_push(sample_ring_t *ring, const struct rtd_sample *sample)
+{
+	assert(ring != NULL);
+	assert(sample != NULL);
+
+	uint32_t sequence =
+	    atomic_load_explicit(&ring->head, memory_order_relaxed) + 1;
+	if (sequence == 0) {
+		/* 0 marks a slot that is being written */
+		sequence = 1;
+	}
+
+	struct sample_ring_slot *slot =
+	    &ring->slots[sequence & SAMPLE_RING_MASK];
+	atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->sample = *sample;
+	slot->sample.sequence = sequence;
+
+	atomic_store_explicit(&slot->sequence, sequence, memory_order_release);
+	atomic_store_explicit(&ring->head, sequence, memory_order_release);
+	return sequence;
+}
+
+/* Sequence number of the latest sample, 0 if the ring is empty */
+uint32_t sample_ring_head(const sample_ring_t *ring)
+{
+	assert(ring != NULL);
+	return atomic_load_explicit((atomic_uint *)&ring->head,
+				    memory_order_acquire);
+}
+
+/* Copy the sample with the given sequence number. Returns 0 if that sample
+ * was not published yet or was already overwritten, 1 otherwise. */
+int sample_ring_read(const sample_ring_t *ring, const uint32_t sequence,
+		     struct rtd_sample *sample)
+{
+	assert(ring != NULL);
+	assert(sample != NULL);
+
+	/* consumers only read the slot, the cast drops the const needed for
+	 * the atomic loads */
+	struct sample_ring_slot *slot =
+	    (struct sample_ring_slot *)&ring->slots[sequence &
+						    SAMPLE_RING_MASK];
+	if (sequence == 0 ||
+	    atomic_load_explicit(&slot->sequence, memory_order_acquire) !=
+		sequence) {
+		return 0;
+	}
+
+	*sample = slot->sample;
+
+	/* the copy is only valid if the producer didn't start overwriting
+	 * the slot in the meantime */
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&slot->sequence, memory_order_relaxed) ==
+	       sequence;
+}
+
+/* Copy the latest sample. Returns 0 if the ring is empty, 1 otherwise. */
+int sample_ring_latest(const sample_ring_t *ring, struct rtd_sample *sample)
+{
+	uint32_t sequence;
+
+	/* The producer has to lap the whole ring for the read to fail, which
+	 * takes SAMPLE_RING_SIZE conversions */
+	do {
+		sequence = sample_ring_head(ring);
+		if (sequence == 0) {
+			return 0;
+		}
+	} while (!sample_ring_read(ring, sequence, sample));
+	return 1;
+}
+
+/* Copy up to count of the most recent samples in chronological order.
+ * Returns the number of samples copied, which is less than count if the
+ * ring holds fewer samples or the oldest ones were overwritten while
+ * copying. */
+size_t sample_ring_window(const sample_ring_t *ring, struct rtd_sample *samples,
+			  const size_t count)
+{
+	assert(samples != NULL || count == 0);
+
+	size_t n = count;
+	if (n > SAMPLE_RING_SIZE - 1) {
+		/* the slot after the head may be being overwritten */
+		n = SAMPLE_RING_SIZE - 1;
+	}
+
+	const uint32_t head = sample_ring_head(ring);
+	if (n > head) {
+		n = head;
+	}
+
+	/* copy the newest samples first, so an overwrite only costs the
+	 * oldest ones */
+	size_t copied = 0;
+	while (copied < n &&
+	       sample_ring_read(ring, head - copied,
+				&samples[n - 1 - copied])) {
+		++copied;
+	}
+
+	if (copied < n) {
+		memmove(samples, samples + n - copied,
+			sizeof(struct rtd_sample) * copied);
+	}
+	return copied;
+}
@@ -0,0 +1,76 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_SAMPLE_RING_H
+#define SOUSVIDED_SAMPLE_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Number of samples kept in a ring, must be a power of two. At 50-60
+ * conversions per second this is about a second of history. */
+#ifndef SAMPLE_RING_SIZE
+#define SAMPLE_RING_SIZE 64
+#endif
+
+#define SAMPLE_RING_CACHE_LINE 64
+
+/* A single conversion result of an RTD converter */
+struct rtd_sample
+{
+	struct timespec timestamp; /* end of conversion (CLOCK_MONOTONIC) */
+	uint32_t sequence;         /* 1, 2, 3, ... (0 is never used) */
+	uint16_t rtd;
+	uint8_t fault;
+	float temperature;
+};
+
+struct sample_ring_slot
+{
+	atomic_uint sequence; /* sequence of the sample in the slot, 0 while
+			       * the producer is writing it */
+	struct rtd_sample sample;
+};
+
+/* Single producer, multiple consumer ring of the most recent samples.
+ * Consumers never block the producer or each other: each slot works like a
+ * seqlock, so a consumer that races with the producer overwriting a slot
+ * notices and retries or skips that sample. */
+struct sample_ring
+{
+	_Alignas(SAMPLE_RING_CACHE_LINE) atomic_uint head;
+	_Alignas(SAMPLE_RING_CACHE_LINE)
+	    struct sample_ring_slot slots[SAMPLE_RING_SIZE];
+};
+typedef struct sample_ring sample_ring_t;
+
+void sample_ring_init(sample_ring_t *ring);
+
+uint32_t sample_ring_push(sample_ring_t *ring, const struct rtd_sample *sample);
+
+uint32_t sample_ring_head(const sample_ring_t *ring);
+int sample_ring_read(const sample_ring_t *ring, const uint32_t sequence,
+		     struct rtd_sample *sample);
+int sample_ring_latest(const sample_ring_t *ring, struct rtd_sample *sample);
+size_t sample_ring_window(const sample_ring_t *ring, struct rtd_sample *samples,
+			  const size_t count);
+
+#endif /* SOUSVIDED_SAMPLE_RING_H */
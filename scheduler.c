@@ -0,0 +1,363 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+/* for CPU_SET() and pthread_attr_setaffinity_np() */
+#define _GNU_SOURCE
+
+#include "scheduler.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+#include <sys/mman.h>
+
+#include "trace.h"
+
+/* Time for scheduler_start() to create the threads before the first
+ * period begins */
+#define SCHEDULER_START_DELAY_US 10000
+
+static void timespec_add_us(struct timespec *t, const int64_t us)
+{
+	int64_t nsec = t->tv_nsec + us * 1000;
+	t->tv_sec += nsec / 1000000000;
+	nsec %= 1000000000;
+	if (nsec < 0) {
+		nsec += 1000000000;
+		--t->tv_sec;
+	}
+	t->tv_nsec = nsec;
+}
+
+/* end - start in us, negative if end is earlier */
+static int64_t elapsed_us(const struct timespec *start,
+			  const struct timespec *end)
+{
+	return (int64_t)(end->tv_sec - start->tv_sec) * 1000000 +
+	       (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+static void sleep_until(const struct timespec *deadline)
+{
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline,
+			       NULL) == EINTR) {
+	}
+}
+
+static void record_latency(struct scheduler_phase *phase, const int64_t us)
+{
+	const unsigned int latency = us > 0 ? us : 0;
+	unsigned int max = atomic_load(&phase->max_latency_us);
+	while (latency > max &&
+	       !atomic_compare_exchange_weak(&phase->max_latency_us, &max,
+					     latency)) {
+	}
+}
+
+/* Deadline of the phase after phase i, which may be the first one of the
+ * next period */
+static int next_deadline(const scheduler_task_t *task, const unsigned int i,
+			 const struct scheduler_slot *slot,
+			 struct timespec *deadline)
+{
+	unsigned int j;
+	for (j = i + 1; j < task->num_phases; ++j) {
+		if (task->phases[j].offset_us >= 0) {
+			*deadline = slot->start;
+			timespec_add_us(deadline, task->phases[j].offset_us);
+			return 0;
+		}
+	}
+	for (j = 0; j <= i; ++j) {
+		if (task->phases[j].offset_us >= 0) {
+			*deadline = slot->end;
+			timespec_add_us(deadline, task->phases[j].offset_us);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void run_phase(scheduler_task_t *task, const unsigned int i,
+		      struct scheduler_slot *slot)
+{
+	struct scheduler_phase *phase = &task->phases[i];
+	struct timespec now, next;
+
+	slot->deadline = slot->start;
+	timespec_add_us(&slot->deadline, phase->offset_us);
+	sleep_until(&slot->deadline);
+	if (atomic_load(&task->scheduler->stop)) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	record_latency(phase, elapsed_us(&slot->deadline, &now));
+	phase->fn(slot, phase->user_data);
+	atomic_fetch_add(&phase->runs, 1);
+
+	/* the callback may have moved the next phase */
+	if (next_deadline(task, i, slot, &next) == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const int64_t late_us = elapsed_us(&next, &now);
+		if (late_us > 0) {
+			atomic_fetch_add(&phase->overruns, 1);
+			fprintf(stderr, "scheduler: %s phase of %s overran by "
+					"%lld us\n",
+				phase->name, task->name, (long long)late_us);
+		}
+	}
+}
+
+static void *task_thread(void *user_data)
+{
+	scheduler_task_t *task = (scheduler_task_t *)user_data;
+	scheduler_t *s = task->scheduler;
+	struct scheduler_slot slot;
+	struct timespec now;
+	unsigned int i;
+
+	trace_thread_name(task->name);
+	slot.cycle = 0;
+	slot.start = s->epoch;
+	while (!atomic_load(&s->stop)) {
+		slot.end = slot.start;
+		timespec_add_us(&slot.end, s->period_us);
+
+		for (i = 0; i < task->num_phases && !atomic_load(&s->stop);
+		     ++i) {
+			if (task->phases[i].offset_us >= 0) {
+				run_phase(task, i, &slot);
+			}
+		}
+		atomic_fetch_add(&task->cycles, 1);
+
+		++slot.cycle;
+		slot.start = slot.end;
+
+		/* skip the periods that are already over instead of running
+		 * them back to back */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		const int64_t behind_us = elapsed_us(&slot.start, &now);
+		if (behind_us >= s->period_us) {
+			const uint64_t missed = behind_us / s->period_us;
+			timespec_add_us(&slot.start, missed * s->period_us);
+			slot.cycle += missed;
+			atomic_fetch_add(&task->missed_cycles, missed);
+			fprintf(stderr, "scheduler: %s missed %llu periods\n",
+				task->name, (unsigned long long)missed);
+		}
+	}
+	return NULL;
+}
+
+void scheduler_init(scheduler_t *s, const uint32_t period_us,
+		    const struct scheduler_options *options)
+{
+	const struct scheduler_options defaults = SCHEDULER_OPTIONS_DEFAULT;
+
+	assert(s != NULL);
+	assert(period_us > 0);
+
+	memset(s, 0, sizeof(*s));
+	s->period_us = period_us;
+	s->options = options ? *options : defaults;
+	atomic_init(&s->stop, 0);
+	s->initialized = 1;
+}
+
+void scheduler_cleanup(scheduler_t *s)
+{
+	assert(s != NULL);
+
+	if (s->initialized) {
+		scheduler_stop(s);
+		s->initialized = 0;
+	}
+}
+
+scheduler_task_t *scheduler_add_task(scheduler_t *s, const char *name)
+{
+	assert(s != NULL);
+	assert(s->initialized);
+	assert(name != NULL);
+
+	if (s->num_tasks == SCHEDULER_MAX_TASKS) {
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	scheduler_task_t *task = &s->tasks[s->num_tasks++];
+	task->name = name;
+	task->scheduler = s;
+	atomic_init(&task->cycles, 0);
+	atomic_init(&task->missed_cycles, 0);
+	return task;
+}
+
+/* Phases run in the order they were added. Returns the index of the phase
+ * for scheduler_set_phase_offset(). */
+int scheduler_add_phase(scheduler_task_t *task, const char *name,
+			const int64_t offset_us, scheduler_fn fn,
+			void *user_data)
+{
+	assert(task != NULL);
+	assert(!task->running);
+	assert(fn != NULL);
+
+	if (task->num_phases == SCHEDULER_MAX_PHASES) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	struct scheduler_phase *phase = &task->phases[task->num_phases];
+	phase->name = name;
+	phase->fn = fn;
+	phase->user_data = user_data;
+	phase->offset_us = offset_us;
+	atomic_init(&phase->runs, 0);
+	atomic_init(&phase->overruns, 0);
+	atomic_init(&phase->max_latency_us, 0);
+	return task->num_phases++;
+}
+
+/* Move a phase, or skip it with SCHEDULER_SKIP. Once the task runs, only
+ * its own phases may call this, the change applies to the current period if
+ * the phase hasn't run yet. The offset may exceed the period as long as the
+ * phase is due before the first phase of the next period. */
+void scheduler_set_phase_offset(scheduler_task_t *task,
+				const unsigned int phase,
+				const int64_t offset_us)
+{
+	assert(task != NULL);
+	assert(phase < task->num_phases);
+
+	task->phases[phase].offset_us = offset_us;
+}
+
+static int create_thread(scheduler_t *s, scheduler_task_t *task,
+			 const int realtime)
+{
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+
+	if (realtime) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = s->options.priority;
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	if (s->options.cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(s->options.cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+
+	const int rc = pthread_create(&task->thread, &attr, &task_thread, task);
+	pthread_attr_destroy(&attr);
+	return rc;
+}
+
+/* Start all tasks, the first period begins shortly after. Without the
+ * privileges for SCHED_FIFO or mlockall() the tasks run anyway. */
+int scheduler_start(scheduler_t *s)
+{
+	unsigned int i;
+
+	assert(s != NULL);
+	assert(s->initialized);
+
+	if (s->options.lock_memory &&
+	    mlockall(MCL_CURRENT | MCL_FUTURE) == -1) {
+		fprintf(stderr, "scheduler: failed to lock memory: %s\n",
+			strerror(errno));
+	}
+
+	atomic_store(&s->stop, 0);
+	clock_gettime(CLOCK_MONOTONIC, &s->epoch);
+	timespec_add_us(&s->epoch, SCHEDULER_START_DELAY_US);
+
+	int realtime = s->options.priority > 0;
+	for (i = 0; i < s->num_tasks; ++i) {
+		scheduler_task_t *task = &s->tasks[i];
+		int rc = create_thread(s, task, realtime);
+		if (rc == EPERM && realtime) {
+			fprintf(stderr, "scheduler: not permitted to use "
+					"SCHED_FIFO, running with normal "
+					"priority\n");
+			realtime = 0;
+			rc = create_thread(s, task, realtime);
+		}
+		if (rc != 0) {
+			fprintf(stderr, "scheduler: failed to start %s: %s\n",
+				task->name, strerror(rc));
+			scheduler_stop(s);
+			errno = rc;
+			return -1;
+		}
+		task->running = 1;
+	}
+	return 0;
+}
+
+/* Waits for the phases that are running to finish */
+void scheduler_stop(scheduler_t *s)
+{
+	unsigned int i;
+
+	assert(s != NULL);
+
+	atomic_store(&s->stop, 1);
+	for (i = 0; i < s->num_tasks; ++i) {
+		if (s->tasks[i].running) {
+			pthread_join(s->tasks[i].thread, NULL);
+			s->tasks[i].running = 0;
+		}
+	}
+}
+
+void scheduler_print_statistics(scheduler_t *s, FILE *stream)
+{
+	unsigned int i, j;
+
+	assert(s != NULL);
+	assert(stream != NULL);
+
+	for (i = 0; i < s->num_tasks; ++i) {
+		scheduler_task_t *task = &s->tasks[i];
+		fprintf(stream, "Scheduler %s: %llu periods of %u us, %llu "
+				"missed\n",
+			task->name, (unsigned long long)task->cycles,
+			s->period_us, (unsigned long long)task->missed_cycles);
+		for (j = 0; j < task->num_phases; ++j) {
+			struct scheduler_phase *phase = &task->phases[j];
+			fprintf(stream, "  %-10s %llu runs, %llu overruns, max "
+					"latency %u us\n",
+				phase->name, (unsigned long long)phase->runs,
+				(unsigned long long)phase->overruns,
+				atomic_load(&phase->max_latency_us));
+		}
+	}
+}
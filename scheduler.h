@@ -0,0 +1,123 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_SCHEDULER_H
+#define SOUSVIDED_SCHEDULER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <pthread.h>
+
+/* Periodic scheduler on an absolute time grid. Every task is a thread that
+ * runs its phases in order once per period, each phase at a fixed offset
+ * from the start of the period. All tasks share the period and the start
+ * time, so they can't drift relative to each other. Deadlines are absolute,
+ * a phase that runs late doesn't shift the phases after it. */
+
+#define SCHEDULER_MAX_TASKS 4
+#define SCHEDULER_MAX_PHASES 4
+
+/* Phase offset that skips the phase in the current period */
+#define SCHEDULER_SKIP -1
+
+/* What a phase callback gets to know about the period it runs in */
+struct scheduler_slot
+{
+	uint64_t cycle;
+	struct timespec start;    /* of the period */
+	struct timespec deadline; /* of the phase */
+	struct timespec end;      /* start of the next period */
+};
+
+typedef void (*scheduler_fn)(const struct scheduler_slot *, void *);
+
+struct scheduler_phase
+{
+	const char *name;
+	scheduler_fn fn;
+	void *user_data;
+	int64_t offset_us; /* owned by the task's thread once started */
+
+	atomic_ullong runs;
+	/* finished after the deadline of the next phase */
+	atomic_ullong overruns;
+	/* time from the deadline until the phase started */
+	atomic_uint max_latency_us;
+};
+
+struct scheduler;
+
+struct scheduler_task
+{
+	const char *name;
+	struct scheduler *scheduler;
+	struct scheduler_phase phases[SCHEDULER_MAX_PHASES];
+	unsigned int num_phases;
+	uint8_t running;
+	pthread_t thread;
+
+	atomic_ullong cycles;
+	atomic_ullong missed_cycles; /* skipped to get back on the grid */
+};
+typedef struct scheduler_task scheduler_task_t;
+
+/* Real-time settings applied by scheduler_start() */
+struct scheduler_options
+{
+	int priority;    /* SCHED_FIFO priority, 0 for SCHED_OTHER */
+	int cpu;         /* CPU the tasks are pinned to, -1 for any */
+	int lock_memory; /* mlockall() to avoid page faults */
+};
+
+#define SCHEDULER_OPTIONS_DEFAULT { 0, -1, 0 }
+
+struct scheduler
+{
+	uint8_t initialized;
+	uint32_t period_us;
+	struct scheduler_options options;
+	struct timespec epoch;
+	atomic_int stop;
+
+	scheduler_task_t tasks[SCHEDULER_MAX_TASKS];
+	unsigned int num_tasks;
+};
+typedef struct scheduler scheduler_t;
+
+void scheduler_init(scheduler_t *s, const uint32_t period_us,
+		    const struct scheduler_options *options);
+void scheduler_cleanup(scheduler_t *s);
+
+scheduler_task_t *scheduler_add_task(scheduler_t *s, const char *name);
+int scheduler_add_phase(scheduler_task_t *task, const char *name,
+			const int64_t offset_us, scheduler_fn fn,
+			void *user_data);
+void scheduler_set_phase_offset(scheduler_task_t *task,
+				const unsigned int phase,
+				const int64_t offset_us);
+
+int scheduler_start(scheduler_t *s);
+void scheduler_stop(scheduler_t *s);
+
+void scheduler_print_statistics(scheduler_t *s, FILE *stream);
+
+#endif /* SOUSVIDED_SCHEDULER_H */
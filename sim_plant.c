@@ -0,0 +1,109 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "sim_plant.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/* Explicit Euler steps are stable as long as they are well below the
+ * smallest time constant, the heater zone with full circulation (~10s) */
+#define SIM_PLANT_MAX_STEP 0.01
+
+/* A 1kW immersion heater in a 10l bath with a 0.5l heater zone, losing
+ * about 4W/K through the container walls and the water surface */
+void sim_plant_default_params(struct sim_plant_params *params)
+{
+	assert(params != NULL);
+
+	params->heater_power = 1000.0;
+	params->heater_capacity = 0.5 * 4186.0;
+	params->bath_capacity = 9.5 * 4186.0;
+	params->mixing_still = 30.0;
+	params->mixing_full = 200.0;
+	params->loss = 4.0;
+	params->ambient = 20.0;
+	params->sensor_lag = 5.0;
+	params->sensor_noise = 0.01;
+}
+
+/* params may be NULL for the defaults. The bath starts at the ambient
+ * temperature. */
+void sim_plant_init(sim_plant_t *plant, const struct sim_plant_params *params)
+{
+	assert(plant != NULL);
+
+	if (params) {
+		plant->params = *params;
+	} else {
+		sim_plant_default_params(&plant->params);
+	}
+	plant->heater_temperature = plant->params.ambient;
+	plant->bath_temperature = plant->params.ambient;
+	plant->sensor_temperature = plant->params.ambient;
+	plant->seed = 1;
+}
+
+/* Advance the model by dt seconds with the heater on for the given fraction
+ * of the time and the circulator at the given fraction of its full speed */
+void sim_plant_step(sim_plant_t *plant, const double dt, const double heater,
+		    const double circulator)
+{
+	assert(plant != NULL);
+	assert(dt >= 0.0);
+
+	const struct sim_plant_params *p = &plant->params;
+	const double mixing =
+	    p->mixing_still + circulator * (p->mixing_full - p->mixing_still);
+
+	double remaining = dt;
+	while (remaining > 0.0) {
+		const double h =
+		    remaining < SIM_PLANT_MAX_STEP ? remaining
+						   : SIM_PLANT_MAX_STEP;
+		const double exchange =
+		    mixing *
+		    (plant->heater_temperature - plant->bath_temperature);
+		const double loss =
+		    p->loss * (plant->bath_temperature - p->ambient);
+
+		plant->heater_temperature +=
+		    h * (heater * p->heater_power - exchange) /
+		    p->heater_capacity;
+		plant->bath_temperature +=
+		    h * (exchange - loss) / p->bath_capacity;
+		plant->sensor_temperature +=
+		    h * (plant->bath_temperature - plant->sensor_temperature) /
+		    p->sensor_lag;
+		remaining -= h;
+	}
+}
+
+/* Probe temperature with gaussian noise (Box-Muller) */
+double sim_plant_read_sensor(sim_plant_t *plant)
+{
+	assert(plant != NULL);
+
+	const double u1 = (rand_r(&plant->seed) + 1.0) / (RAND_MAX + 2.0);
+	const double u2 = rand_r(&plant->seed) / (RAND_MAX + 1.0);
+	const double noise = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+	return plant->sensor_temperature + plant->params.sensor_noise * noise;
+}
@@ -0,0 +1,55 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_SIM_PLANT_H
+#define SOUSVIDED_SIM_PLANT_H
+
+/* Lumped thermal model of the water bath: the water around the heater, the
+ * rest of the bath, which exchange heat through the circulator's flow, and
+ * a probe that follows the bath with a first order lag */
+struct sim_plant_params
+{
+	double heater_power;     /* W while the SSR is on */
+	double heater_capacity;  /* J/K of the water around the heater */
+	double bath_capacity;    /* J/K of the rest of the bath */
+	double mixing_still;     /* W/K between both without circulation */
+	double mixing_full;      /* W/K with the circulator at full speed */
+	double loss;             /* W/K from the bath to the ambient */
+	double ambient;          /* degrees Celsius */
+	double sensor_lag;       /* s, time constant of the probe */
+	double sensor_noise;     /* degrees Celsius, standard deviation */
+};
+
+struct sim_plant
+{
+	struct sim_plant_params params;
+	double heater_temperature;
+	double bath_temperature;
+	double sensor_temperature;
+	unsigned int seed;
+};
+typedef struct sim_plant sim_plant_t;
+
+void sim_plant_default_params(struct sim_plant_params *params);
+void sim_plant_init(sim_plant_t *plant, const struct sim_plant_params *params);
+void sim_plant_step(sim_plant_t *plant, const double dt, const double heater,
+		    const double circulator);
+double sim_plant_read_sensor(sim_plant_t *plant);
+
+#endif /* SOUSVIDED_SIM_PLANT_H */
@@ -0,0 +1,191 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "smith.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double delta_t_s(const struct timespec *start,
+			const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) * 1.0E-9;
+}
+
+static unsigned int delay_periods(const double dead_time,
+				  const double period_s)
+{
+	return lround(dead_time / period_s);
+}
+
+/* The model is given in physical units, the time step is the period */
+int smith_init(smith_t *s, pidctrl_t *pid, const double gain,
+	       const double time_constant, const double dead_time,
+	       const double period_s, const double output_max)
+{
+	assert(s != NULL);
+	assert(pid != NULL);
+	assert(period_s > 0.0);
+	assert(output_max > 0.0);
+	assert(dead_time >= 0.0);
+
+	memset(s, 0, sizeof(*s));
+	s->ring_size =
+	    SMITH_DELAY_HEADROOM * delay_periods(dead_time, period_s) + 1;
+	s->ring = (double *)calloc(s->ring_size, sizeof(double));
+	if (!s->ring) {
+		fprintf(stderr, "Failed to allocate %zu periods of dead time\n",
+			s->ring_size);
+		return -1;
+	}
+
+	s->pid = pid;
+	s->period_s = period_s;
+	s->output_max = output_max;
+	smith_set_model(s, gain, time_constant, dead_time);
+	return 0;
+}
+
+void smith_cleanup(smith_t *s)
+{
+	assert(s != NULL);
+	free(s->ring);
+	s->ring = NULL;
+	s->ring_size = 0;
+}
+
+/* Takes a new model, e.g. from the online identification. The model
+ * outputs so far are kept. */
+void smith_set_model(smith_t *s, const double gain, const double time_constant,
+		     const double dead_time)
+{
+	assert(s != NULL);
+	assert(gain > 0.0);
+	assert(time_constant > 0.0);
+	assert(dead_time >= 0.0);
+
+	s->gain = gain;
+	s->alpha = exp(-s->period_s / time_constant);
+	s->delay = delay_periods(dead_time, s->period_s);
+	if (s->delay >= s->ring_size) {
+		s->delay = s->ring_size - 1;
+	}
+}
+
+/* Also resets the PID. The model starts settled at the output applied
+ * until now, so the prediction starts out as the measurement. */
+void smith_reset(smith_t *s, const double output)
+{
+	assert(s != NULL);
+
+	size_t i;
+
+	s->output = output;
+	s->applied = output;
+	s->model = s->gain * output / s->output_max;
+	for (i = 0; i < s->ring_size; ++i) {
+		s->ring[i] = s->model;
+	}
+	s->ring_next = 0;
+	s->has_input = 0;
+	pidctrl_reset(s->pid, output);
+}
+
+/* The model runs on the output the heater actually got, see
+ * controller_ops. Until told otherwise that is the one returned. */
+void smith_set_applied(smith_t *s, const double output)
+{
+	assert(s != NULL);
+	s->applied = output;
+}
+
+/* Model output n periods back, 0 for the latest one */
+static double past_model(const smith_t *s, const size_t n)
+{
+	assert(n < s->ring_size);
+	return s->ring[(s->ring_next + s->ring_size - 1 - n) % s->ring_size];
+}
+
+/* Feed a measurement taken at timestamp and return the output to apply
+ * until the next one. The model runs on the nominal period, a measurement
+ * that isn't newer than the previous one leaves the output unchanged. */
+double smith_update(smith_t *s, const double input,
+		    const struct timespec *timestamp)
+{
+	assert(s != NULL);
+	assert(timestamp != NULL);
+
+	if (s->has_input) {
+		if (delta_t_s(&s->last_update, timestamp) <= 0.0) {
+			return s->output;
+		}
+
+		/* the last output was applied until now */
+		s->model = s->alpha * s->model + (1.0 - s->alpha) * s->gain *
+						     s->applied / s->output_max;
+		s->ring[s->ring_next] = s->model;
+		s->ring_next = (s->ring_next + 1) % s->ring_size;
+	}
+	s->has_input = 1;
+	s->last_update = *timestamp;
+
+	const double predicted = input + s->model - past_model(s, s->delay);
+	s->output = pidctrl_update(s->pid, predicted, timestamp);
+	s->applied = s->output;
+	return s->output;
+}
+
+static double controller_update_fn(void *state, const double input,
+				   const struct timespec *timestamp)
+{
+	return smith_update((smith_t *)state, input, timestamp);
+}
+
+static double controller_get_set_point_fn(void *state)
+{
+	return pidctrl_get_set_point(((smith_t *)state)->pid);
+}
+
+static void controller_set_set_point_fn(void *state, const double sp)
+{
+	pidctrl_set_set_point(((smith_t *)state)->pid, sp);
+}
+
+static void controller_reset_fn(void *state, const double output)
+{
+	smith_reset((smith_t *)state, output);
+}
+
+static void controller_set_applied_fn(void *state, const double output)
+{
+	smith_set_applied((smith_t *)state, output);
+}
+
+const struct controller_ops smith_controller_ops = {
+	.name = "smith",
+	.update = &controller_update_fn,
+	.get_set_point = &controller_get_set_point_fn,
+	.set_set_point = &controller_set_set_point_fn,
+	.reset = &controller_reset_fn,
+	.set_applied = &controller_set_applied_fn,
+};
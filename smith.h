@@ -0,0 +1,85 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_SMITH_H
+#define SOUSVIDED_SMITH_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "controller.h"
+#include "pid.h"
+
+/* Smith predictor around a pidctrl_t. It runs a first order model of the
+ * bath on the controller's outputs, once without and once with the dead
+ * time, and hands the PID the measurement plus the difference of both:
+ * the temperature to expect once the heat already on its way shows. The
+ * PID then controls a plant without dead time and can use much higher
+ * gains without overshooting. Model errors only show in the measurement
+ * and are taken care of by the PID as usual.
+ *
+ * The delayed model output comes from a ring of past model outputs,
+ * allocated once for up to SMITH_DELAY_HEADROOM times the dead time the
+ * predictor starts with. Longer dead times from later models are cut to
+ * what fits. */
+
+#ifndef SMITH_DELAY_HEADROOM
+#define SMITH_DELAY_HEADROOM 4
+#endif
+
+struct smith
+{
+	pidctrl_t *pid;
+	double period_s;
+	double output_max;
+
+	double gain;        /* K above ambient at full output */
+	double alpha;       /* decay of the model per period */
+	unsigned int delay; /* dead time in periods */
+
+	/* model outputs without dead time, newest at ring_next - 1 */
+	double *ring;
+	size_t ring_size;
+	size_t ring_next;
+
+	double model; /* without dead time, K above ambient */
+	struct timespec last_update;
+	int has_input;
+	double output;
+	double applied; /* output the heater got since the last update */
+};
+typedef struct smith smith_t;
+
+int smith_init(smith_t *s, pidctrl_t *pid, const double gain,
+	       const double time_constant, const double dead_time,
+	       const double period_s, const double output_max);
+void smith_cleanup(smith_t *s);
+
+void smith_set_model(smith_t *s, const double gain, const double time_constant,
+		     const double dead_time);
+
+void smith_reset(smith_t *s, const double output);
+void smith_set_applied(smith_t *s, const double output);
+double smith_update(smith_t *s, const double input,
+		    const struct timespec *timestamp);
+
+/* smith_t as a controller_t */
+extern const struct controller_ops smith_controller_ops;
+
+#endif /* SOUSVIDED_SMITH_H */
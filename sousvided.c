@@ -20,23 +20,43 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #include <assert.h>
 #include <errno.h>
 #include <math.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <pthread.h>
+#include <signal.h>
 #include <unistd.h>
 
-#include "bcm2835.h"
+#include "autotune.h"
 #include "buttons.h"
+#include "controller.h"
+#include "filter.h"
+#include "hal.h"
+#include "ident.h"
+#include "latency.h"
 #include "max31865.h"
 #include "motor.h"
+#include "mpc.h"
 #include "pid.h"
 #include "rtd_table.h"
+#include "scheduler.h"
+#include "smith.h"
+#include "trace.h"
 
-#define MAX31865_DRDY_PIN RPI_V2_GPIO_P1_22
+/* GPIO numbers, with the pin on the P1 header in the comments */
+#define MAX31865_DRDY_PIN 25 /* P1-22 */
+/* Trigger a single conversion per control loop cycle instead of running
+ * automatic conversions */
+#define MAX31865_ONE_SHOT 1
+/* Check the RTD wiring for open or shorted leads every 10s, and right after
+ * a sample flagged a fault */
+#define MAX31865_FAULT_CYCLE MAX31865_FAULT_CYCLE_AUTO
+#define MAX31865_FAULT_INTERVAL_MS 10000
 
-#define MOTOR_CLOCK_DIVIDER BCM2835_PWM_CLOCK_DIVIDER_1024
+#define MOTOR_CLOCK_DIVIDER 1024
 #define MOTOR_PWM_RANGE 1000
 #define MOTOR_SPEED_DELTA 50
 
@@ -51,27 +71,153 @@ Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 #define PID_INTEGRAL_GAIN 2.5
 #define PID_DIFFERENTIAL_GAIN 50.0
 
-#define BUTTON_1_PIN RPI_V2_GPIO_P1_13
-#define BUTTON_2_PIN RPI_V2_GPIO_P1_15
-#define BUTTON_3_PIN RPI_V2_GPIO_P1_16
-#define BUTTON_4_PIN RPI_V2_GPIO_P1_18
+/* Relay test of the a command, see autotune.h */
+#define AUTOTUNE_HYSTERESIS 0.1
+#define AUTOTUNE_CYCLES 3
+#define AUTOTUNE_TIMEOUT_S (8 * 3600)
 
-#define SSR_PIN RPI_V2_GPIO_P1_07
+#define AUTOTUNE_REQUEST_NONE 0
+#define AUTOTUNE_REQUEST_STOP 1
+#define AUTOTUNE_REQUEST_START 2 /* + enum AUTOTUNE_RULE */
+
+/* Controller at startup, "pid", "mpc" or "smith". Can be changed at runtime
+ * with the s command. */
+#define CONTROLLER "pid"
+
+/* Model of the bath the MPC and the Smith predictor start with, a 1kW
+ * heater in 10l of water. The online identification replaces it once it
+ * has a model. */
+#define BATH_MODEL_GAIN 250.0
+#define BATH_MODEL_TIME_CONSTANT 10000.0
+#define BATH_MODEL_DEAD_TIME 15.0
+#define BATH_MODEL_AMBIENT 20.0
+
+/* Gains of the PID inside the Smith predictor. Without the dead time in
+ * the loop it can be much faster than the plain PID. */
+#define SMITH_PROPORTIONAL_GAIN 4000.0
+#define SMITH_INTEGRAL_GAIN 1.0
+#define SMITH_DIFFERENTIAL_GAIN 0.0
+
+/* Online identification of the bath, see ident.h. The model is updated
+ * every 5s and remembers about the last 1000 updates. */
+#define IDENT_STEP_S 5.0
+#define IDENT_FORGETTING 0.999
+
+/* Time between the phases of the control loop, for the SPI transfers and
+ * the scheduling latency */
+#define SCHEDULER_SLACK_US 5000
+
+#define BUTTON_1_PIN 27 /* P1-13 */
+#define BUTTON_2_PIN 22 /* P1-15 */
+#define BUTTON_3_PIN 23 /* P1-16 */
+#define BUTTON_4_PIN 24 /* P1-18 */
+
+#define SSR_PIN 4 /* P1-07 */
+#define SSR_MIN_ON_MS 10 /* half a mains period at 50Hz */
+
+/* Filter stages between the MAX31865 and the PID controller, see
+ * filter_pipeline_parse(). Can be changed at runtime with the f command. */
+#define SENSOR_FILTER "median:3,ema:0.5"
+
+/* Chrome trace-event JSON written by the t command and SIGUSR2 */
+#define TRACE_FILE "sousvided-trace.json"
 
 struct callback_data {
+	rtd_table_t *rtd_table;
 	max31865_t maxim;
+	filter_pipeline_t filter; /* owned by the sample producer */
+	_Atomic(filter_pipeline_t *) pending_filter;
+	sample_ring_t filtered;
 	motor_t motor;
 	pidctrl_t *pidctrl;
+	mpc_t mpc;
+	pidctrl_t *smith_pidctrl;
+	smith_t smith;
+	controller_t pid_controller;
+	controller_t mpc_controller;
+	controller_t smith_controller;
+	controller_t *controller; /* owned by the control task */
+	_Atomic(controller_t *) pending_controller;
 	buttons_t *buttons;
-	pthread_t ctrl_loop_id;
-	pthread_t heater_ctrl_id;
-	volatile int stop_control_loop;
+	scheduler_t scheduler;
+	scheduler_task_t *heater_task;
+	int release_phase;
+	int64_t actuate_offset_us;
+	int one_shot;
+	struct timespec last_compute; /* owned by the control task */
+	atomic_ullong set_point_changed_ns;
+	/* sequence numbers of the latest filtered sample and of the sample
+	 * the heater duty cycle is based on, for the trace */
+	atomic_uint filtered_sample;
+	atomic_uint duty_sample;
 	volatile double heater_duty_cycle;
+	autotune_t autotune; /* owned by the control task */
+	ident_t ident;       /* updated by the control task */
+	struct ident_model plant_model; /* the one the controllers use */
+	atomic_int autotune_request;
+	uint8_t ssr_state; /* owned by the heater task */
+	uint32_t heater_on_ms;
+	atomic_uint applied_on_ms; /* of the last period, from the heater task */
 };
 
-static double query_wrapper(void *p)
+/* Runs on the thread that acquired the sample. The filter works on ADC
+ * codes, its fractional output is converted by interpolating the table. */
+static void filter_sample(const struct rtd_sample *sample, void *user_data)
 {
-	return max31865_get_temperature((max31865_t *)p, NULL);
+	struct callback_data *data = (struct callback_data *)user_data;
+
+	filter_pipeline_t *pending =
+	    atomic_exchange(&data->pending_filter, NULL);
+	if (pending) {
+		data->filter = *pending;
+		free(pending);
+	}
+
+	const uint64_t start = trace_now();
+	double rtd;
+	if (sample->fault ||
+	    !filter_pipeline_process(&data->filter, sample->rtd, &rtd)) {
+		return;
+	}
+
+	struct rtd_sample filtered = *sample;
+	filtered.rtd = (uint16_t)(rtd + 0.5);
+	filtered.temperature = rtd_table_lookupf(data->rtd_table, rtd);
+	sample_ring_push(&data->filtered, &filtered);
+	trace_slice("filter", start, sample->sequence, TRACE_FLOW_STEP);
+	atomic_store(&data->filtered_sample, sample->sequence);
+}
+
+/* Replace the sensor filter with the stages given on the rest of the line,
+ * e.g. "f median:5,decimate:8,kalman:0.001:2". The new filter starts with
+ * the next sample. */
+static void configure_filter(struct callback_data *data)
+{
+	char line[128];
+	if (!fgets(line, sizeof(line), stdin)) {
+		return;
+	}
+	line[strcspn(line, "\r\n")] = '\0';
+
+	filter_pipeline_t *filter =
+	    (filter_pipeline_t *)malloc(sizeof(filter_pipeline_t));
+	if (!filter) {
+		return;
+	}
+	filter_pipeline_init(filter);
+	if (filter_pipeline_parse(filter, line) == -1) {
+		fprintf(stderr, "Invalid filter \"%s\"\n", line);
+		free(filter);
+		return;
+	}
+
+	char description[128];
+	filter_pipeline_format(filter, description, sizeof(description));
+	printf("New sensor filter: %s\n",
+	       filter->num_stages ? description : "none");
+
+	/* a filter that wasn't picked up yet is replaced */
+	free(atomic_exchange(&data->pending_filter, filter));
 }
 
 static void change_motor_speed(motor_t *motor, int32_t delta)
@@ -95,9 +241,17 @@ static void change_motor_speed(motor_t *motor, int32_t delta)
 	       100.0 * motor_get_duty_cycle_percentage(motor));
 }
 
-static void update_target_temperature(pidctrl_t *pidctrl, double delta)
+static uint64_t monotonic_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void update_target_temperature(struct callback_data *data,
+				      double delta)
 {
-	double current = pidctrl_get_set_point(pidctrl);
+	double current = pidctrl_get_set_point(data->pidctrl);
 	if (delta < 0 && current + delta < PID_MIN_SET_POINT) {
 		current = PID_MIN_SET_POINT;
 	} else if (delta > 0 && current + delta > PID_MAX_SET_POINT) {
@@ -105,8 +259,15 @@ static void update_target_temperature(pidctrl_t *pidctrl, double delta)
 	} else {
 		current += delta;
 	}
-	pidctrl_set_set_point(pidctrl, current);
+	pidctrl_set_set_point(data->pidctrl, current);
+	mpc_set_set_point(&data->mpc, current);
+	pidctrl_set_set_point(data->smith_pidctrl, current);
 	printf("New target temperature %.2f degree Celsius\n", current);
+
+	/* the earliest unprocessed change counts */
+	uint64_t expected = 0;
+	atomic_compare_exchange_strong(&data->set_point_changed_ns, &expected,
+				       monotonic_ns());
 }
 
 static void button_callback_handler(const uint8_t pin, void *user_data)
@@ -116,11 +277,11 @@ static void button_callback_handler(const uint8_t pin, void *user_data)
 	switch (pin) {
 	case BUTTON_1_PIN:
 		/* increment temperature set point in PID controller */
-		update_target_temperature(data->pidctrl, PID_SET_POINT_DELTA);
+		update_target_temperature(data, PID_SET_POINT_DELTA);
 		break;
 	case BUTTON_2_PIN:
 		/* decrement temperature set point in PID controller */
-		update_target_temperature(data->pidctrl, -PID_SET_POINT_DELTA);
+		update_target_temperature(data, -PID_SET_POINT_DELTA);
 		break;
 	case BUTTON_3_PIN:
 		change_motor_speed(&data->motor, MOTOR_SPEED_DELTA);
@@ -135,105 +296,493 @@ static void button_callback_handler(const uint8_t pin, void *user_data)
 	}
 }
 
-static void *pidctrl_loop_thread(void *user_data)
+static void print_diagnostics(max31865_t *maxim)
+{
+	struct max31865_snapshot snapshot;
+	char fault[128];
+	max31865_read_snapshot(maxim, &snapshot);
+	max31865_format_fault(max31865_get_fault(maxim), fault, sizeof(fault));
+	printf("MAX31865: config 0x%02X, RTD %u%s, fault thresholds %u/%u, "
+	       "fault status 0x%02X, last fault detection: %s\n",
+	       (unsigned int)snapshot.config, (unsigned int)snapshot.rtd,
+	       snapshot.rtd_fault ? " (fault)" : "",
+	       (unsigned int)snapshot.fault_lt, (unsigned int)snapshot.fault_ht,
+	       (unsigned int)snapshot.fault_status, fault);
+}
+
+/* Read up to three "measured:reference" pairs from the rest of the line, e.g.
+ * "c 0.3:0.0 99.1:100.0", and recalibrate the RTD table with them. Without
+ * any pairs the calibration is removed. */
+static void calibrate_rtd_table(rtd_table_t *table)
+{
+	struct rtd_calibration_point points[3];
+	unsigned int num_points = 0;
+	char line[128];
+
+	if (!fgets(line, sizeof(line), stdin)) {
+		return;
+	}
+
+	char *p = line;
+	int n;
+	while (num_points < 3 &&
+	       sscanf(p, " %lf:%lf%n", &points[num_points].measured,
+		      &points[num_points].reference, &n) == 2) {
+		++num_points;
+		p += n;
+	}
+
+	if (rtd_table_calibrate(table, points, num_points) == -1) {
+		if (errno == EBUSY) {
+			fprintf(stderr, "Calibration is already in progress\n");
+		} else {
+			fprintf(stderr, "Invalid calibration points\n");
+		}
+	}
+}
+
+/* The control loop runs on the scheduler's grid. With one-shot conversions
+ * every period starts with the conversion, the PID controller gets a
+ * sample that is only as old as the SPI readout. */
+static void sample_phase(const struct scheduler_slot *slot, void *user_data)
 {
 	struct callback_data *data = (struct callback_data *)user_data;
-	const useconds_t num_usecs = 1000 * PID_CONTROL_LOOP_MS;
+	max31865_read_one_shot(&data->maxim, NULL);
+}
+
+static void handle_autotune_request(struct callback_data *data)
+{
+	const int request =
+	    atomic_exchange(&data->autotune_request, AUTOTUNE_REQUEST_NONE);
 
-	while (!data->stop_control_loop) {
-		data->heater_duty_cycle = pidctrl_get_output(data->pidctrl);
-		usleep(num_usecs);
+	if (request == AUTOTUNE_REQUEST_STOP &&
+	    data->autotune.state == AUTOTUNE_RUNNING) {
+		data->autotune.state = AUTOTUNE_OFF;
+		controller_reset(data->controller,
+				 autotune_get_mean_output(&data->autotune));
+		printf("Autotune stopped\n");
+	} else if (request >= AUTOTUNE_REQUEST_START) {
+		const double set_point = pidctrl_get_set_point(data->pidctrl);
+		autotune_init(&data->autotune,
+			      request - AUTOTUNE_REQUEST_START, set_point,
+			      PID_MIN_DUTY_CYCLE, PID_MAX_DUTY_CYCLE,
+			      AUTOTUNE_HYSTERESIS, AUTOTUNE_CYCLES,
+			      AUTOTUNE_TIMEOUT_S);
+		printf("Autotuning at %.2f degree Celsius\n", set_point);
 	}
-	return NULL;
 }
 
-static uint32_t nearest_multiple(const double value, const uint32_t multiple)
+static void apply_tuned_gains(struct callback_data *data)
 {
-	return (ceil(value / multiple) * multiple);
+	struct pid_gains gains;
+	autotune_get_gains(&data->autotune, &gains);
+	pidctrl_tune(data->pidctrl, gains.kp, gains.ki, gains.kd);
+	printf("Autotune: Ku = %.1f, Tu = %.0f s, new gains kp = %.2f, "
+	       "ki = %.4f, kd = %.1f\n",
+	       data->autotune.ku, data->autotune.tu, gains.kp, gains.ki,
+	       gains.kd);
+
+	if (autotune_store_gains(PID_GAINS_FILE, &gains, &data->autotune) ==
+	    0) {
+		printf("Saved PID gains to %s\n", PID_GAINS_FILE);
+	}
+}
+
+/* The relay drives the heater instead of the controller until the
+ * autotuner is done, the controller then starts over (the PID with the new
+ * gains) from the mean relay output */
+static double autotune_step(struct callback_data *data,
+			    const struct rtd_sample *sample)
+{
+	double output;
+
+	switch (autotune_update(&data->autotune, sample->temperature,
+				&sample->timestamp, &output)) {
+	case AUTOTUNE_RUNNING:
+		return output;
+	case AUTOTUNE_DONE:
+		apply_tuned_gains(data);
+		break;
+	default:
+		printf("Autotune failed, keeping the PID gains\n");
+		break;
+	}
+
+	data->autotune.state = AUTOTUNE_OFF;
+	controller_reset(data->controller,
+			 autotune_get_mean_output(&data->autotune));
+	return controller_update(data->controller, sample->temperature,
+				 &sample->timestamp);
+}
+
+/* The duty cycle the heater got in the last period. It differs from the
+ * computed one by the rounding to half waves and while a fault keeps the
+ * heater off. */
+static double applied_duty_cycle(struct callback_data *data)
+{
+	return atomic_load(&data->applied_on_ms) * PID_MAX_DUTY_CYCLE /
+	       PID_CONTROL_LOOP_MS;
+}
+
+/* The applied duty cycle is the one until the sample. The MPC and the Smith
+ * predictor take the identified model once it is stable and differs from
+ * the one they have. */
+static void identify_plant(struct callback_data *data,
+			   const struct rtd_sample *sample, const double applied)
+{
+	struct ident_model identified;
+	struct mpc_model model;
+
+	if (ident_update(&data->ident, applied / PID_MAX_DUTY_CYCLE,
+			 sample->temperature, &sample->timestamp)) {
+		printf("Load change detected at %.2f \xB0""C\n",
+		       sample->temperature);
+	}
+
+	ident_get_model(&data->ident, &identified);
+	if (identified.stable &&
+	    (!data->plant_model.stable ||
+	     ident_model_differs(&identified, &data->plant_model))) {
+		data->plant_model = identified;
+		printf("New plant model: gain %.1f K, time constant %.0f s, "
+		       "dead time %.0f s\n",
+		       identified.gain, identified.time_constant,
+		       identified.dead_time);
+
+		mpc_get_model(&data->mpc, &model);
+		model.gain = identified.gain;
+		model.time_constant = identified.time_constant;
+		model.dead_time = identified.dead_time;
+		model.ambient = identified.ambient;
+		mpc_set_model(&data->mpc, &model);
+		smith_set_model(&data->smith, model.gain,
+				model.time_constant, model.dead_time);
+	}
 }
 
-static void *heater_control_thread(void *user_data)
+/* The new controller starts from scratch at the current set point, with
+ * the duty cycle applied so far as its past */
+static void switch_controller(struct callback_data *data,
+			      const double applied)
+{
+	controller_t *pending =
+	    atomic_exchange(&data->pending_controller, NULL);
+	if (!pending || pending == data->controller) {
+		return;
+	}
+
+	controller_set_set_point(pending,
+				 controller_get_set_point(data->controller));
+	controller_reset(pending, applied);
+	data->controller = pending;
+	printf("Switched to the %s controller\n", controller_name(pending));
+}
+
+static void compute_phase(const struct scheduler_slot *slot, void *user_data)
 {
 	struct callback_data *data = (struct callback_data *)user_data;
-	uint32_t on_ms, off_ms;
-	struct timespec start, end;
-	uint32_t n = 0;
-	uint32_t total_on = 0;
-	uint8_t ssr_state = 0;
-
-	while (!data->stop_control_loop) {
-		/* The SSR has a built-in triac, so it will only switch on
-		 * zero crossings. Make sure we do not switch the SSR on for
-		 * time intervals smaller than a half-period (10ms @ 50Hz,
-		 * 8ms @ 60Hz).
-		 */
-		if (data->heater_duty_cycle >= (10.0 / PID_CONTROL_LOOP_MS)) {
-			on_ms = nearest_multiple(
-			    PID_CONTROL_LOOP_MS * data->heater_duty_cycle / 1000.0, 10);
-			if (on_ms > PID_CONTROL_LOOP_MS) {
-				on_ms = PID_CONTROL_LOOP_MS;
-			}
-			off_ms = PID_CONTROL_LOOP_MS - on_ms;
+	const uint64_t changed_ns =
+	    atomic_exchange(&data->set_point_changed_ns, 0);
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (data->last_compute.tv_sec) {
+		const int64_t error_ns =
+		    (int64_t)(now.tv_sec - data->last_compute.tv_sec) *
+			1000000000 +
+		    (now.tv_nsec - data->last_compute.tv_nsec) -
+		    PID_CONTROL_LOOP_MS * 1000000LL;
+		latency_record(LATENCY_CONTROL_PERIOD, llabs(error_ns));
+	}
+	data->last_compute = now;
+
+	/* The controller only takes the latest filtered sample, the time
+	 * step is the time between the samples' DRDY edges. Without a new
+	 * sample the output stays the same. A sample is only traced into the
+	 * first update that uses it. */
+	const uint32_t sample = atomic_exchange(&data->filtered_sample, 0);
+	struct rtd_sample latest;
+	const int have_sample = sample_ring_latest(&data->filtered, &latest);
+	const double applied = applied_duty_cycle(data);
+	switch_controller(data, applied);
+	handle_autotune_request(data);
+	if (have_sample) {
+		trace_counter("temperature", latest.temperature);
+		identify_plant(data, &latest, applied);
+		if (data->autotune.state == AUTOTUNE_RUNNING) {
+			data->heater_duty_cycle = autotune_step(data, &latest);
 		} else {
-			on_ms = 0;
-			off_ms = PID_CONTROL_LOOP_MS;
+			const uint64_t start = trace_now();
+			controller_set_applied(data->controller, applied);
+			data->heater_duty_cycle =
+			    controller_update(data->controller,
+					      latest.temperature,
+					      &latest.timestamp);
+			trace_slice("controller update", start, sample,
+				    TRACE_FLOW_STEP);
 		}
+	}
+	trace_counter("heater duty", data->heater_duty_cycle);
+	atomic_store(&data->duty_sample, sample);
+	if (changed_ns) {
+		latency_record(LATENCY_SET_POINT, monotonic_ns() - changed_ns);
+	}
+}
 
-		total_on += on_ms;
-		if (on_ms) {
-			/* No need to write to GPIO if SSR is already on */
-			if (!ssr_state) {
-				clock_gettime(CLOCK_MONOTONIC, &start);
-				bcm2835_gpio_write(SSR_PIN, HIGH);
-				ssr_state = 1;
-				clock_gettime(CLOCK_MONOTONIC, &end);
+/* fit the fault detection between this conversion and the next one */
+static void fault_check_phase(const struct scheduler_slot *slot,
+			      void *user_data)
+{
+	struct callback_data *data = (struct callback_data *)user_data;
+	max31865_run_fault_detection(&data->maxim, &slot->end);
+}
 
-				on_ms -= (end.tv_sec - start.tv_sec) * 1E3 +
-					 (end.tv_nsec - start.tv_nsec) / 1E6;
-			}
+static uint32_t nearest_multiple(const double value, const uint32_t multiple)
+{
+	return (ceil(value / multiple) * multiple);
+}
 
-			usleep(1000 * on_ms);
+static void write_SSR(struct callback_data *data, const uint8_t on)
+{
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	hal_gpio_write(SSR_PIN, on ? HAL_HIGH : HAL_LOW);
+	latency_record_since(LATENCY_SSR_WRITE, &start);
+	trace_slice(on ? "ssr on" : "ssr off", trace_timestamp(&start), 0,
+		    TRACE_FLOW_NONE);
+	data->ssr_state = on;
+}
+
+/* Switch the heater on for its share of the period and schedule the release
+ * phase to switch it off again */
+static void actuate_phase(const struct scheduler_slot *slot, void *user_data)
+{
+	struct callback_data *data = (struct callback_data *)user_data;
+	const uint64_t start = trace_now();
+	uint32_t on_ms = 0;
+
+	/* The SSR has a built-in triac, so it will only switch on
+	 * zero crossings. Make sure we do not switch the SSR on for
+	 * time intervals smaller than a half-period (10ms @ 50Hz,
+	 * 8ms @ 60Hz).
+	 */
+	if (data->heater_duty_cycle >= (10.0 / PID_CONTROL_LOOP_MS)) {
+		on_ms = nearest_multiple(
+		    PID_CONTROL_LOOP_MS * data->heater_duty_cycle / 1000.0,
+		    SSR_MIN_ON_MS);
+		if (on_ms > PID_CONTROL_LOOP_MS) {
+			on_ms = PID_CONTROL_LOOP_MS;
 		}
+	}
 
-		if (off_ms) {
-			/* No need to write to GPIO if SSR is already off */
-			if (ssr_state) {
-				clock_gettime(CLOCK_MONOTONIC, &start);
-				bcm2835_gpio_write(SSR_PIN, LOW);
-				ssr_state = 0;
-				clock_gettime(CLOCK_MONOTONIC, &end);
+	/* a broken RTD reads as an arbitrary temperature, keep the
+	 * heater off until the fault detection clears the fault */
+	if (max31865_get_fault(&data->maxim)) {
+		on_ms = 0;
+	}
 
-				off_ms -= (end.tv_sec - start.tv_sec) * 1E3 +
-					  (end.tv_nsec - start.tv_nsec) / 1E6;
-			}
+	/* No need to write to GPIO if SSR is already in that state */
+	if (!on_ms != !data->ssr_state) {
+		write_SSR(data, on_ms != 0);
+	}
 
-			usleep(1000 * off_ms);
-		}
+	/* at 100% the SSR stays on into the next period */
+	scheduler_set_phase_offset(
+	    data->heater_task, data->release_phase,
+	    on_ms && on_ms < PID_CONTROL_LOOP_MS
+		? data->actuate_offset_us + 1000 * on_ms
+		: SCHEDULER_SKIP);
+	trace_slice("actuate", start, atomic_exchange(&data->duty_sample, 0),
+		    TRACE_FLOW_END);
 
-		if (++n % PID_CONTROL_LOOP_HZ == 0) {
-			printf("Heater was on for %u ms (%.2f %%), T = %.2f \xB0""C\n",
-			       total_on, (total_on / 10.0),
-			       max31865_get_temperature(&data->maxim, NULL));
-			total_on = 0;
-		}
+	atomic_store(&data->applied_on_ms, on_ms);
+	data->heater_on_ms += on_ms;
+	if ((slot->cycle + 1) % PID_CONTROL_LOOP_HZ == 0) {
+		printf("Heater was on for %u ms (%.2f %%), T = %.2f \xB0""C\n",
+		       data->heater_on_ms, (data->heater_on_ms / 10.0),
+		       max31865_get_temperature(&data->maxim, NULL));
+		data->heater_on_ms = 0;
+	}
+}
+
+static void release_phase(const struct scheduler_slot *slot, void *user_data)
+{
+	write_SSR((struct callback_data *)user_data, 0);
+}
+
+/* Sample, compute and actuate phases of the control loop. The heater has a
+ * task of its own, its edges can't wait for a conversion to finish. */
+static int setup_scheduler(struct callback_data *data)
+{
+	scheduler_task_t *control = scheduler_add_task(&data->scheduler,
+						       "control");
+	data->heater_task = scheduler_add_task(&data->scheduler, "heater");
+
+	int64_t offset_us = 0;
+	if (data->one_shot) {
+		scheduler_add_phase(control, "sample", 0, &sample_phase, data);
+		offset_us = max31865_get_one_shot_lead_us(&data->maxim) +
+			    SCHEDULER_SLACK_US;
+	}
+	scheduler_add_phase(control, "compute", offset_us, &compute_phase,
+			    data);
+	offset_us += SCHEDULER_SLACK_US;
+	if (data->one_shot) {
+		scheduler_add_phase(control, "fault", offset_us,
+				    &fault_check_phase, data);
 	}
 
-	/* make sure SSR is off after the thread finishes */
-	bcm2835_gpio_write(SSR_PIN, LOW);
+	data->actuate_offset_us = offset_us;
+	scheduler_add_phase(data->heater_task, "actuate", offset_us,
+			    &actuate_phase, data);
+	data->release_phase =
+	    scheduler_add_phase(data->heater_task, "release", SCHEDULER_SKIP,
+				&release_phase, data);
 
-	return NULL;
+	return scheduler_start(&data->scheduler);
 }
 
 static void configure_SSR_output()
 {
-	bcm2835_gpio_fsel(SSR_PIN, BCM2835_GPIO_FSEL_OUTP);
-	bcm2835_gpio_write(SSR_PIN, LOW);
+	hal_gpio_function(SSR_PIN, HAL_GPIO_OUTPUT);
+	hal_gpio_write(SSR_PIN, HAL_LOW);
 }
 
 static void cleanup_SSR_output()
 {
-	bcm2835_gpio_write(SSR_PIN, LOW);
-	bcm2835_gpio_fsel(SSR_PIN, BCM2835_GPIO_FSEL_INPT);
+	hal_gpio_write(SSR_PIN, HAL_LOW);
+	hal_gpio_function(SSR_PIN, HAL_GPIO_INPUT);
+}
+
+/* SIGUSR1 dumps the latency histograms, SIGUSR2 the trace. The signals are
+ * blocked in every thread and taken synchronously by this one, so it can
+ * print. */
+static void *signal_thread(void *user_data)
+{
+	const sigset_t *signals = (const sigset_t *)user_data;
+	int signo;
+
+	trace_thread_name("signals");
+	while (sigwait(signals, &signo) == 0) {
+		if (signo == SIGUSR1) {
+			latency_print(stdout);
+		} else {
+			trace_dump(TRACE_FILE);
+		}
+	}
+	return NULL;
+}
+
+/* Must run before any other thread is created, they inherit the mask */
+static void start_signal_thread(void)
+{
+	static sigset_t signals;
+	pthread_t thread;
+
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR1);
+	sigaddset(&signals, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+	if (pthread_create(&thread, NULL, &signal_thread, &signals) != 0) {
+		fprintf(stderr, "Failed to create signal thread\n");
+		return;
+	}
+	pthread_detach(thread);
+}
+
+/* Start the autotuner at the current set point with the rule given on the
+ * rest of the line, "zn" for Ziegler-Nichols or "tl" (the default) for
+ * Tyreus-Luyben, or stop it with "stop" */
+static void request_autotune(struct callback_data *data)
+{
+	char line[64];
+	if (!fgets(line, sizeof(line), stdin)) {
+		return;
+	}
+	line[strcspn(line, "\r\n")] = '\0';
+
+	const char *arg = line + strspn(line, " \t");
+	int request;
+	if (!strcmp(arg, "stop")) {
+		request = AUTOTUNE_REQUEST_STOP;
+	} else if (!strcmp(arg, "zn")) {
+		request = AUTOTUNE_REQUEST_START + AUTOTUNE_ZIEGLER_NICHOLS;
+	} else if (!*arg || !strcmp(arg, "tl")) {
+		request = AUTOTUNE_REQUEST_START + AUTOTUNE_TYREUS_LUYBEN;
+	} else {
+		fprintf(stderr, "Invalid autotune rule \"%s\"\n", arg);
+		return;
+	}
+	atomic_store(&data->autotune_request, request);
+}
+
+/* Select the controller named on the rest of the line, or print the
+ * current one */
+static void select_controller(struct callback_data *data)
+{
+	char line[64];
+	if (!fgets(line, sizeof(line), stdin)) {
+		return;
+	}
+	line[strcspn(line, "\r\n")] = '\0';
+
+	const char *name = line + strspn(line, " \t");
+	controller_t *controllers[] = { &data->pid_controller,
+					&data->mpc_controller,
+					&data->smith_controller };
+	unsigned int i;
+
+	if (!*name) {
+		controller_t *pending = atomic_load(&data->pending_controller);
+		printf("Controller: %s\n",
+		       controller_name(pending ? pending : data->controller));
+		return;
+	}
+	for (i = 0; i < sizeof(controllers) / sizeof(controllers[0]); ++i) {
+		if (!strcmp(name, controller_name(controllers[i]))) {
+			atomic_store(&data->pending_controller,
+				     controllers[i]);
+			return;
+		}
+	}
+	fprintf(stderr, "Unknown controller \"%s\"\n", name);
+}
+
+static void print_plant_model(struct callback_data *data)
+{
+	struct ident_model model;
+	ident_get_model(&data->ident, &model);
+
+	if (!model.valid) {
+		printf("Plant model: not identified yet, prediction error "
+		       "%.3f K\n", model.error);
+	} else {
+		printf("Plant model: gain %.1f K, time constant %.0f s, dead "
+		       "time %.0f s, loss %.2f %%/K, ambient %.1f \xB0""C, "
+		       "prediction error %.3f K, %s\n",
+		       model.gain, model.time_constant, model.dead_time,
+		       100.0 * model.loss, model.ambient, model.error,
+		       model.stable ? "stable" : "settling");
+	}
+	if (model.load_changes) {
+		printf("%u load changes, the last one at %ld s\n",
+		       model.load_changes,
+		       (long)model.last_load_change.tv_sec);
+	}
+}
+
+/* Dump the trace to the file given on the rest of the line, TRACE_FILE by
+ * default */
+static void dump_trace(void)
+{
+	char line[256];
+	if (!fgets(line, sizeof(line), stdin)) {
+		return;
+	}
+	line[strcspn(line, "\r\n")] = '\0';
+
+	const char *path = line + strspn(line, " \t");
+	trace_dump(*path ? path : TRACE_FILE);
 }
 
 int main(int argc, char **argv)
@@ -247,19 +796,52 @@ int main(int argc, char **argv)
 	struct callback_data data;
 	memset(&data, 0, sizeof(data));
 
-	if (!bcm2835_init()) {
-		fprintf(stderr, "Failed to initialize bcm2835 library.\n");
+	/* -b sim runs the daemon against a simulated water bath, -r, -c and
+	 * -l run the control loop with SCHED_FIFO priority, pinned to a CPU
+	 * and with locked memory */
+	const char *backend = NULL;
+	struct scheduler_options options = SCHEDULER_OPTIONS_DEFAULT;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:r:c:l")) != -1) {
+		switch (opt) {
+		case 'b':
+			backend = optarg;
+			break;
+		case 'r':
+			options.priority = atoi(optarg);
+			break;
+		case 'c':
+			options.cpu = atoi(optarg);
+			break;
+		case 'l':
+			options.lock_memory = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-b bcm2835|linux|sim] "
+					"[-r PRIORITY] [-c CPU] [-l]\n",
+				argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	trace_thread_name("main");
+	start_signal_thread();
+
+	if (hal_init(backend) == -1) {
+		fprintf(stderr, "Failed to initialize hardware backend.\n");
 		goto out;
 	}
 	++status;
 
 	printf("Initializing RTD table\n");
-	if (rtd_table_init(0.0, 100.0, 1000.0, 1400.0) == -1) {
+	data.rtd_table = rtd_table_create(0.0, 100.0, 1000, 1400);
+	if (!data.rtd_table) {
+		fprintf(stderr, "Failed to initialize RTD table\n");
 		goto out;
 	}
 	++status;
 
-	if (max31865_init(&data.maxim, BCM2835_SPI_CS0, MAX31865_DRDY_PIN,
+	if (max31865_init(&data.maxim, HAL_SPI_CS0, MAX31865_DRDY_PIN,
 		      MAX31865_4WIRE_RTD) == -1) {
 		if (errno == EIO) {
 			fprintf(stderr, "Failed to initialize MAX31865: failed "
@@ -270,6 +852,26 @@ int main(int argc, char **argv)
 		goto out;
 	}
 
+	filter_pipeline_init(&data.filter);
+	if (filter_pipeline_parse(&data.filter, SENSOR_FILTER) == -1) {
+		fprintf(stderr, "Invalid sensor filter %s\n", SENSOR_FILTER);
+	}
+	atomic_init(&data.pending_filter, NULL);
+	sample_ring_init(&data.filtered);
+
+	max31865_set_rtd_table(&data.maxim, data.rtd_table);
+	max31865_set_sample_callback(&data.maxim, &filter_sample, &data);
+	max31865_set_fault_detection(&data.maxim, MAX31865_FAULT_CYCLE,
+				     MAX31865_FAULT_INTERVAL_MS);
+	if (MAX31865_ONE_SHOT && max31865_enable_one_shot(&data.maxim) == 0) {
+		/* the PID controller's initial set point needs a sample */
+		data.one_shot = 1;
+		max31865_read_one_shot(&data.maxim, NULL);
+	} else if (max31865_start_acquisition(&data.maxim, &filter_sample,
+					      &data) == -1) {
+		fprintf(stderr, "Failed to start MAX31865 acquisition thread, "
+				"polling DRDY instead\n");
+	}
 	++status;
 
 	motor_init(&data.motor, MOTOR_CLOCK_DIVIDER, MOTOR_PWM_RANGE);
@@ -277,15 +879,58 @@ int main(int argc, char **argv)
 	motor_set_duty_cycle(&data.motor, MOTOR_PWM_RANGE / 2);
 	++status;
 
+	/* gains found by the autotuner in an earlier run take precedence */
+	struct pid_gains gains = { PID_PROPORTIONAL_GAIN, PID_INTEGRAL_GAIN,
+				   PID_DIFFERENTIAL_GAIN };
+	if (autotune_load_gains(PID_GAINS_FILE, &gains) == 0) {
+		printf("Using PID gains from %s\n", PID_GAINS_FILE);
+	}
 	data.pidctrl = pidctrl_init(
 	    nearest_multiple(max31865_get_temperature(&data.maxim, NULL), 1.0),
-	    PID_PROPORTIONAL_GAIN, PID_INTEGRAL_GAIN, PID_DIFFERENTIAL_GAIN, 2.0,
-	    &query_wrapper, (void *)&data.maxim, PID_CONTROL_LOOP_MS,
+	    gains.kp, gains.ki, gains.kd, 2.0, NULL, NULL, PID_CONTROL_LOOP_MS,
 	    PID_MIN_DUTY_CYCLE, PID_MAX_DUTY_CYCLE);
 	if (!data.pidctrl) {
 		fprintf(stderr, "Failed to initialize PID controller.\n");
 		goto out;
 	}
+	data.smith_pidctrl = pidctrl_init(
+	    pidctrl_get_set_point(data.pidctrl), SMITH_PROPORTIONAL_GAIN,
+	    SMITH_INTEGRAL_GAIN, SMITH_DIFFERENTIAL_GAIN, 2.0, NULL, NULL,
+	    PID_CONTROL_LOOP_MS, PID_MIN_DUTY_CYCLE, PID_MAX_DUTY_CYCLE);
+	if (!data.smith_pidctrl ||
+	    smith_init(&data.smith, data.smith_pidctrl, BATH_MODEL_GAIN,
+		       BATH_MODEL_TIME_CONSTANT, BATH_MODEL_DEAD_TIME,
+		       PID_CONTROL_LOOP_MS / 1000.0, PID_MAX_DUTY_CYCLE) < 0) {
+		fprintf(stderr, "Failed to initialize Smith predictor.\n");
+		if (data.smith_pidctrl) {
+			pidctrl_free(data.smith_pidctrl);
+		}
+		pidctrl_free(data.pidctrl);
+		goto out;
+	}
+	const struct mpc_model mpc_model = {
+		.gain = BATH_MODEL_GAIN,
+		.time_constant = BATH_MODEL_TIME_CONSTANT,
+		.dead_time = BATH_MODEL_DEAD_TIME,
+		.ambient = BATH_MODEL_AMBIENT,
+	};
+	mpc_init(&data.mpc, pidctrl_get_set_point(data.pidctrl), &mpc_model,
+		 PID_CONTROL_LOOP_MS / 1000.0, PID_MIN_DUTY_CYCLE,
+		 PID_MAX_DUTY_CYCLE,
+		 PID_MAX_DUTY_CYCLE * SSR_MIN_ON_MS / PID_CONTROL_LOOP_MS);
+	controller_init(&data.pid_controller, &pidctrl_controller_ops,
+			data.pidctrl);
+	controller_init(&data.mpc_controller, &mpc_controller_ops, &data.mpc);
+	controller_init(&data.smith_controller, &smith_controller_ops,
+			&data.smith);
+	if (!strcmp(CONTROLLER, "mpc")) {
+		data.controller = &data.mpc_controller;
+	} else if (!strcmp(CONTROLLER, "smith")) {
+		data.controller = &data.smith_controller;
+	} else {
+		data.controller = &data.pid_controller;
+	}
+	ident_init(&data.ident, IDENT_STEP_S, IDENT_FORGETTING);
 	++status;
 
 	data.buttons =
@@ -298,21 +943,9 @@ int main(int argc, char **argv)
 	configure_SSR_output();
 	++status;
 
-	if (pthread_create(&data.ctrl_loop_id, NULL,
-			   &pidctrl_loop_thread, (void *)&data) == -1) {
-		fprintf(stderr, "Failed to create PID control loop thread\n");
-		goto out;
-	}
-	++status;
-
-	/* wait for the PID loop to run a couple of cycles */
-	sleep(1);
-
-	if (pthread_create(&data.heater_ctrl_id, NULL,
-			   &heater_control_thread, (void *)&data) == -1) {
-		fprintf(stderr, "Failed to create heater control thread\n");
-		data.stop_control_loop = 1;
-		pthread_join(data.ctrl_loop_id, NULL);
+	scheduler_init(&data.scheduler, 1000 * PID_CONTROL_LOOP_MS, &options);
+	if (setup_scheduler(&data) == -1) {
+		fprintf(stderr, "Failed to start control loop\n");
 		goto out;
 	}
 	++status;
@@ -324,10 +957,10 @@ int main(int argc, char **argv)
                         button_callback_handler(BUTTON_1_PIN, &data);
                         break;
                 case '.':
-                        update_target_temperature(data.pidctrl, 0.1);
+                        update_target_temperature(&data, 0.1);
                         break;
                 case ',':
-                        update_target_temperature(data.pidctrl, -0.1);
+                        update_target_temperature(&data, -0.1);
                         break;
                 case '-':
                         button_callback_handler(BUTTON_2_PIN, &data);
@@ -338,6 +971,31 @@ int main(int argc, char **argv)
                 case 'n':
                         button_callback_handler(BUTTON_4_PIN, &data);
                         break;
+                case 'c':
+                        calibrate_rtd_table(data.rtd_table);
+                        break;
+                case 'd':
+                        print_diagnostics(&data.maxim);
+                        scheduler_print_statistics(&data.scheduler, stdout);
+                        break;
+                case 'l':
+                        latency_print(stdout);
+                        break;
+                case 't':
+                        dump_trace();
+                        break;
+                case 'f':
+                        configure_filter(&data);
+                        break;
+                case 'a':
+                        request_autotune(&data);
+                        break;
+                case 'p':
+                        print_plant_model(&data);
+                        break;
+                case 's':
+                        select_controller(&data);
+                        break;
                 case 'q':
                         done = 1;
                         break;
@@ -346,25 +1004,25 @@ int main(int argc, char **argv)
 
 out:
 	switch (status) {
-	case 8:
-		data.stop_control_loop = 1;
-		pthread_join(data.ctrl_loop_id, NULL);
 	case 7:
-		data.stop_control_loop = 1;
-		pthread_join(data.heater_ctrl_id, NULL);
+		scheduler_cleanup(&data.scheduler);
 	case 6:
 		cleanup_SSR_output();
 		buttons_cleanup(data.buttons);
 	case 5:
+		ident_cleanup(&data.ident);
+		smith_cleanup(&data.smith);
+		pidctrl_free(data.smith_pidctrl);
 		pidctrl_free(data.pidctrl);
 	case 4:
 		motor_cleanup(&data.motor);
 	case 3:
 		max31865_cleanup(&data.maxim);
+		free(atomic_exchange(&data.pending_filter, NULL));
 	case 2:
-		rtd_table_free();
+		rtd_table_destroy(data.rtd_table);
 	case 1:
-		bcm2835_close();
+		hal_close();
 	}
 
 	if (status != 7) {
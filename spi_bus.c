@@ -0,0 +1,183 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "spi_bus.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include <pthread.h>
+
+#include "hal.h"
+
+/* The SPI peripheral is shared by all devices. Transfers are granted in the
+ * order they were requested (ticket lock), so a device that keeps the bus
+ * busy, e.g. a converter with a short conversion time, can't starve the
+ * others. */
+static struct
+{
+	atomic_uint next_ticket;
+	atomic_uint serving;
+	pthread_mutex_t mtx; /* only protects waiting on cond */
+	pthread_cond_t cond;
+	unsigned int num_devices;
+	const spi_device_t *current;
+} BUS = { 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0,
+	  NULL };
+
+static int is_gpio_cs(const uint8_t cs)
+{
+	return (cs & SPI_BUS_GPIO_CS_FLAG) != 0;
+}
+
+static uint8_t gpio_cs_pin(const uint8_t cs)
+{
+	return cs & ~SPI_BUS_GPIO_CS_FLAG;
+}
+
+/* Taking a ticket never blocks, so the order of the transfers is the order
+ * in which they were requested */
+static void acquire_bus(void)
+{
+	const unsigned int ticket = atomic_fetch_add(&BUS.next_ticket, 1);
+	if (atomic_load(&BUS.serving) == ticket) {
+		return;
+	}
+
+	pthread_mutex_lock(&BUS.mtx);
+	while (atomic_load(&BUS.serving) != ticket) {
+		pthread_cond_wait(&BUS.cond, &BUS.mtx);
+	}
+	pthread_mutex_unlock(&BUS.mtx);
+}
+
+static void release_bus(void)
+{
+	pthread_mutex_lock(&BUS.mtx);
+	atomic_fetch_add(&BUS.serving, 1);
+	pthread_cond_broadcast(&BUS.cond);
+	pthread_mutex_unlock(&BUS.mtx);
+}
+
+/* Configure the bus for dev, only called while holding the bus */
+static void select_device(const spi_device_t *dev)
+{
+	if (BUS.current == dev) {
+		return;
+	}
+
+	hal_spi_configure(dev->data_mode, dev->speed_hz,
+			  is_gpio_cs(dev->cs) ? HAL_SPI_CS_NONE : dev->cs);
+	BUS.current = dev;
+}
+
+/* The clock runs at the fastest rate the backend supports up to speed_hz */
+void spi_device_init(spi_device_t *dev, const uint8_t cs,
+		     const enum HAL_SPI_MODE data_mode, const uint32_t speed_hz)
+{
+	assert(dev != NULL);
+	assert(!dev->initialized);
+	assert(is_gpio_cs(cs) || cs < HAL_SPI_CS_NONE);
+	assert(speed_hz > 0);
+
+	dev->cs = cs;
+	dev->data_mode = data_mode;
+	dev->speed_hz = speed_hz;
+
+	acquire_bus();
+	if (BUS.num_devices++ == 0) {
+		hal_spi_begin();
+		BUS.current = NULL;
+	}
+
+	if (is_gpio_cs(cs)) {
+		/* active low, deselected until the first transfer */
+		hal_gpio_function(gpio_cs_pin(cs), HAL_GPIO_OUTPUT);
+		hal_gpio_write(gpio_cs_pin(cs), HAL_HIGH);
+	}
+	release_bus();
+
+	dev->initialized = 1;
+}
+
+void spi_device_cleanup(spi_device_t *dev)
+{
+	assert(dev != NULL);
+	assert(dev->initialized);
+
+	acquire_bus();
+	if (is_gpio_cs(dev->cs)) {
+		hal_gpio_function(gpio_cs_pin(dev->cs), HAL_GPIO_INPUT);
+	}
+	if (BUS.current == dev) {
+		BUS.current = NULL;
+	}
+	if (--BUS.num_devices == 0) {
+		hal_spi_end();
+	}
+	release_bus();
+
+	dev->initialized = 0;
+}
+
+/* Full duplex transfer of n bytes, data is replaced by the bytes read */
+void spi_device_transfer(const spi_device_t *dev, uint8_t *data,
+			 const size_t n)
+{
+	assert(dev != NULL);
+	assert(dev->initialized);
+
+	acquire_bus();
+	select_device(dev);
+	if (is_gpio_cs(dev->cs)) {
+		hal_gpio_write(gpio_cs_pin(dev->cs), HAL_LOW);
+		hal_spi_transfer(data, n);
+		hal_gpio_write(gpio_cs_pin(dev->cs), HAL_HIGH);
+	} else {
+		hal_spi_transfer(data, n);
+	}
+	release_bus();
+}
+
+/* Transfer the messages without releasing the bus in between, each one in
+ * its own chip select cycle. Backends that support it issue the whole batch
+ * with a single system call. */
+void spi_device_transfer_batch(const spi_device_t *dev,
+			       struct hal_spi_message *messages,
+			       const size_t n)
+{
+	assert(dev != NULL);
+	assert(dev->initialized);
+	assert(messages != NULL);
+
+	acquire_bus();
+	select_device(dev);
+	if (is_gpio_cs(dev->cs)) {
+		size_t i;
+		for (i = 0; i < n; ++i) {
+			hal_gpio_write(gpio_cs_pin(dev->cs), HAL_LOW);
+			hal_spi_transfer(messages[i].data, messages[i].n);
+			hal_gpio_write(gpio_cs_pin(dev->cs), HAL_HIGH);
+		}
+	} else {
+		hal_spi_transfer_batch(messages, n);
+	}
+	release_bus();
+}
@@ -0,0 +1,54 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_SPI_BUS_H
+#define SOUSVIDED_SPI_BUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+
+/* Chip select driven by a GPIO pin instead of the SPI peripheral's CS0/CS1,
+ * e.g. SPI_BUS_GPIO_CS(RPI_V2_GPIO_P1_29) */
+#define SPI_BUS_GPIO_CS_FLAG 0x80
+#define SPI_BUS_GPIO_CS(pin) (SPI_BUS_GPIO_CS_FLAG | (pin))
+
+/* A chip on the SPI bus. The bus is reconfigured for the device's chip
+ * select, data mode and clock whenever a transfer switches devices. */
+struct spi_device
+{
+	uint8_t initialized;
+	uint8_t cs;
+	enum HAL_SPI_MODE data_mode;
+	uint32_t speed_hz;
+};
+typedef struct spi_device spi_device_t;
+
+void spi_device_init(spi_device_t *dev, const uint8_t cs,
+		     const enum HAL_SPI_MODE data_mode, const uint32_t speed_hz);
+void spi_device_cleanup(spi_device_t *dev);
+
+void spi_device_transfer(const spi_device_t *dev, uint8_t *data,
+			 const size_t n);
+void spi_device_transfer_batch(const spi_device_t *dev,
+			       struct hal_spi_message *messages,
+			       const size_t n);
+
+#endif /* SOUSVIDED_SPI_BUS_H */
@@ -0,0 +1,283 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "trace.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define TRACE_BUFFER_MASK (TRACE_BUFFER_EVENTS - 1)
+
+enum TRACE_PHASE {
+	TRACE_PHASE_SLICE = 0,
+	TRACE_PHASE_COUNTER
+};
+
+struct trace_event
+{
+	/* 1 + index of the event in the slot, 0 while it's being written */
+	atomic_ullong sequence;
+	const char *name;
+	uint64_t timestamp_ns;
+	uint64_t duration_ns;
+	double value;
+	int32_t tid;
+	uint32_t sample;
+	uint8_t phase;
+	uint8_t flow;
+};
+
+struct trace_thread
+{
+	atomic_int tid; /* 0 until name is set */
+	const char *name;
+};
+
+static struct
+{
+	atomic_ullong head;
+	struct trace_event events[TRACE_BUFFER_EVENTS];
+	atomic_uint num_threads;
+	struct trace_thread threads[TRACE_MAX_THREADS];
+} TRACE;
+
+static _Thread_local int32_t TID;
+
+static int32_t thread_id(void)
+{
+	if (!TID) {
+		TID = syscall(SYS_gettid);
+	}
+	return TID;
+}
+
+uint64_t trace_timestamp(const struct timespec *t)
+{
+	assert(t != NULL);
+	return (uint64_t)t->tv_sec * 1000000000 + t->tv_nsec;
+}
+
+uint64_t trace_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return trace_timestamp(&now);
+}
+
+/* Name the calling thread in the trace, names of threads beyond
+ * TRACE_MAX_THREADS are dropped */
+void trace_thread_name(const char *name)
+{
+	assert(name != NULL);
+
+	const unsigned int i = atomic_fetch_add(&TRACE.num_threads, 1);
+	if (i < TRACE_MAX_THREADS) {
+		TRACE.threads[i].name = name;
+		atomic_store_explicit(&TRACE.threads[i].tid, thread_id(),
+				      memory_order_release);
+	}
+}
+
+static void record(const struct trace_event *event)
+{
+	const uint64_t index =
+	    atomic_fetch_add_explicit(&TRACE.head, 1, memory_order_relaxed);
+	struct trace_event *slot = &TRACE.events[index & TRACE_BUFFER_MASK];
+
+	atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->name = event->name;
+	slot->timestamp_ns = event->timestamp_ns;
+	slot->duration_ns = event->duration_ns;
+	slot->value = event->value;
+	slot->tid = event->tid;
+	slot->sample = event->sample;
+	slot->phase = event->phase;
+	slot->flow = event->flow;
+
+	atomic_store_explicit(&slot->sequence, index + 1,
+			      memory_order_release);
+}
+
+/* A stage that started at start_ns and ends now. sample is the sequence
+ * number of the sample the stage works on, 0 if there is none. */
+void trace_slice(const char *name, const uint64_t start_ns,
+		 const uint32_t sample, const enum TRACE_FLOW flow)
+{
+	struct trace_event event;
+
+	assert(name != NULL);
+
+	const uint64_t now = trace_now();
+	event.name = name;
+	event.timestamp_ns = start_ns;
+	event.duration_ns = now > start_ns ? now - start_ns : 0;
+	event.value = 0.0;
+	event.tid = thread_id();
+	event.sample = sample;
+	event.phase = TRACE_PHASE_SLICE;
+	event.flow = sample ? flow : TRACE_FLOW_NONE;
+	record(&event);
+}
+
+void trace_counter(const char *name, const double value)
+{
+	struct trace_event event;
+
+	assert(name != NULL);
+
+	event.name = name;
+	event.timestamp_ns = trace_now();
+	event.duration_ns = 0;
+	event.value = value;
+	event.tid = thread_id();
+	event.sample = 0;
+	event.phase = TRACE_PHASE_COUNTER;
+	event.flow = TRACE_FLOW_NONE;
+	record(&event);
+}
+
+/* Copy the event with the given index. Returns 0 if it was overwritten or
+ * is still being written. */
+static int read_event(const uint64_t index, struct trace_event *event)
+{
+	struct trace_event *slot = &TRACE.events[index & TRACE_BUFFER_MASK];
+
+	if (atomic_load_explicit(&slot->sequence, memory_order_acquire) !=
+	    index + 1) {
+		return 0;
+	}
+
+	event->name = slot->name;
+	event->timestamp_ns = slot->timestamp_ns;
+	event->duration_ns = slot->duration_ns;
+	event->value = slot->value;
+	event->tid = slot->tid;
+	event->sample = slot->sample;
+	event->phase = slot->phase;
+	event->flow = slot->flow;
+
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&slot->sequence, memory_order_relaxed) ==
+	       index + 1;
+}
+
+static void write_event(FILE *stream, const struct trace_event *event,
+			const int pid)
+{
+	static const char FLOW_PHASES[] = { ' ', 's', 't', 'f' };
+	const double ts = event->timestamp_ns / 1.0E3;
+
+	if (event->phase == TRACE_PHASE_COUNTER) {
+		/* JSON has no nan or inf, e.g. from a broken RTD */
+		if (!isfinite(event->value)) {
+			return;
+		}
+		fprintf(stream, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,"
+				"\"pid\":%d,\"args\":{\"value\":%g}}",
+			event->name, ts, pid, event->value);
+		return;
+	}
+
+	fprintf(stream, ",\n{\"name\":\"%s\",\"cat\":\"control\",\"ph\":\"X\","
+			"\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+		event->name, ts, event->duration_ns / 1.0E3, pid,
+		(int)event->tid);
+	if (event->sample) {
+		fprintf(stream, ",\"args\":{\"sample\":%u}",
+			(unsigned int)event->sample);
+	}
+	fprintf(stream, "}");
+
+	/* flow events bind to the slice they are in */
+	if (event->flow != TRACE_FLOW_NONE) {
+		fprintf(stream, ",\n{\"name\":\"sample\",\"cat\":\"sample\","
+				"\"ph\":\"%c\",\"bp\":\"e\",\"id\":%u,"
+				"\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+			FLOW_PHASES[event->flow], (unsigned int)event->sample,
+			ts, pid, (int)event->tid);
+	}
+}
+
+/* Write the events in the buffer to path, oldest first. Events recorded
+ * while dumping may or may not be included. */
+int trace_dump(const char *path)
+{
+	struct trace_event event;
+	unsigned int i;
+
+	assert(path != NULL);
+
+	FILE *stream = fopen(path, "w");
+	if (!stream) {
+		fprintf(stderr, "Failed to open %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+
+	const int pid = getpid();
+	fprintf(stream, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+			"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"args\":{\"name\":\"sousvided\"}}",
+		pid);
+
+	unsigned int num_threads = atomic_load(&TRACE.num_threads);
+	if (num_threads > TRACE_MAX_THREADS) {
+		num_threads = TRACE_MAX_THREADS;
+	}
+	for (i = 0; i < num_threads; ++i) {
+		const int tid = atomic_load_explicit(&TRACE.threads[i].tid,
+						     memory_order_acquire);
+		if (tid) {
+			fprintf(stream, ",\n{\"name\":\"thread_name\","
+					"\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+					"\"args\":{\"name\":\"%s\"}}",
+				pid, tid, TRACE.threads[i].name);
+		}
+	}
+
+	const uint64_t head =
+	    atomic_load_explicit(&TRACE.head, memory_order_acquire);
+	uint64_t index = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS
+						    : 0;
+	size_t count = 0;
+	for (; index < head; ++index) {
+		if (read_event(index, &event)) {
+			write_event(stream, &event, pid);
+			++count;
+		}
+	}
+	fprintf(stream, "\n]}\n");
+
+	if (fclose(stream) != 0) {
+		fprintf(stderr, "Failed to write %s: %s\n", path,
+			strerror(errno));
+		return -1;
+	}
+	printf("Wrote %zu trace events to %s\n", count, path);
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*
+sousvided the Sous Vide deamon for the RaspberryPi
+Copyright (C) 2015  Nima Saed-Samii
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#ifndef SOUSVIDED_TRACE_H
+#define SOUSVIDED_TRACE_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Fixed-size in-memory trace of the control path, written lock-free by any
+ * thread and dumped as Chrome trace-event JSON for chrome://tracing or
+ * ui.perfetto.dev. The oldest events are overwritten. Events of the same
+ * sample are linked by flow arrows, identified by the sample's sequence
+ * number in the MAX31865 sample ring. */
+
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 16384 /* power of two */
+#endif
+
+#define TRACE_MAX_THREADS 16
+
+/* Position of an event in the chain of its sample */
+enum TRACE_FLOW {
+	TRACE_FLOW_NONE = 0,
+	TRACE_FLOW_START,
+	TRACE_FLOW_STEP,
+	TRACE_FLOW_END
+};
+
+uint64_t trace_now(void);
+uint64_t trace_timestamp(const struct timespec *t);
+
+void trace_thread_name(const char *name);
+
+void trace_slice(const char *name, const uint64_t start_ns,
+		 const uint32_t sample, const enum TRACE_FLOW flow);
+void trace_counter(const char *name, const double value);
+
+int trace_dump(const char *path);
+
+#endif /* SOUSVIDED_TRACE_H */